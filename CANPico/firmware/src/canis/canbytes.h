@@ -0,0 +1,43 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Byte packing
+// ============
+//
+// Helpers for the big-endian words of the binary snapshots and records built by the portable modules. These
+// modules do not include the MicroPython headers, so they cannot use BIG_ENDIAN_BUF from common.h.
+
+#ifndef CANBYTES_H
+#define CANBYTES_H
+
+#include <inttypes.h>
+
+/// \brief Write a word to a buffer in big-endian order
+static inline void canbytes_put_word(uint8_t *buf, uint32_t word)
+{
+    buf[0] = (uint8_t)(word >> 24);
+    buf[1] = (uint8_t)(word >> 16);
+    buf[2] = (uint8_t)(word >> 8);
+    buf[3] = (uint8_t)word;
+}
+
+/// \brief Read a big-endian word from a buffer
+static inline uint32_t canbytes_get_word(const uint8_t *buf)
+{
+    return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | buf[3];
+}
+
+#endif // CANBYTES_H
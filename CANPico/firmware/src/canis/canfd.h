@@ -0,0 +1,76 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// CAN FD frames
+// =============
+//
+// A CAN FD frame carries up to 64 bytes, with the DLC codes 9 to 15 meaning 12, 16, 20, 24, 32, 48 and 64
+// bytes. The binary formats of rp2_can.h mark an FD frame with flag bits in byte 0 and carry its whole payload
+// from byte 11, so an FD record is 11 bytes plus the payload, padded to at least the 19 bytes of a classic
+// frame's record.
+//
+// The CAN driver only handles classic frames, so for now FD frames can be made, converted to and from bytes and
+// logged, but not sent or received.
+
+#ifndef CANFD_H
+#define CANFD_H
+
+#include <inttypes.h>
+
+#define CANFD_MAX_DATA                      (64U)
+
+// Flags in byte 0 of a binary record (bit 7 is the remote flag, which FD frames do not have)
+#define CANFD_FLAG_FD                       (0x10U)     // FD frame (FDF bit)
+#define CANFD_FLAG_BRS                      (0x20U)     // Data phase sent at the fast bit rate
+#define CANFD_FLAG_ESI                      (0x40U)     // Transmitter was error passive
+
+// Binary record sizes: the fields before the payload, a classic frame, and the largest FD frame
+#define CANFD_RECORD_HEADER                 (11U)
+#define CANFD_RECORD_CLASSIC                (19U)
+#define CANFD_RECORD_MAX                    (CANFD_RECORD_HEADER + CANFD_MAX_DATA)
+
+/// \brief Payload length of an FD frame's DLC
+static inline uint32_t canfd_dlc_to_len(uint8_t dlc)
+{
+    static const uint8_t lens[16] = {0, 1U, 2U, 3U, 4U, 5U, 6U, 7U, 8U, 12U, 16U, 20U, 24U, 32U, 48U, 64U};
+
+    return lens[dlc & 0x0fU];
+}
+
+/// \brief Smallest DLC of an FD frame carrying a payload length (15 if longer than 64 bytes)
+static inline uint8_t canfd_len_to_dlc(uint32_t len)
+{
+    uint8_t dlc = 0;
+
+    while (dlc < 15U && canfd_dlc_to_len(dlc) < len) {
+        dlc++;
+    }
+
+    return dlc;
+}
+
+/// \brief Size of a binary record from its flags (byte 0) and DLC (byte 5)
+static inline uint32_t canfd_record_size(uint8_t flags, uint8_t dlc)
+{
+    if ((flags & CANFD_FLAG_FD) == 0) {
+        return CANFD_RECORD_CLASSIC;
+    }
+    uint32_t len = canfd_dlc_to_len(dlc);
+
+    return CANFD_RECORD_HEADER + (len < 8U ? 8U : len);
+}
+
+#endif // CANFD_H
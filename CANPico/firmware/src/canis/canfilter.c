@@ -0,0 +1,262 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "canfilter.h"
+
+// Marks a cube that has been merged away (real masks never use bit 31)
+#define DEAD                                (0x80000000U)
+#define NO_PARTNER                          (0xffffffffU)
+
+static uint32_t popcount(uint32_t x)
+{
+    uint32_t n = 0;
+    while (x) {
+        x &= x - 1U;
+        n++;
+    }
+    return n;
+}
+
+static uint32_t id_mask(const canfilter_compiler_t *c)
+{
+    return (1U << c->id_bits) - 1U;
+}
+
+// Number of IDs matched by a cube
+static uint32_t volume(const canfilter_compiler_t *c, canfilter_cube_t cube)
+{
+    return 1U << (c->id_bits - popcount(cube.mask & id_mask(c)));
+}
+
+// Smallest cube containing both cubes
+static canfilter_cube_t merge(canfilter_cube_t a, canfilter_cube_t b)
+{
+    canfilter_cube_t m;
+
+    m.mask = a.mask & b.mask & ~(a.match ^ b.match);
+    m.match = a.match & m.mask;
+
+    return m;
+}
+
+// True if cube b lies entirely inside cube a
+static bool contains(canfilter_cube_t a, canfilter_cube_t b)
+{
+    return ((a.mask & ~b.mask) == 0) && (((a.match ^ b.match) & a.mask) == 0);
+}
+
+// Number of extra IDs let through by merging two (disjoint) cubes
+static uint32_t merge_cost(const canfilter_compiler_t *c, canfilter_cube_t a, canfilter_cube_t b)
+{
+    uint32_t va = volume(c, a);
+    uint32_t vb = volume(c, b);
+    uint32_t vm = volume(c, merge(a, b));
+
+    return vm > va + vb ? vm - va - vb : 0;
+}
+
+static bool is_dead(const canfilter_compiler_t *c, size_t i)
+{
+    return (c->cubes[i].mask & DEAD) != 0;
+}
+
+// Finds the cheapest partner for cube i by scanning all the live cubes
+static void find_best(canfilter_compiler_t *c, size_t i)
+{
+    c->best[i] = NO_PARTNER;
+    c->best_cost[i] = 0xffffffffU;
+
+    for (size_t k = 0; k < c->n_cubes; k++) {
+        if (k != i && !is_dead(c, k)) {
+            uint32_t cost = merge_cost(c, c->cubes[i], c->cubes[k]);
+            if (cost < c->best_cost[i]) {
+                c->best[i] = k;
+                c->best_cost[i] = cost;
+            }
+        }
+    }
+}
+
+// Kills every cube inside cube i (they are covered by it anyway)
+static size_t kill_contained(canfilter_compiler_t *c, size_t i)
+{
+    size_t killed = 0;
+
+    for (size_t k = 0; k < c->n_cubes; k++) {
+        if (k != i && !is_dead(c, k) && contains(c->cubes[i], c->cubes[k])) {
+            c->cubes[k].mask |= DEAD;
+            killed++;
+        }
+    }
+
+    return killed;
+}
+
+// Moves the live cubes to the front of the array
+static void compact(canfilter_compiler_t *c)
+{
+    size_t n = 0;
+
+    for (size_t k = 0; k < c->n_cubes; k++) {
+        if (!is_dead(c, k)) {
+            c->cubes[n++] = c->cubes[k];
+        }
+    }
+    c->n_cubes = n;
+}
+
+void canfilter_init(canfilter_compiler_t *c, canfilter_cube_t *cubes, uint32_t *best, uint32_t *best_cost, size_t max_cubes, bool extended)
+{
+    c->cubes = cubes;
+    c->best = best;
+    c->best_cost = best_cost;
+    c->n_cubes = 0;
+    c->max_cubes = max_cubes;
+    c->id_bits = extended ? CANFILTER_EXTENDED_BITS : CANFILTER_STANDARD_BITS;
+    c->wanted = 0;
+}
+
+bool canfilter_add_id(canfilter_compiler_t *c, uint32_t id)
+{
+    if (c->n_cubes >= c->max_cubes) {
+        return false;
+    }
+    c->cubes[c->n_cubes].match = id & id_mask(c);
+    c->cubes[c->n_cubes].mask = id_mask(c);
+    c->n_cubes++;
+
+    return true;
+}
+
+bool canfilter_add_range(canfilter_compiler_t *c, uint32_t lo, uint32_t hi)
+{
+    uint64_t start = lo & id_mask(c);
+    uint64_t end = hi & id_mask(c);
+
+    // Take the biggest aligned block that starts at 'start' and does not go past 'end'
+    while (start <= end) {
+        uint32_t k = 0;
+        while (k < c->id_bits && (start & ((2ULL << k) - 1ULL)) == 0 && start + (2ULL << k) - 1ULL <= end) {
+            k++;
+        }
+        if (c->n_cubes >= c->max_cubes) {
+            return false;
+        }
+        c->cubes[c->n_cubes].match = (uint32_t)start;
+        c->cubes[c->n_cubes].mask = id_mask(c) & ~((1U << k) - 1U);
+        c->n_cubes++;
+        start += 1ULL << k;
+    }
+
+    return true;
+}
+
+uint32_t canfilter_compile(canfilter_compiler_t *c, size_t max_filters)
+{
+    // Remove duplicates and nested cubes so that the remaining cubes are disjoint
+    for (size_t i = 0; i < c->n_cubes; i++) {
+        if (!is_dead(c, i)) {
+            kill_contained(c, i);
+        }
+    }
+    compact(c);
+
+    c->wanted = 0;
+    for (size_t i = 0; i < c->n_cubes; i++) {
+        c->wanted += volume(c, c->cubes[i]);
+    }
+
+    size_t n_live = c->n_cubes;
+    if (n_live > max_filters && max_filters > 0) {
+        for (size_t i = 0; i < c->n_cubes; i++) {
+            find_best(c, i);
+        }
+    }
+
+    while (n_live > max_filters && max_filters > 0) {
+        // Pick the cheapest merge
+        size_t i = NO_PARTNER;
+        for (size_t k = 0; k < c->n_cubes; k++) {
+            if (!is_dead(c, k) && (i == NO_PARTNER || c->best_cost[k] < c->best_cost[i])) {
+                i = k;
+            }
+        }
+        size_t j = c->best[i];
+
+        c->cubes[i] = merge(c->cubes[i], c->cubes[j]);
+        c->cubes[j].mask |= DEAD;
+        n_live--;
+        n_live -= kill_contained(c, i);
+
+        // Only cubes whose partner has gone need a full rescan; the rest just check the new cube
+        find_best(c, i);
+        for (size_t k = 0; k < c->n_cubes; k++) {
+            if (k == i || is_dead(c, k)) {
+                continue;
+            }
+            uint32_t partner = c->best[k];
+            if (partner == NO_PARTNER || partner == i || is_dead(c, partner)) {
+                find_best(c, k);
+            }
+            else {
+                uint32_t cost = merge_cost(c, c->cubes[k], c->cubes[i]);
+                if (cost < c->best_cost[k]) {
+                    c->best[k] = i;
+                    c->best_cost[k] = cost;
+                }
+            }
+        }
+    }
+    compact(c);
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < c->n_cubes; i++) {
+        total += volume(c, c->cubes[i]);
+    }
+    total = total > c->wanted ? total - c->wanted : 0;
+
+    return total > 0xffffffffULL ? 0xffffffffU : (uint32_t)total;
+}
+
+size_t canfilter_idset_size(size_t n_keys)
+{
+    size_t size = 8U;
+
+    while (size < 2U * n_keys) {
+        size <<= 1;
+    }
+
+    return size;
+}
+
+void canfilter_idset_init(canfilter_idset_t *set, uint32_t *keys, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        keys[i] = CANFILTER_IDSET_EMPTY;
+    }
+    set->keys = keys;
+    set->mask = size - 1U;
+}
+
+void canfilter_idset_add(canfilter_idset_t *set, uint32_t key)
+{
+    uint32_t i = canfilter_idset_hash(key) & set->mask;
+
+    while (set->keys[i] != CANFILTER_IDSET_EMPTY && set->keys[i] != key) {
+        i = (i + 1U) & set->mask;
+    }
+    set->keys[i] = key;
+}
@@ -0,0 +1,133 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Acceptance filter compiler
+// ==========================
+//
+// The CAN controller has a small number of mask/match acceptance filters. Applications usually have a list of
+// a few hundred IDs of interest, so the list is compiled down into a set of mask/match pairs ("cubes") that fit
+// the hardware. Each cube matches 2^n IDs, where n is the number of don't-care bits in the mask.
+//
+// The compiler works in two stages:
+//
+// 1. Each ID becomes a cube with all mask bits set, and each range of IDs is split into the minimum number of
+//    prefix cubes. Prefix cubes are either nested or disjoint, so once nested cubes are removed the cubes are
+//    disjoint and their total volume is the number of wanted IDs.
+//
+// 2. The pair of cubes with the cheapest merge (fewest extra IDs let in) is repeatedly merged until the cubes fit
+//    the number of filters available. Merges that cost nothing (e.g. 0x100 and 0x101 becoming 0x10X) are always
+//    taken first. Each cube tracks its cheapest partner so that a merge only rescans the cubes it affects.
+//
+// The false positives let through by the compiled filters are removed by the ID set (see below) in the receive
+// path.
+
+#ifndef CANFILTER_H
+#define CANFILTER_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define CANFILTER_STANDARD_BITS             (11U)
+#define CANFILTER_EXTENDED_BITS             (29U)
+
+// Maximum number of cubes a range can be split into
+#define CANFILTER_MAX_RANGE_CUBES(bits)     (2U * (bits))
+
+typedef struct {
+    uint32_t match;                             // Value of the bits that must match
+    uint32_t mask;                              // 1 = bit must match, 0 = don't care
+} canfilter_cube_t;
+
+// Working space for the compiler (provided by the caller because there is no heap in portable code)
+typedef struct {
+    canfilter_cube_t *cubes;                    // Cubes (grows as IDs and ranges are added)
+    uint32_t *best;                             // Index of the cheapest partner of each cube
+    uint32_t *best_cost;                        // Cost of merging with the cheapest partner
+    size_t n_cubes;
+    size_t max_cubes;                           // Size of the arrays
+    uint32_t id_bits;                           // 11 or 29
+    uint32_t wanted;                            // Number of IDs wanted (valid after canfilter_compile())
+} canfilter_compiler_t;
+
+/// \brief Initialize the compiler with caller-provided working space
+/// \param c the compiler
+/// \param cubes space for max_cubes cubes
+/// \param best space for max_cubes words
+/// \param best_cost space for max_cubes words
+/// \param max_cubes number of entries in each array
+/// \param extended true if compiling 29-bit IDs
+void canfilter_init(canfilter_compiler_t *c, canfilter_cube_t *cubes, uint32_t *best, uint32_t *best_cost, size_t max_cubes, bool extended);
+
+/// \brief Add a single ID
+/// \return false if there is no room
+bool canfilter_add_id(canfilter_compiler_t *c, uint32_t id);
+
+/// \brief Add an inclusive range of IDs (split into prefix cubes)
+/// \return false if there is no room
+bool canfilter_add_range(canfilter_compiler_t *c, uint32_t lo, uint32_t hi);
+
+/// \brief Merge cubes until there are no more than max_filters
+/// \return number of IDs let through that were not asked for (an upper bound if merged cubes overlap)
+uint32_t canfilter_compile(canfilter_compiler_t *c, size_t max_filters);
+
+// Software ID set
+// ===============
+//
+// Open-addressing hash set of 32-bit keys (the ID with the IDE flag in bit 31) with linear probing. The table
+// size is a power of two at least twice the number of keys so that a lookup is usually a single probe. Looked
+// up from the receive ISR so there is no allocation and no locking: the table is only ever replaced as a whole.
+
+#define CANFILTER_IDSET_EMPTY               (0xffffffffU)
+#define CANFILTER_IDSET_KEY(ide, id)        (((ide) ? 0x80000000U : 0) | (id))
+
+typedef struct {
+    uint32_t *keys;                             // Table of keys, CANFILTER_IDSET_EMPTY if slot is unused
+    uint32_t mask;                              // Table size - 1
+} canfilter_idset_t;
+
+/// \brief Table size needed for a number of keys
+size_t canfilter_idset_size(size_t n_keys);
+
+/// \brief Initialize the set with a table of canfilter_idset_size() words
+void canfilter_idset_init(canfilter_idset_t *set, uint32_t *keys, size_t size);
+
+/// \brief Add a key to the set
+void canfilter_idset_add(canfilter_idset_t *set, uint32_t key);
+
+// Fibonacci hashing spreads sequential IDs over the table
+static inline uint32_t canfilter_idset_hash(uint32_t key)
+{
+    return (key * 0x9e3779b1U) >> 16;
+}
+
+static inline bool canfilter_idset_contains(const canfilter_idset_t *set, uint32_t key)
+{
+    uint32_t i = canfilter_idset_hash(key) & set->mask;
+
+    for (;;) {
+        uint32_t k = set->keys[i];
+        if (k == key) {
+            return true;
+        }
+        if (k == CANFILTER_IDSET_EMPTY) {
+            return false;
+        }
+        i = (i + 1U) & set->mask;
+    }
+}
+
+#endif // CANFILTER_H
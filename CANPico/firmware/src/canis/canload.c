@@ -0,0 +1,201 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <string.h>
+
+#include "canload.h"
+
+// CRC delimiter, ACK slot, ACK delimiter and EOF, then intermission
+#define TAIL_BITS                           (10U + 3U)
+
+// Stuffing state is the value of the last bit and the length of the run of that value (0 before SOF)
+#define STATE(bit, run)                     ((bit) * 5U + (run))
+#define STATE_START                         STATE(1U, 0)
+
+static uint16_t crc_table[256];
+// Indexed by stuffing state and the next four bits: bits 3:0 are the new state, bits 7:4 the stuff bits added
+static uint8_t stuff_table[10][16];
+
+// Moves the stuffing state on by one bit
+static uint32_t stuff_step(uint32_t state, uint32_t bit, uint32_t *stuff)
+{
+    uint32_t value = state / 5U;
+    uint32_t run = state % 5U;
+
+    if (run > 0 && bit == value) {
+        run++;
+    }
+    else {
+        value = bit;
+        run = 1U;
+    }
+    if (run == 5U) {
+        // The stuff bit has the opposite value and starts a new run
+        (*stuff)++;
+        value ^= 1U;
+        run = 1U;
+    }
+
+    return STATE(value, run);
+}
+
+void canload_init_tables(void)
+{
+    for (uint32_t i = 0; i < 256U; i++) {
+        uint32_t crc = i << 7;
+        for (uint32_t j = 0; j < 8U; j++) {
+            crc = (crc & 0x4000U) ? ((crc << 1) ^ 0x4599U) : (crc << 1);
+        }
+        crc_table[i] = (uint16_t)(crc & 0x7fffU);
+    }
+
+    for (uint32_t state = 0; state < 10U; state++) {
+        for (uint32_t nibble = 0; nibble < 16U; nibble++) {
+            uint32_t stuff = 0;
+            uint32_t s = state;
+            for (uint32_t j = 0; j < 4U; j++) {
+                s = stuff_step(s, (nibble >> (3U - j)) & 1U, &stuff);
+            }
+            stuff_table[state][nibble] = (uint8_t)((stuff << 4) | s);
+        }
+    }
+}
+
+// Appends bits (most significant first) to a bitstream
+static void put_bits(uint8_t *buf, uint32_t *n_bits, uint32_t value, uint32_t count)
+{
+    for (uint32_t i = count; i > 0; i--) {
+        if ((value >> (i - 1U)) & 1U) {
+            buf[*n_bits >> 3] |= 0x80U >> (*n_bits & 7U);
+        }
+        (*n_bits)++;
+    }
+}
+
+static uint32_t get_bit(const uint8_t *buf, uint32_t i)
+{
+    return (buf[i >> 3] >> (7U - (i & 7U))) & 1U;
+}
+
+uint32_t canload_frame_bits(bool ide, uint32_t arbitration_id, bool remote, uint8_t dlc, const uint8_t *data)
+{
+    // Longest stuffed region is an extended frame with 8 bytes: 54 + 64 = 118 bits
+    uint8_t buf[16];
+    uint32_t n = 0;
+    uint32_t len = remote ? 0 : (dlc >= 8U ? 8U : dlc);
+
+    memset(buf, 0, sizeof(buf));
+
+    // SOF
+    put_bits(buf, &n, 0, 1U);
+    if (ide) {
+        // ID A, SRR, IDE, ID B, RTR, r1, r0
+        put_bits(buf, &n, arbitration_id >> 18, 11U);
+        put_bits(buf, &n, 3U, 2U);
+        put_bits(buf, &n, arbitration_id & 0x3ffffU, 18U);
+        put_bits(buf, &n, remote ? 1U : 0, 1U);
+        put_bits(buf, &n, 0, 2U);
+    }
+    else {
+        // ID A, RTR, IDE, r0
+        put_bits(buf, &n, arbitration_id & 0x7ffU, 11U);
+        put_bits(buf, &n, remote ? 1U : 0, 1U);
+        put_bits(buf, &n, 0, 2U);
+    }
+    put_bits(buf, &n, dlc & 0xfU, 4U);
+    for (uint32_t i = 0; i < len; i++) {
+        put_bits(buf, &n, data[i], 8U);
+    }
+
+    // CRC over SOF to the end of the data, a byte at a time then the bits left over
+    uint32_t crc = 0;
+    uint32_t full = n >> 3;
+    for (uint32_t i = 0; i < full; i++) {
+        crc = ((crc << 8) ^ crc_table[((crc >> 7) ^ buf[i]) & 0xffU]) & 0x7fffU;
+    }
+    for (uint32_t i = full << 3; i < n; i++) {
+        uint32_t crc_nxt = get_bit(buf, i) ^ ((crc >> 14) & 1U);
+        crc = (crc << 1) & 0x7fffU;
+        if (crc_nxt) {
+            crc ^= 0x4599U;
+        }
+    }
+    put_bits(buf, &n, crc, 15U);
+
+    // Stuff bits from SOF to the end of the CRC, a nibble at a time then the bits left over
+    uint32_t stuff = 0;
+    uint32_t state = STATE_START;
+    uint32_t nibbles = n >> 2;
+    for (uint32_t i = 0; i < nibbles; i++) {
+        uint32_t nibble = (i & 1U) ? (buf[i >> 1] & 0xfU) : (buf[i >> 1] >> 4);
+        uint32_t entry = stuff_table[state][nibble];
+        stuff += entry >> 4;
+        state = entry & 0xfU;
+    }
+    for (uint32_t i = nibbles << 2; i < n; i++) {
+        state = stuff_step(state, get_bit(buf, i), &stuff);
+    }
+
+    return n + stuff + TAIL_BITS;
+}
+
+// Record the load of a finished window
+static void record(canload_t *load, uint64_t bits)
+{
+    uint64_t l = (bits * 1000000ULL * CANLOAD_FULL) / ((uint64_t)load->bitrate * load->window);
+    uint32_t window_load = l > CANLOAD_FULL ? CANLOAD_FULL : (uint32_t)l;
+
+    load->last_load = window_load;
+    if (window_load > load->peak_load) {
+        load->peak_load = window_load;
+    }
+    load->history[load->history_next] = (uint16_t)window_load;
+    load->history_next = (load->history_next + 1U) % CANLOAD_HISTORY_SIZE;
+    if (load->n_history < CANLOAD_HISTORY_SIZE) {
+        load->n_history++;
+    }
+}
+
+void canload_start(canload_t *load, uint32_t bitrate, uint32_t window, uint64_t now)
+{
+    load->bitrate = bitrate;
+    load->window = window;
+    load->window_start = now;
+    load->bits = 0;
+    load->last_load = 0;
+    load->peak_load = 0;
+    load->history_next = 0;
+    load->n_history = 0;
+    load->total_bits = 0;
+    load->enabled = true;
+}
+
+void canload_advance(canload_t *load, uint64_t now)
+{
+    if (now < load->window_start + load->window) {
+        return;
+    }
+    record(load, load->bits);
+    load->bits = 0;
+    load->window_start += load->window;
+
+    // Windows with no traffic at all
+    uint64_t idle = (now - load->window_start) / load->window;
+    for (uint64_t i = 0; i < idle && i < CANLOAD_HISTORY_SIZE; i++) {
+        record(load, 0);
+    }
+    load->window_start += idle * load->window;
+}
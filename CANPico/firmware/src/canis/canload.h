@@ -0,0 +1,84 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Bus load meter
+// ==============
+//
+// The bus time taken by a frame is worked out exactly: the frame is laid out as a bitstream from SOF to the end
+// of the CRC (the same layout as canhack_set_frame()), the CRC is computed a byte at a time from a table, and
+// the stuff bits are counted a nibble at a time from a table indexed by the stuffing state (the value and run
+// length of the last bits) and the next four bits. The fixed-form fields (CRC delimiter, ACK, EOF) and the
+// intermission are then added.
+//
+// An error frame is counted as a superposed error flag (12 bits), the error delimiter (8 bits) and intermission
+// (3 bits). The part of the frame destroyed by the error is not known so is not counted.
+//
+// Load is measured over fixed windows of time and kept in hundredths of a percent. A ring keeps the load of the
+// most recent windows and the peak window load is kept since the meter was started.
+
+#ifndef CANLOAD_H
+#define CANLOAD_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define CANLOAD_ERROR_FRAME_BITS            (23U)
+// Number of windows kept in the history ring
+#define CANLOAD_HISTORY_SIZE                (64U)
+// Load of a full bus
+#define CANLOAD_FULL                        (10000U)
+
+typedef struct {
+    bool enabled;
+    uint32_t bitrate;                           // Bits per second
+    uint32_t window;                            // Microseconds
+    uint64_t window_start;                      // Time the current window started (microseconds)
+    uint64_t bits;                              // Bits in the current window
+    uint32_t last_load;                         // Load of the last complete window
+    uint32_t peak_load;                         // Highest window load since the meter was started
+    uint16_t history[CANLOAD_HISTORY_SIZE];     // Load of the most recent windows
+    uint32_t history_next;                      // Where the next window load goes
+    uint32_t n_history;
+    uint64_t total_bits;                        // Bits since the meter was started
+} canload_t;
+
+/// \brief Build the CRC and stuffing tables (must be called before canload_frame_bits())
+void canload_init_tables(void);
+
+/// \brief Number of bits a frame takes on the bus, including stuff bits and intermission
+uint32_t canload_frame_bits(bool ide, uint32_t arbitration_id, bool remote, uint8_t dlc, const uint8_t *data);
+
+/// \brief Start the meter
+/// \param bitrate bits per second
+/// \param window window length in microseconds
+/// \param now time now in microseconds
+void canload_start(canload_t *load, uint32_t bitrate, uint32_t window, uint64_t now);
+
+/// \brief Close the windows that have ended by a time
+void canload_advance(canload_t *load, uint64_t now);
+
+/// \brief Add bus activity that started at a time
+static inline void canload_add(canload_t *load, uint32_t bits, uint64_t timestamp)
+{
+    if (timestamp >= load->window_start + load->window) {
+        canload_advance(load, timestamp);
+    }
+    load->bits += bits;
+    load->total_bits += bits;
+}
+
+#endif // CANLOAD_H
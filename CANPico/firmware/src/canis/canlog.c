@@ -0,0 +1,197 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <string.h>
+
+#include "canbytes.h"
+#include "canfd.h"
+#include "canlog.h"
+
+static void start_block(canlog_t *log)
+{
+    memset(log->blocks[log->current], 0, CANLOG_BLOCK_SIZE);
+    log->used = CANLOG_HEADER_SIZE;
+    log->n_records = 0;
+    log->block_dropped = log->dropped;
+    log->dropped = 0;
+    log->n_ids = 0;
+    memset(log->dict_keys, 0, sizeof(log->dict_keys));
+}
+
+void canlog_init(canlog_t *log, uint8_t *block0, uint8_t *block1)
+{
+    log->blocks[0] = block0;
+    log->blocks[1] = block1;
+    log->full[0] = false;
+    log->full[1] = false;
+    log->current = 0;
+    log->seq = 0;
+    log->dropped = 0;
+    log->records = 0;
+    log->total_dropped = 0;
+    start_block(log);
+}
+
+bool canlog_close_block(canlog_t *log)
+{
+    if (log->n_records == 0) {
+        return true;
+    }
+    uint32_t next = log->current ^ 1U;
+    if (log->full[next]) {
+        return false;
+    }
+
+    uint8_t *header = log->blocks[log->current];
+    canbytes_put_word(header, CANLOG_MAGIC);
+    canbytes_put_word(header + 4U, log->seq);
+    canbytes_put_word(header + 8U, (uint32_t)(log->first >> 32));
+    canbytes_put_word(header + 12U, (uint32_t)log->first);
+    canbytes_put_word(header + 16U, (uint32_t)(log->latest >> 32));
+    canbytes_put_word(header + 20U, (uint32_t)log->latest);
+    header[24] = (uint8_t)(log->n_records >> 8);
+    header[25] = (uint8_t)log->n_records;
+    header[26] = (uint8_t)(log->used >> 8);
+    header[27] = (uint8_t)log->used;
+    canbytes_put_word(header + 28U, log->block_dropped);
+    log->full[log->current] = true;
+
+    log->current = next;
+    log->seq++;
+    start_block(log);
+
+    return true;
+}
+
+// Start a record, making room for it in a new block if needed. Returns NULL if the event is dropped.
+static uint8_t *start_record(canlog_t *log, uint64_t timestamp)
+{
+    int64_t delta = (int64_t)(timestamp - log->last);
+
+    // Times between records in a block must fit in 32 bits (signed)
+    if (log->used + CANLOG_MAX_RECORD > CANLOG_BLOCK_SIZE ||
+        (log->n_records > 0 && (delta > INT32_MAX || delta < INT32_MIN))) {
+        if (!canlog_close_block(log)) {
+            log->dropped++;
+            log->total_dropped++;
+            return NULL;
+        }
+    }
+
+    if (log->n_records == 0) {
+        log->first = timestamp;
+        log->last = timestamp;
+        log->latest = timestamp;
+        delta = 0;
+    }
+    uint8_t *p = log->blocks[log->current] + log->used + 1U;
+    // Zigzag encoded so that an event earlier than the record before it keeps its own time
+    uint32_t zigzag = delta < 0 ? ((uint32_t)(-delta) << 1) - 1U : (uint32_t)delta << 1;
+    while (zigzag >= 0x80U) {
+        *p++ = (uint8_t)(zigzag | 0x80U);
+        zigzag >>= 7;
+    }
+    *p++ = (uint8_t)zigzag;
+    log->last = timestamp;
+    if (timestamp > log->latest) {
+        log->latest = timestamp;
+    }
+
+    return p;
+}
+
+static void end_record(canlog_t *log, uint8_t flags, const uint8_t *end)
+{
+    uint8_t *record = log->blocks[log->current] + log->used;
+
+    record[0] = flags;
+    log->used = end - log->blocks[log->current];
+    log->n_records++;
+    log->records++;
+}
+
+// Write an ID, as an index if it is in the block's dictionary. Returns the new-ID flag if it is written in full.
+static uint8_t put_id(canlog_t *log, uint32_t id_word, uint8_t **p)
+{
+    // The stored key is offset by 1 so that 0 marks an empty slot
+    uint32_t key = id_word + 1U;
+    uint32_t i = ((key * 0x9e3779b1U) >> 16) & (CANLOG_DICT_TABLE - 1U);
+    while (log->dict_keys[i] != 0 && log->dict_keys[i] != key) {
+        i = (i + 1U) & (CANLOG_DICT_TABLE - 1U);
+    }
+    if (log->dict_keys[i] == key) {
+        *(*p)++ = log->dict_index[i];
+        return 0;
+    }
+    canbytes_put_word(*p, id_word);
+    *p += 4U;
+    if (log->n_ids < CANLOG_DICT_IDS) {
+        log->dict_keys[i] = key;
+        log->dict_index[i] = (uint8_t)log->n_ids++;
+    }
+    return 0x10U;
+}
+
+bool canlog_frame(canlog_t *log, uint32_t event, uint32_t id_word, bool remote, uint8_t dlc, const uint8_t *data, uint64_t timestamp)
+{
+    uint8_t *p = start_record(log, timestamp);
+    if (p == NULL) {
+        return false;
+    }
+
+    uint8_t flags = (uint8_t)((event << 6) | (remote ? 0x20U : 0) | (dlc & 0x0fU));
+    flags |= put_id(log, id_word, &p);
+
+    if (!remote) {
+        uint32_t len = dlc > 8U ? 8U : dlc;
+        memcpy(p, data, len);
+        p += len;
+    }
+    end_record(log, flags, p);
+
+    return true;
+}
+
+bool canlog_fd_frame(canlog_t *log, bool tx, uint32_t id_word, bool brs, bool esi, uint8_t dlc, const uint8_t *data, uint64_t timestamp)
+{
+    uint8_t *p = start_record(log, timestamp);
+    if (p == NULL) {
+        return false;
+    }
+
+    uint8_t flags = (uint8_t)((CANLOG_FD << 6) | (tx ? 0x20U : 0) | (dlc & 0x0fU));
+    flags |= put_id(log, id_word, &p);
+
+    *p++ = (uint8_t)((brs ? 0x01U : 0) | (esi ? 0x02U : 0));
+    uint32_t len = canfd_dlc_to_len(dlc);
+    memcpy(p, data, len);
+    p += len;
+    end_record(log, flags, p);
+
+    return true;
+}
+
+bool canlog_error(canlog_t *log, uint32_t info, uint64_t timestamp)
+{
+    uint8_t *p = start_record(log, timestamp);
+    if (p == NULL) {
+        return false;
+    }
+    canbytes_put_word(p, info);
+    end_record(log, (uint8_t)(CANLOG_ERROR << 6), p + 4U);
+
+    return true;
+}
@@ -0,0 +1,117 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Block logger
+// ============
+//
+// Events are encoded into fixed-size blocks (the size of a flash sector) so that a log file can be written a
+// block at a time and searched by reading only the block headers. There are two blocks: the ISR fills one
+// while the other is written out by the main thread. If the ISR fills its block before the other one has been
+// written then events are dropped and the number dropped is recorded in the header of the next block.
+//
+// Each block starts with a header (all words big endian) that acts as an index for seeking:
+//
+// Bytes 0-3:   Magic number "CANL"
+// Bytes 4-7:   Block sequence number (from 0 for each file)
+// Bytes 8-15:  Timestamp of the first record (microseconds)
+// Bytes 16-23: Latest timestamp of the records
+// Bytes 24-25: Number of records
+// Bytes 26-27: Bytes used in the block, including the header (the rest of the block is zero)
+// Bytes 28-31: Events dropped before the first record of this block
+//
+// Records follow the header. Each record starts with a flags byte:
+//
+//      bits 7:6 = event (0 = received frame, 1 = transmitted frame, 2 = CAN error, 3 = CAN FD frame)
+//      bit 5    = remote frame (transmitted for a CAN FD frame, which is never remote)
+//      bit 4    = new ID: the ID follows in full
+//      bits 3:0 = DLC
+//
+// then the time since the previous record in the block (0 for the first record, which is at the first
+// timestamp) in microseconds, as a signed number zigzag encoded (0, -1, 1, -2, ... as 0, 1, 2, 3, ...) into an
+// unsigned LEB128 number. It is signed because events are not always reported in time order: transmitted
+// frames and errors often arrive after a later received frame. A frame then has its ID, either in full
+// (4 bytes, the 32-bit ID format of rp2_can.h) or as a 1-byte index into the block's ID dictionary, and then the payload
+// (DLC-trimmed, none for a remote frame). Each block has its own dictionary so that a block can be decoded on
+// its own: IDs are given in full the first time they appear in a block and are numbered from 0 in that order,
+// up to 255 of them (IDs after that are always given in full). A CAN FD frame has a byte after its ID with BRS
+// in bit 0 and ESI in bit 1, and its payload is the length given by the CAN FD DLC (see canfd.h). An error has a
+// 4-byte error word.
+
+#ifndef CANLOG_H
+#define CANLOG_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define CANLOG_BLOCK_SIZE                   (4096U)
+#define CANLOG_HEADER_SIZE                  (32U)
+#define CANLOG_MAGIC                        (0x43414e4cU)
+
+#define CANLOG_RX                           (0)
+#define CANLOG_TX                           (1U)
+#define CANLOG_ERROR                        (2U)
+#define CANLOG_FD                           (3U)
+
+// Largest record: flags, 5-byte time, full ID, CAN FD flags and 64 bytes of data
+#define CANLOG_MAX_RECORD                   (75U)
+// IDs in a block's dictionary, and the size of the hash table used to find them
+#define CANLOG_DICT_IDS                     (255U)
+#define CANLOG_DICT_TABLE                   (512U)
+
+typedef struct {
+    uint8_t *blocks[2];                         // Block buffers (CANLOG_BLOCK_SIZE bytes each)
+    volatile bool full[2];                      // Set when a block is ready to be written out
+    uint32_t current;                           // Block being filled
+    uint32_t used;                              // Bytes used in the current block
+    uint32_t n_records;                         // Records in the current block
+    uint64_t first;                             // Timestamp of the first record in the current block
+    uint64_t last;                              // Timestamp of the last record
+    uint64_t latest;                            // Latest timestamp of the records in the current block
+    uint32_t seq;                               // Sequence number of the current block
+    uint32_t dropped;                           // Events dropped since the current block was started
+    uint32_t block_dropped;                     // Events dropped before the current block was started
+    uint32_t n_ids;                             // IDs in the current block's dictionary
+    uint32_t dict_keys[CANLOG_DICT_TABLE];      // ID word + 1 (0 if unused)
+    uint8_t dict_index[CANLOG_DICT_TABLE];
+    uint32_t records;                           // Total records logged
+    uint32_t total_dropped;                     // Total events dropped
+} canlog_t;
+
+/// \brief Initialize with two empty blocks of CANLOG_BLOCK_SIZE bytes
+void canlog_init(canlog_t *log, uint8_t *block0, uint8_t *block1);
+
+/// \brief Add a frame
+/// \param event CANLOG_RX or CANLOG_TX
+/// \param id_word ID in the 32-bit format of rp2_can.h
+/// \return false if the event was dropped
+bool canlog_frame(canlog_t *log, uint32_t event, uint32_t id_word, bool remote, uint8_t dlc, const uint8_t *data, uint64_t timestamp);
+
+/// \brief Add a CAN FD frame
+/// \param id_word ID in the 32-bit format of rp2_can.h
+/// \param dlc CAN FD DLC (0-15)
+/// \return false if the event was dropped
+bool canlog_fd_frame(canlog_t *log, bool tx, uint32_t id_word, bool brs, bool esi, uint8_t dlc, const uint8_t *data, uint64_t timestamp);
+
+/// \brief Add a CAN error
+/// \return false if the event was dropped
+bool canlog_error(canlog_t *log, uint32_t info, uint64_t timestamp);
+
+/// \brief Finish the current block (if it has any records) so that it is ready to be written out
+/// \return false if the other block has not been written out yet
+bool canlog_close_block(canlog_t *log);
+
+#endif // CANLOG_H
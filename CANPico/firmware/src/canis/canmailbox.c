@@ -0,0 +1,52 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <string.h>
+
+#include "canmailbox.h"
+
+void canmailbox_init(canmailbox_t *mb, uint8_t *records, canmailbox_entry_t *entries, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        entries[i].key = CANFILTER_IDSET_EMPTY;
+    }
+    mb->records = records;
+    mb->entries = entries;
+    mb->mask = size - 1U;
+    mb->n_slots = 0;
+}
+
+bool canmailbox_add(canmailbox_t *mb, uint32_t key)
+{
+    uint32_t i = canfilter_idset_hash(key) & mb->mask;
+
+    while (mb->entries[i].key != CANFILTER_IDSET_EMPTY) {
+        if (mb->entries[i].key == key) {
+            return false;
+        }
+        i = (i + 1U) & mb->mask;
+    }
+    mb->entries[i].key = key;
+    mb->entries[i].slot = mb->n_slots;
+
+    uint8_t *record = mb->records + mb->n_slots * CANMAILBOX_RECORD_SIZE;
+    uint32_t id = key & 0x1fffffffU;
+    memset(record, 0, CANMAILBOX_RECORD_SIZE);
+    canbytes_put_word(record, (key & 0x80000000U) ? ((1U << 29) | id) : (id << 18));
+    mb->n_slots++;
+
+    return true;
+}
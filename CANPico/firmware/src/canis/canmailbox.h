@@ -0,0 +1,92 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Latest-value mailboxes
+// ======================
+//
+// A fixed table of records, one for each of a configured set of IDs, that the receive ISR overwrites with the
+// newest frame of that ID. The slot for an ID is found from an open-addressing hash table keyed by ID (as for
+// the software ID set). The records are laid out so they can be read in place through a memoryview, all big
+// endian:
+//
+// Bytes 0-3:   CAN ID in 32-bit format (see rp2_can.h)
+// Bytes 4-7:   Number of frames received (0 if the slot has not yet been written)
+// Bytes 8-15:  Timestamp of the newest frame (microseconds)
+// Byte 16:     DLC
+// Byte 17:     Flags: bit 7 = remote frame
+// Bytes 18-23: Reserved (0)
+// Bytes 24-31: Data (zero-padded to 8 bytes)
+//
+// The count is written last. A reader that is not protected from the ISR reads the count, copies the record
+// and reads the count again; if the two counts differ the record was overwritten and must be read again.
+
+#ifndef CANMAILBOX_H
+#define CANMAILBOX_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "canbytes.h"
+#include "canfilter.h"
+
+#define CANMAILBOX_RECORD_SIZE              (32U)
+
+typedef struct {
+    uint32_t key;                               // CANFILTER_IDSET_KEY() of the ID, CANFILTER_IDSET_EMPTY if unused
+    uint32_t slot;
+} canmailbox_entry_t;
+
+typedef struct {
+    uint8_t *records;                           // Slot records (NULL if mailboxes are off)
+    canmailbox_entry_t *entries;                // Hash table of IDs to slots
+    uint32_t mask;                              // Table size - 1
+    uint32_t n_slots;
+} canmailbox_t;
+
+/// \brief Initialize with a table of canfilter_idset_size(max_slots) entries and no slots
+void canmailbox_init(canmailbox_t *mb, uint8_t *records, canmailbox_entry_t *entries, size_t size);
+
+/// \brief Add a slot for an ID (slots are numbered in the order they are added)
+/// \return false if the ID already has a slot
+bool canmailbox_add(canmailbox_t *mb, uint32_t key);
+
+/// \brief Overwrite the slot for an ID (if it has one) with a frame
+static inline void canmailbox_frame(canmailbox_t *mb, uint32_t key, bool remote, uint8_t dlc, const uint8_t *data, uint64_t timestamp)
+{
+    uint32_t i = canfilter_idset_hash(key) & mb->mask;
+
+    while (mb->entries[i].key != key) {
+        if (mb->entries[i].key == CANFILTER_IDSET_EMPTY) {
+            return;
+        }
+        i = (i + 1U) & mb->mask;
+    }
+
+    uint8_t *record = mb->records + mb->entries[i].slot * CANMAILBOX_RECORD_SIZE;
+    uint32_t len = remote ? 0 : (dlc > 8U ? 8U : dlc);
+
+    canbytes_put_word(record + 8U, (uint32_t)(timestamp >> 32));
+    canbytes_put_word(record + 12U, (uint32_t)timestamp);
+    record[16] = dlc;
+    record[17] = remote ? 0x80U : 0;
+    for (uint32_t j = 0; j < 8U; j++) {
+        record[24U + j] = j < len ? data[j] : 0;
+    }
+    canbytes_put_word(record + 4U, canbytes_get_word(record + 4U) + 1U);
+}
+
+#endif // CANMAILBOX_H
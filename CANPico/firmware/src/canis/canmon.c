@@ -0,0 +1,139 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "canmon.h"
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+// Puts a value as a given number of hex digits
+static char *put_hex(char *p, uint32_t value, uint32_t digits)
+{
+    for (uint32_t i = digits; i > 0; i--) {
+        p[i - 1U] = hex_digits[value & 0xfU];
+        value >>= 4;
+    }
+
+    return p + digits;
+}
+
+// Puts a value as decimal, padded with a fill character to a minimum width
+static char *put_dec(char *p, uint32_t value, uint32_t width, char fill)
+{
+    char digits[10];
+    uint32_t n = 0;
+
+    do {
+        digits[n++] = (char)('0' + value % 10U);
+        value /= 10U;
+    } while (value > 0);
+    for (uint32_t i = n; i < width; i++) {
+        *p++ = fill;
+    }
+    while (n > 0) {
+        *p++ = digits[--n];
+    }
+
+    return p;
+}
+
+static char *put_str(char *p, const char *s)
+{
+    while (*s) {
+        *p++ = *s++;
+    }
+
+    return p;
+}
+
+// Puts a timestamp as seconds and microseconds
+static char *put_time(char *p, uint64_t timestamp, uint32_t width, char fill)
+{
+    p = put_dec(p, (uint32_t)(timestamp / 1000000ULL), width, fill);
+    *p++ = '.';
+
+    return put_dec(p, (uint32_t)(timestamp % 1000000ULL), 6U, '0');
+}
+
+size_t canmon_frame(uint32_t style, char *line, uint64_t timestamp, bool ide, uint32_t arbitration_id, bool remote,
+                    uint8_t dlc, const uint8_t *data)
+{
+    char *p = line;
+    uint32_t len = remote ? 0 : (dlc > 8U ? 8U : dlc);
+
+    if (style == CANMON_ASC) {
+        p = put_time(p, timestamp, 1U, ' ');
+        p = put_str(p, " 1  ");
+        char *id = p;
+        if (ide) {
+            p = put_hex(p, arbitration_id & 0x1fffffffU, 8U);
+            *p++ = 'x';
+        }
+        else {
+            p = put_hex(p, arbitration_id & 0x7ffU, 3U);
+        }
+        // ID column is 16 wide
+        while (p < id + 16) {
+            *p++ = ' ';
+        }
+        p = put_str(p, "Rx   ");
+        *p++ = remote ? 'r' : 'd';
+        *p++ = ' ';
+        *p++ = hex_digits[dlc & 0xfU];
+        for (uint32_t i = 0; i < len; i++) {
+            *p++ = ' ';
+            p = put_hex(p, data[i], 2U);
+        }
+    }
+    else {
+        *p++ = '(';
+        p = put_time(p, timestamp, 10U, '0');
+        p = put_str(p, ") can0 ");
+        p = ide ? put_hex(p, arbitration_id & 0x1fffffffU, 8U) : put_hex(p, arbitration_id & 0x7ffU, 3U);
+        *p++ = '#';
+        if (remote) {
+            *p++ = 'R';
+            if (dlc > 0) {
+                *p++ = hex_digits[dlc & 0xfU];
+            }
+        }
+        else {
+            for (uint32_t i = 0; i < len; i++) {
+                p = put_hex(p, data[i], 2U);
+            }
+            if (dlc > 8U) {
+                *p++ = '_';
+                *p++ = hex_digits[dlc & 0xfU];
+            }
+        }
+    }
+    *p++ = '\r';
+    *p++ = '\n';
+
+    return (size_t)(p - line);
+}
+
+size_t canmon_error(uint32_t style, char *line, uint64_t timestamp)
+{
+    char *p = line;
+
+    if (style != CANMON_ASC) {
+        return 0;
+    }
+    p = put_time(p, timestamp, 1U, ' ');
+    p = put_str(p, " 1  ErrorFrame\r\n");
+
+    return (size_t)(p - line);
+}
@@ -0,0 +1,53 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Text monitor lines
+// =================
+//
+// Frames are formatted straight into a text buffer, without going through Python objects or printf, in one of
+// two styles understood by the usual tools:
+//
+// - candump: the log format of Linux can-utils (candump -L), e.g. "(0000000012.345678) can0 123#DEADBEEF" with
+//   "R" for a remote frame and "_" and the DLC for a classic frame with a DLC above 8
+// - ASC: the Vector ASCII log format, e.g. "12.345678 1  123             Rx   d 4 DE AD BE EF" with an "x"
+//   after an extended ID and "ErrorFrame" for a CAN error
+//
+// candump logs have no line for a CAN error so these are left out in that style. Each line ends with CR LF so that
+// it shows properly on a serial terminal, and is never longer than CANMON_LINE_MAX bytes.
+
+#ifndef CANMON_H
+#define CANMON_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define CANMON_CANDUMP                      (0)
+#define CANMON_ASC                          (1U)
+
+#define CANMON_LINE_MAX                     (80U)
+
+/// \brief Format a frame
+/// \param timestamp microseconds
+/// \return number of bytes put into the line
+size_t canmon_frame(uint32_t style, char *line, uint64_t timestamp, bool ide, uint32_t arbitration_id, bool remote,
+                    uint8_t dlc, const uint8_t *data);
+
+/// \brief Format a CAN error
+/// \return number of bytes put into the line (0 if the style has no line for an error)
+size_t canmon_error(uint32_t style, char *line, uint64_t timestamp);
+
+#endif // CANMON_H
@@ -1,3 +1,13 @@
+#include "canfilter.h"
+#include "canstats.h"
+#include "canload.h"
+#include "canpolicy.h"
+#include "canmailbox.h"
+#include "canresponder.h"
+#include "canlog.h"
+#include "canmon.h"
+#include "canslcan.h"
+
 // Triggers for turning a CANPico into a smart trigger for a scope/LA
 typedef struct {
     uint32_t arbitration_id_mask;                       // Mask/match values over ID, DLC and data
@@ -10,13 +20,267 @@ typedef struct {
     bool on_error;                                      // Set if should trigger on error
     bool on_rx;                                         // Set if should trigger on receiving a matching frame
     bool on_tx;                                         // Set if should trigger on a transmitting a matching frame
+    bool canhack;                                       // Set if a received match starts the armed CANHack action
     bool enabled;                                       // Set if trigger is enabled
 } can_trigger_t;
 
+// Maximum number of ID ranges that can be accepted by the software ID filter
+#define CAN_ACCEPT_MAX_RANGES               (8U)
+
+// Software acceptance stage that removes the false positives let through by the hardware ID filters
+typedef struct {
+    bool enabled;                                       // Set if frames are checked against the IDs
+    canfilter_idset_t ids;                              // Hash set of IDs (table allocated on the heap)
+    uint32_t range_lo[CAN_ACCEPT_MAX_RANGES];           // Ranges of IDs (as ID set keys)
+    uint32_t range_hi[CAN_ACCEPT_MAX_RANGES];
+    uint32_t n_ranges;
+    uint32_t rejected;                                  // Number of frames removed
+} can_accept_t;
+
+// Maximum number of IDs in the traffic statistics table
+#define CAN_STATS_MAX_IDS                   (512U)
+
+// Maximum number of IDs that receive policies can track
+#define CAN_POLICY_MAX_IDS                  (512U)
+
+// Maximum number of latest-value mailbox slots
+#define CAN_MAILBOX_MAX_SLOTS               (256U)
+
+// Maximum number of IDs the remote frame responder answers
+#define CAN_RESPONDER_MAX_IDS               (64U)
+// Remote frames that can be waiting for a response in one pass of the ISR
+#define CAN_RESPONDER_PENDING               (8U)
+
+// Number of transmit slots: enough for a full transmit queue, a full FIFO and a full transmit event FIFO
+#define CAN_TX_SLOTS                        (CAN_TX_QUEUE_SIZE + CAN_TX_FIFO_SIZE + CAN_TX_EVENT_FIFO_SIZE)
+
+// A copy of a frame sent without a CANFrame instance (from bytes or from a schedule): stands in for a
+// CANFrame instance so that the uref has somewhere to point
+typedef struct {
+    can_frame_t frame;                                  // Copy of the frame (for the transmit trigger)
+    uint32_t tag;                                       // Application tag
+    uint64_t timestamp;                                 // Set by the transmit ISR
+    uint32_t deadline;                                  // Requested transmit time (controller time)
+    bool timed;                                         // Set if the frame was sent with a deadline
+    bool queued;                                        // Set until the frame is transmitted
+    bool fifo;                                          // Set if queued in the FIFO queue
+    uint64_t queued_at;                                 // Controller time the frame was queued
+    uint32_t latency;                                   // Microseconds from queued to sent (set by the transmit ISR)
+} can_tx_slot_t;
+
+// Number of buckets in a latency histogram: bucket 0 is under 2us, bucket n is 2^n to 2^(n+1)-1us and the
+// last bucket holds everything longer
+#define CAN_LATENCY_BUCKETS                 (20U)
+
+// Histogram of the time from a frame being queued to it being sent
+typedef struct {
+    uint32_t buckets[CAN_LATENCY_BUCKETS];
+    uint32_t count;
+    uint32_t max;
+    uint64_t sum;
+} can_latency_hist_t;
+
+// Number of receive lanes: lane 0 is the driver's receive FIFO, lanes 1 and up are software FIFOs filled from
+// the receive ISR for frames let through by the ID filters assigned to them (lane 1 is filled first)
+#define CAN_RX_LANES                        (4U)
+#define CAN_RX_LANE_MAX_SIZE                (256U)
+
+typedef struct {
+    can_frame_t frame;
+    uint64_t timestamp;
+} can_rx_lane_entry_t;
+
+// Single-producer (ISR) single-consumer (recv()) ring: the ISR only writes at head and recv() only reads at
+// tail, and each only moves its own index once the entry has been written or read, so no locking is needed
+typedef struct {
+    can_rx_lane_entry_t *entries;                       // Ring of frames (allocated on the heap)
+    uint32_t size;                                      // Number of entries, a power of two (0 if the lane is not set up)
+    volatile uint32_t head;                             // Total frames written
+    volatile uint32_t tail;                             // Total frames read
+    uint32_t filters;                                   // Bitmap of the ID filters assigned to the lane
+    uint32_t received;                                  // Frames put in the lane
+    uint32_t overflows;                                 // Frames dropped because the lane was full
+    uint32_t overflows_reported;                        // Overflows already returned by recv()
+} can_rx_lane_t;
+
+// Deep receive FIFO, sized when the CAN instance is created and kept in a static arena outside the garbage
+// collected heap, so the collector never scans it. The records hold received frames in the binary format
+// (see rp2_can.h) so recv(as_bytes=True) is a copy.
+// The arena is always reserved, so the default is kept small (12KB); a board with RAM to spare can raise it.
+// Depths are powers of two because the ring indexes are free-running counters.
+#ifndef CAN_RX_ARENA_FRAMES
+#define CAN_RX_ARENA_FRAMES                 (512U)
+#endif
+#if (CAN_RX_ARENA_FRAMES & (CAN_RX_ARENA_FRAMES - 1U)) != 0
+#error "CAN_RX_ARENA_FRAMES must be a power of two"
+#endif
+// Binary format record (19 bytes), a pad byte then the top 32 bits of the 64-bit timestamp (big endian)
+#define CAN_RX_RECORD_SIZE                  (24U)
+#define CAN_RX_RECORD_BYTES                 (19U)
+
+// Single-producer single-consumer ring, as for the receive lanes
+typedef struct {
+    uint8_t *records;                                   // Records in the arena (NULL if not in use)
+    uint32_t size;                                      // Number of records (a power of two)
+    volatile uint32_t head;                             // Total frames written
+    volatile uint32_t tail;                             // Total frames read
+    uint32_t overflows;                                 // Frames dropped because the FIFO was full
+    uint32_t overflows_reported;                        // Overflows already returned by recv()
+} can_rx_deep_t;
+
+// Maximum number of frames in a cyclic schedule
+#define CAN_SCHED_MAX_ENTRIES               (256U)
+
+// A frame sent periodically by the scheduler
+typedef struct {
+    can_frame_t frame;                                  // Frame to send (the payload can be updated in place)
+    uint32_t tag;
+    uint32_t period;                                    // Microseconds (0 = send once)
+    uint32_t remaining;                                 // Number of sends left (0 = forever)
+    uint64_t due;                                       // RP2040 time (time_us_64()) of the next send
+    uint32_t sent;
+    uint32_t skipped;                                   // Sends missed because the transmit queue was full or sends were late
+    uint32_t max_late;                                  // Worst lateness of a send in microseconds
+} can_sched_entry_t;
+
+// Number of frames that can be waiting to be sent at a given time
+#define CAN_TIMED_QUEUE_SIZE                (64U)
+
+// A frame waiting to be sent at a given time
+typedef struct {
+    can_frame_t frame;
+    uint32_t tag;
+    uint32_t deadline;                                  // Requested transmit time (controller time)
+    uint64_t release;                                   // RP2040 time (time_us_64()) to put the frame in the transmit queue
+    bool fifo;
+} can_timed_frame_t;
+
+// Replay of a capture of frames in the binary format returned by recv(as_bytes=True), each frame released at
+// its original time relative to the first (scaled by the replay speed)
+typedef struct {
+    const uint8_t *records;                             // Capture records (NULL if not replaying)
+    mp_obj_t capture;                                   // Object holding the records (kept so it is not collected)
+    uint32_t n_records;
+    uint32_t next;                                      // Index of the next record to release
+    uint32_t t0;                                        // Timestamp of the first record
+    uint64_t start;                                     // RP2040 time (time_us_64()) the first record of this pass is released
+    uint32_t scale;                                     // Replay microseconds per capture microsecond (16.16 fixed point)
+    uint32_t gap;                                       // Microseconds from the last record to the first when looping
+    bool loop;
+    bool fifo;                                          // Send through the FIFO queue rather than the priority queue
+    canfilter_idset_t ids;                              // IDs to replay (keys NULL to replay all IDs)
+    uint32_t passes;                                    // Passes through the capture completed
+    uint32_t sent;
+    uint32_t max_late;                                  // Worst lateness of a release in microseconds
+    uint64_t total_late;
+} can_replay_t;
+
+// Cyclic transmit schedule, driven by a hardware alarm
+typedef struct {
+    can_sched_entry_t *entries;                         // Allocated on the heap
+    uint16_t *heap;                                     // Indexes of entries still to send, as a min-heap on due time
+    uint32_t n_entries;
+    uint32_t n_heap;
+    bool fifo;                                          // Send through the FIFO queue rather than the priority queue
+    can_timed_frame_t *timed;                           // Frames to send at a given time, as a min-heap on release (static)
+    uint32_t n_timed;
+    can_replay_t replay;                                // Capture being replayed
+} can_sched_t;
+
+// Pairing of the controller's timestamp counter with the RP2040 timer, used to extend 32-bit timestamps
+// (which wrap after 71 minutes) to 64 bits. Both clocks tick at 1MHz.
+typedef struct {
+    uint64_t controller;                                // Controller time (extended to 64 bits) when sampled
+    uint64_t local;                                     // RP2040 time (time_us_64()) when sampled
+    uint64_t epoch;                                     // Host-provided time at the controller time in epoch_controller
+    uint64_t epoch_controller;
+    bool epoch_valid;                                   // Set once set_epoch() has been called
+} can_timebase_t;
+
+// Roles in time synchronization
+#define CAN_SYNC_OFF                        (0)
+#define CAN_SYNC_MASTER                     (1)
+#define CAN_SYNC_SLAVE                      (2)
+
+// Time synchronization: the master sends a SYNC frame and then a follow-up (FUP) frame carrying the time the
+// SYNC frame was sent, and the slave compares this with the time it received the SYNC frame
+typedef struct {
+    uint8_t role;
+    uint32_t sync_id;                                   // ID of the SYNC frame
+    uint32_t fup_id;                                    // ID of the follow-up frame
+    bool extended;                                      // Set if the IDs are 29-bit
+    uint32_t period;                                    // Microseconds between SYNC frames (master)
+    uint64_t next_sync;                                 // RP2040 time (time_us_64()) of the next SYNC frame (master)
+    uint8_t seq;                                        // Sequence number of the last SYNC frame sent or received
+    bool awaiting_tx;                                   // Set while the SYNC frame is waiting to be sent (master)
+    bool fup_pending;                                   // Set when the FUP frame is waiting to be queued (master)
+    uint64_t fup_timestamp;                             // Time the SYNC frame was sent (master)
+    bool sync_rx_valid;                                 // Set when a SYNC frame has been received (slave)
+    uint64_t sync_rx_timestamp;                         // Time the SYNC frame was received (slave)
+    int64_t offset;                                     // Master time - local time at local time t_ref (slave)
+    int64_t drift;                                      // Rate of change of offset, as a 32.32 fixed point (slave)
+    uint64_t t_ref;
+    int32_t last_error;                                 // Error of the offset estimate at the last update
+    uint32_t n_updates;                                 // Number of FUP frames used since the servo started
+    bool locked;                                        // Set when the offset estimate is tracking the master
+} can_sync_t;
+
+// Maximum number of CAN controllers on a board (each with its own SPI chip select and interrupt pin)
+#define CAN_MAX_CONTROLLERS                 (3U)
+
+// Block logger writing to a file (see canlog.h): the ISR fills the blocks and the main thread writes them
+typedef struct {
+    canlog_t *log;                                      // Allocated on the heap (NULL if not logging)
+    canlog_t *spare;                                    // Blocks of the last file, for the next one to reuse
+    mp_obj_t file;                                      // File being written
+    bool tx;                                            // Log transmitted frames
+    bool errors;                                        // Log CAN errors
+    volatile bool flush_scheduled;                      // Set while a write of the full blocks is scheduled
+    uint32_t blocks;                                    // Blocks written to the file
+    int error;                                          // Error number of a failed write (logging stops)
+} can_logger_t;
+
+// Text lines written to a USB CDC port by the monitor (see canmon.h) and the SLCAN server (see canslcan.h)
+#define CAN_MONITOR_BUF_SIZE                (2048U)
+
+typedef struct {
+    uint32_t lines;                                     // Lines formatted
+    uint32_t bytes;                                     // Bytes written
+    uint32_t dropped;                                   // Lines dropped because the host was not keeping up (or not there)
+    uint32_t stalls;                                    // Times the USB could not take all of the buffer
+    uint32_t overflows;                                 // Frames lost by the receive FIFO
+} can_monitor_t;
+
 // The main CAN() class object, holding a CAN controller, a trigger, and a Python callback function
 typedef struct _rp2_can_obj_t {
     mp_obj_base_t base;
+    uint32_t index;                                     // Which of the board's controllers this is
     can_controller_t controller;
     can_trigger_t triggers[1];                          // TODO allow multiple triggers
     mp_obj_t mp_rx_callback_fn;                         // Python function to call on receive
+    can_accept_t accept;                                // Software ID acceptance stage
+    can_id_filter_t id_filters[CAN_MAX_ID_FILTERS];     // ID filters last written to the controller
+    uint32_t id_filters_enabled;                        // Bitmask of filters in use
+    bool id_filters_known;                              // False if the controller set up its own default filters
+    can_tx_slot_t *tx_slots;                            // Frames sent from copies (static)
+    uint32_t tx_slot_next;                              // Where to start looking for a free slot
+    can_sched_t sched;                                  // Cyclic transmit schedule
+    can_timebase_t timebase;                            // For 64-bit timestamps
+    can_sync_t sync;                                    // Time synchronization service
+    canstats_t stats;                                   // Per-ID traffic statistics (table allocated on the heap)
+    uint32_t bitrate;                                   // Nominal bit rate in bits/s (0 if not known)
+    canload_t load;                                     // Bus load meter
+    can_latency_hist_t latency[2];                      // Transmit latency of the priority queue and FIFO queue
+    canpolicy_t policy;                                 // Receive policies (table allocated on the heap)
+    canmailbox_t mailbox;                               // Latest-value mailboxes (allocated on the heap)
+    can_rx_lane_t rx_lanes[CAN_RX_LANES - 1U];          // Receive lanes 1 and up
+    uint8_t filter_lane[CAN_MAX_ID_FILTERS];            // Receive lane for frames let through by each ID filter
+    uint32_t lane_filters;                              // Bitmap of ID filters assigned to lanes 1 and up
+    can_rx_deep_t rx_deep;                              // Deep receive FIFO (replaces the driver's FIFO for frames)
+    bool irq_active;                                    // Set up, so its interrupt is on unless the SPI bus is in use
+    canresponder_t responder;                           // Remote frame responses (table allocated on the heap)
+    canresponder_entry_t *responder_pending[CAN_RESPONDER_PENDING]; // Responses to queue when the driver ISR returns
+    uint32_t n_responder_pending;
+    can_logger_t logger;                                // Binary logger
+    can_monitor_t monitor;                              // Monitor and SLCAN server statistics
 } rp2_can_obj_t;
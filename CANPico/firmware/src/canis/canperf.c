@@ -0,0 +1,50 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <string.h>
+
+#include "canbytes.h"
+#include "canperf.h"
+
+canperf_counter_t canperf_counters[CANPERF_NUM_COUNTERS];
+
+void canperf_reset(void)
+{
+    memset(canperf_counters, 0, sizeof(canperf_counters));
+}
+
+void canperf_pack(uint32_t clock_hz, uint8_t *buf)
+{
+    buf[0] = 0;
+    buf[1] = CANPERF_NUM_COUNTERS;
+    buf[2] = 0;
+    buf[3] = CANPERF_BUCKETS;
+    canbytes_put_word(buf + 4U, clock_hz);
+    buf += CANPERF_HEADER_SIZE;
+
+    for (uint32_t i = 0; i < CANPERF_NUM_COUNTERS; i++) {
+        const canperf_counter_t *c = &canperf_counters[i];
+        canbytes_put_word(buf, c->count);
+        canbytes_put_word(buf + 4U, c->min);
+        canbytes_put_word(buf + 8U, c->max);
+        canbytes_put_word(buf + 12U, (uint32_t)(c->total >> 32));
+        canbytes_put_word(buf + 16U, (uint32_t)c->total);
+        for (uint32_t j = 0; j < CANPERF_BUCKETS; j++) {
+            canbytes_put_word(buf + 20U + (j * 4U), c->buckets[j]);
+        }
+        buf += CANPERF_RECORD_SIZE;
+    }
+}
@@ -0,0 +1,108 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Performance counters
+// ====================
+//
+// A fixed set of counters, one for each instrumented code path, each recording the number of calls and the
+// minimum, maximum and total time taken (in CPU cycles), plus a histogram of the times. Histogram bucket 0
+// counts calls of fewer than 64 cycles and each bucket after that doubles the range, with the last bucket
+// counting everything longer.
+//
+// The snapshot is an 8-byte header followed by one record per counter (in counter order), all big endian:
+//
+// Header:
+// Bytes 0-1:   Number of counters
+// Bytes 2-3:   Number of histogram buckets
+// Bytes 4-7:   CPU clock frequency (Hz), to turn cycles into time
+//
+// Record:
+// Bytes 0-3:   Number of calls
+// Bytes 4-7:   Minimum cycles (0 if there have been no calls)
+// Bytes 8-11:  Maximum cycles
+// Bytes 12-19: Total cycles
+// Bytes 20-:   Histogram buckets, 4 bytes each
+
+#ifndef CANPERF_H
+#define CANPERF_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define CANPERF_CAN_ISR                     (0U)    // Servicing the CAN controller interrupt
+#define CANPERF_CAN_SPI                     (1U)    // Direct SPI register accesses by the binding
+#define CANPERF_CAN_RECV                    (2U)    // CAN.recv() (after any wait)
+#define CANPERF_CAN_SEND                    (3U)    // Queueing a frame in CAN.send_frame()
+#define CANPERF_MIN_USB_WRITE               (4U)    // MIN writes to USB
+#define CANPERF_MIN_USB_READ                (5U)    // MIN reads from USB
+#define CANPERF_CRYPTOCAN_CREATE            (6U)    // CryptoCAN creating a pair of frames
+#define CANPERF_CRYPTOCAN_VERIFY            (7U)    // CryptoCAN verifying a received frame
+#define CANPERF_NUM_COUNTERS                (8U)
+
+#define CANPERF_BUCKETS                     (16U)
+#define CANPERF_HEADER_SIZE                 (8U)
+#define CANPERF_RECORD_SIZE                 (20U + (CANPERF_BUCKETS * 4U))
+#define CANPERF_SNAPSHOT_SIZE               (CANPERF_HEADER_SIZE + (CANPERF_NUM_COUNTERS * CANPERF_RECORD_SIZE))
+
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+    uint32_t buckets[CANPERF_BUCKETS];
+} canperf_counter_t;
+
+extern canperf_counter_t canperf_counters[CANPERF_NUM_COUNTERS];
+
+/// \brief Reset all the counters
+void canperf_reset(void);
+
+/// \brief Write a snapshot of the counters (CANPERF_SNAPSHOT_SIZE bytes)
+void canperf_pack(uint32_t clock_hz, uint8_t *buf);
+
+/// \brief Histogram bucket of a value: bucket 0 holds values below 2^shift, each bucket after that doubles
+/// the range and the last bucket holds everything larger (shift + buckets must be at most 33)
+static inline uint32_t canperf_bucket(uint32_t value, uint32_t shift, uint32_t buckets)
+{
+    uint32_t bucket = 0;
+
+    // A loop rather than a count of leading zeros, which the Cortex-M0+ does not have an instruction for
+    // (and which is undefined for zero)
+    while (bucket < buckets - 1U && (value >> (bucket + shift)) != 0) {
+        bucket++;
+    }
+
+    return bucket;
+}
+
+/// \brief Record a call that took a number of cycles
+static inline void canperf_record(uint32_t counter, uint32_t cycles)
+{
+    canperf_counter_t *c = &canperf_counters[counter];
+
+    c->buckets[canperf_bucket(cycles, 6U, CANPERF_BUCKETS)]++;
+    if (c->count == 0 || cycles < c->min) {
+        c->min = cycles;
+    }
+    if (cycles > c->max) {
+        c->max = cycles;
+    }
+    c->total += cycles;
+    c->count++;
+}
+
+#endif // CANPERF_H
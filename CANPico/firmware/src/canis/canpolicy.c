@@ -0,0 +1,129 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <string.h>
+
+#include "canpolicy.h"
+
+void canpolicy_init(canpolicy_t *p, canpolicy_entry_t *entries, size_t size, size_t max_ids)
+{
+    for (size_t i = 0; i < size; i++) {
+        entries[i].key = CANFILTER_IDSET_EMPTY;
+    }
+    p->entries = entries;
+    p->mask = size - 1U;
+    p->n_ids = 0;
+    p->max_ids = max_ids;
+    for (uint32_t i = 0; i < CANPOLICY_MAX_FILTERS; i++) {
+        p->filter_kind[i] = CANPOLICY_NONE;
+        p->filter_param[i] = 0;
+    }
+    p->suppressed = 0;
+    p->untracked = 0;
+}
+
+// Find the entry for a key, or the empty slot where it would go
+static canpolicy_entry_t *find(canpolicy_t *p, uint32_t key)
+{
+    uint32_t i = canfilter_idset_hash(key) & p->mask;
+
+    while (p->entries[i].key != CANFILTER_IDSET_EMPTY && p->entries[i].key != key) {
+        i = (i + 1U) & p->mask;
+    }
+
+    return &p->entries[i];
+}
+
+static bool add(canpolicy_t *p, canpolicy_entry_t *e, uint32_t key, uint8_t kind, uint32_t param)
+{
+    if (e->key == CANFILTER_IDSET_EMPTY) {
+        if (p->n_ids >= p->max_ids) {
+            return false;
+        }
+        p->n_ids++;
+    }
+    e->key = key;
+    e->kind = kind;
+    e->param = param;
+    e->seen = false;
+    e->count = 0;
+    e->delivered = 0;
+    e->suppressed = 0;
+
+    return true;
+}
+
+bool canpolicy_set_id(canpolicy_t *p, uint32_t key, uint8_t kind, uint32_t param)
+{
+    return add(p, find(p, key), key, kind, param);
+}
+
+void canpolicy_set_filter(canpolicy_t *p, uint32_t filter, uint8_t kind, uint32_t param)
+{
+    if (filter < CANPOLICY_MAX_FILTERS) {
+        p->filter_kind[filter] = kind;
+        p->filter_param[filter] = param;
+    }
+}
+
+bool canpolicy_check(canpolicy_t *p, uint32_t key, uint32_t filter, uint8_t dlc, const uint8_t *data, uint8_t len, uint64_t timestamp)
+{
+    canpolicy_entry_t *e = find(p, key);
+
+    if (e->key == CANFILTER_IDSET_EMPTY) {
+        // First frame of an ID with no policy of its own: pick up the policy of the filter that let it in
+        uint8_t kind = filter < CANPOLICY_MAX_FILTERS ? p->filter_kind[filter] : CANPOLICY_NONE;
+        if (kind == CANPOLICY_NONE) {
+            return true;
+        }
+        if (!add(p, e, key, kind, p->filter_param[filter])) {
+            p->untracked++;
+            return true;
+        }
+    }
+
+    bool deliver;
+    switch (e->kind) {
+        case CANPOLICY_CHANGED:
+            deliver = !e->seen || dlc != e->dlc || len != e->len || memcmp(data, e->data, len) != 0;
+            break;
+        case CANPOLICY_EVERY_NTH:
+            deliver = e->count == 0;
+            e->count = e->count + 1U >= e->param ? 0 : e->count + 1U;
+            break;
+        case CANPOLICY_INTERVAL:
+            deliver = !e->seen || timestamp - e->last >= e->param;
+            break;
+        default:
+            deliver = true;
+            break;
+    }
+
+    if (deliver) {
+        e->seen = true;
+        e->dlc = dlc;
+        e->len = len;
+        memcpy(e->data, data, len);
+        e->last = timestamp;
+        e->delivered++;
+    }
+    else {
+        e->suppressed++;
+        p->suppressed++;
+    }
+
+    return deliver;
+}
@@ -0,0 +1,86 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Receive policies
+// ================
+//
+// A policy decides whether a received frame is delivered or suppressed:
+//
+// - Changed: delivered only if the DLC or payload is different from the last frame delivered
+// - Every Nth: every Nth frame is delivered, starting with the first
+// - Interval: delivered if at least the interval has passed since the last frame delivered
+//
+// Each ID has its own state, kept in an open-addressing hash table keyed by ID (as for the software ID set).
+// Policies are given for IDs, or for ID filters so that the policy applies to each ID let through by the filter
+// (an entry for the ID is made the first time it is seen). If the table is full then frames of new IDs are
+// delivered and counted as untracked.
+
+#ifndef CANPOLICY_H
+#define CANPOLICY_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "canfilter.h"
+
+#define CANPOLICY_NONE                      (0)
+#define CANPOLICY_CHANGED                   (1U)
+#define CANPOLICY_EVERY_NTH                 (2U)
+#define CANPOLICY_INTERVAL                  (3U)
+
+#define CANPOLICY_MAX_FILTERS               (32U)
+
+typedef struct {
+    uint32_t key;                               // CANFILTER_IDSET_KEY() of the ID, CANFILTER_IDSET_EMPTY if unused
+    uint8_t kind;
+    uint32_t param;                             // N for every Nth, microseconds for interval
+    bool seen;                                  // Set once a frame has been delivered
+    uint8_t dlc;                                // Last frame delivered (changed)
+    uint8_t len;
+    uint8_t data[8];
+    uint32_t count;                             // Frames since the last one delivered (every Nth)
+    uint64_t last;                              // Timestamp of the last frame delivered (interval)
+    uint32_t delivered;
+    uint32_t suppressed;
+} canpolicy_entry_t;
+
+typedef struct {
+    canpolicy_entry_t *entries;                 // Table of entries (NULL if there are no policies)
+    uint32_t mask;                              // Table size - 1
+    uint32_t n_ids;
+    uint32_t max_ids;
+    uint8_t filter_kind[CANPOLICY_MAX_FILTERS]; // Policy for IDs let through by each filter
+    uint32_t filter_param[CANPOLICY_MAX_FILTERS];
+    uint32_t suppressed;                        // Total frames suppressed
+    uint32_t untracked;                         // Frames delivered because there was no room for their ID
+} canpolicy_t;
+
+/// \brief Initialize with a table of canfilter_idset_size(max_ids) entries and no policies
+void canpolicy_init(canpolicy_t *p, canpolicy_entry_t *entries, size_t size, size_t max_ids);
+
+/// \brief Set the policy for an ID
+/// \return false if the table is full
+bool canpolicy_set_id(canpolicy_t *p, uint32_t key, uint8_t kind, uint32_t param);
+
+/// \brief Set the policy for the IDs let through by a filter
+void canpolicy_set_filter(canpolicy_t *p, uint32_t filter, uint8_t kind, uint32_t param);
+
+/// \brief Decide whether to deliver a frame (updating the state for its ID)
+/// \return true if the frame should be delivered
+bool canpolicy_check(canpolicy_t *p, uint32_t key, uint32_t filter, uint8_t dlc, const uint8_t *data, uint8_t len, uint64_t timestamp);
+
+#endif // CANPOLICY_H
@@ -0,0 +1,58 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "canresponder.h"
+
+void canresponder_init(canresponder_t *r, canresponder_entry_t *entries, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        entries[i].key = CANFILTER_IDSET_EMPTY;
+    }
+    r->entries = entries;
+    r->mask = size - 1U;
+    r->n_ids = 0;
+    r->responses = 0;
+    r->misses = 0;
+}
+
+canresponder_entry_t *canresponder_add(canresponder_t *r, uint32_t key, uint8_t dlc, const uint8_t *data)
+{
+    uint32_t i = canfilter_idset_hash(key) & r->mask;
+
+    while (r->entries[i].key != CANFILTER_IDSET_EMPTY) {
+        if (r->entries[i].key == key) {
+            return NULL;
+        }
+        i = (i + 1U) & r->mask;
+    }
+    canresponder_entry_t *e = &r->entries[i];
+    e->key = key;
+    e->responses = 0;
+    canresponder_set_data(e, dlc, data);
+    r->n_ids++;
+
+    return e;
+}
+
+void canresponder_set_data(canresponder_entry_t *e, uint8_t dlc, const uint8_t *data)
+{
+    uint32_t len = dlc > 8U ? 8U : dlc;
+
+    e->dlc = dlc;
+    for (uint32_t i = 0; i < 8U; i++) {
+        e->data[i] = i < len ? data[i] : 0;
+    }
+}
@@ -0,0 +1,75 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Remote frame responder
+// ======================
+//
+// A table of responses, one for each of a configured set of IDs, that the receive ISR looks up when a remote
+// frame arrives so that a data frame for the requested ID can be queued without waiting for Python. The
+// response for an ID is found from an open-addressing hash table keyed by ID (as for the software ID set). The
+// payload of a response can be changed at any time so that it is the latest value of the data.
+
+#ifndef CANRESPONDER_H
+#define CANRESPONDER_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "canfilter.h"
+
+typedef struct {
+    uint32_t key;                               // CANFILTER_IDSET_KEY() of the ID, CANFILTER_IDSET_EMPTY if unused
+    uint8_t dlc;                                // Response DLC and payload
+    uint8_t data[8];
+    uint32_t responses;                         // Responses queued for this ID
+} canresponder_entry_t;
+
+typedef struct {
+    canresponder_entry_t *entries;              // Table of responses (NULL if the responder is off)
+    uint32_t mask;                              // Table size - 1
+    uint32_t n_ids;
+    uint32_t responses;                         // Total responses queued
+    uint32_t misses;                            // Remote frames that could not be answered (transmit queue full)
+} canresponder_t;
+
+/// \brief Initialize with a table of canfilter_idset_size(max_ids) entries and no responses
+void canresponder_init(canresponder_t *r, canresponder_entry_t *entries, size_t size);
+
+/// \brief Add a response for an ID
+/// \return the entry for the response, or NULL if the ID already has one
+canresponder_entry_t *canresponder_add(canresponder_t *r, uint32_t key, uint8_t dlc, const uint8_t *data);
+
+/// \brief Find the response for an ID
+/// \return the entry for the response, or NULL if the ID has none
+static inline canresponder_entry_t *canresponder_find(canresponder_t *r, uint32_t key)
+{
+    uint32_t i = canfilter_idset_hash(key) & r->mask;
+
+    while (r->entries[i].key != key) {
+        if (r->entries[i].key == CANFILTER_IDSET_EMPTY) {
+            return NULL;
+        }
+        i = (i + 1U) & r->mask;
+    }
+
+    return &r->entries[i];
+}
+
+/// \brief Change the payload of a response
+void canresponder_set_data(canresponder_entry_t *e, uint8_t dlc, const uint8_t *data);
+
+#endif // CANRESPONDER_H
@@ -0,0 +1,218 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "canslcan.h"
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+// Bit rates of the S command
+static const uint32_t bitrates[] = {10000U, 20000U, 50000U, 100000U, 125000U, 250000U, 500000U, 800000U, 1000000U};
+
+static char *put_hex(char *p, uint32_t value, uint32_t digits)
+{
+    for (uint32_t i = digits; i > 0; i--) {
+        p[i - 1U] = hex_digits[value & 0xfU];
+        value >>= 4;
+    }
+
+    return p + digits;
+}
+
+// Parses a number of hex digits, returning false if any are not hex
+static bool get_hex(const char *p, uint32_t digits, uint32_t *value)
+{
+    uint32_t v = 0;
+
+    for (uint32_t i = 0; i < digits; i++) {
+        char c = p[i];
+        if (c >= '0' && c <= '9') {
+            v = (v << 4) | (uint32_t)(c - '0');
+        }
+        else if (c >= 'A' && c <= 'F') {
+            v = (v << 4) | (uint32_t)(c - 'A' + 10);
+        }
+        else if (c >= 'a' && c <= 'f') {
+            v = (v << 4) | (uint32_t)(c - 'a' + 10);
+        }
+        else {
+            return false;
+        }
+    }
+    *value = v;
+
+    return true;
+}
+
+void canslcan_init(canslcan_t *slcan)
+{
+    slcan->len = 0;
+    slcan->overlong = false;
+    slcan->open = false;
+    slcan->listen_only = false;
+    slcan->timestamps = false;
+    slcan->flags = 0;
+}
+
+// Parses a t, T, r or R command
+static uint32_t parse_frame(const canslcan_t *slcan, const char *p, uint32_t len, canslcan_cmd_t *cmd)
+{
+    uint32_t id_digits = (p[0] == 'T' || p[0] == 'R') ? 8U : 3U;
+    uint32_t value;
+
+    if (!slcan->open || slcan->listen_only || len < 1U + id_digits + 1U) {
+        return CANSLCAN_ERROR;
+    }
+    cmd->ide = id_digits == 8U;
+    cmd->remote = p[0] == 'r' || p[0] == 'R';
+    if (!get_hex(p + 1U, id_digits, &cmd->arbitration_id) || cmd->arbitration_id > (cmd->ide ? 0x1fffffffU : 0x7ffU)) {
+        return CANSLCAN_ERROR;
+    }
+    if (!get_hex(p + 1U + id_digits, 1U, &value) || value > 8U) {
+        return CANSLCAN_ERROR;
+    }
+    cmd->dlc = (uint8_t)value;
+
+    uint32_t n = cmd->remote ? 0 : cmd->dlc;
+    if (len != 1U + id_digits + 1U + n * 2U) {
+        return CANSLCAN_ERROR;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        if (!get_hex(p + 2U + id_digits + i * 2U, 2U, &value)) {
+            return CANSLCAN_ERROR;
+        }
+        cmd->data[i] = (uint8_t)value;
+    }
+
+    return CANSLCAN_SEND;
+}
+
+// Parses a complete command line (without the CR)
+static uint32_t parse(canslcan_t *slcan, const char *p, uint32_t len, canslcan_cmd_t *cmd)
+{
+    if (len == 0) {
+        // An empty line is used by hosts to flush out a partial command
+        return CANSLCAN_OK;
+    }
+
+    switch (p[0]) {
+        case 'S':
+            if (slcan->open || len != 2U || p[1] < '0' || p[1] > '8') {
+                return CANSLCAN_ERROR;
+            }
+            cmd->bitrate = bitrates[p[1] - '0'];
+            return CANSLCAN_BITRATE;
+        case 'O':
+        case 'L':
+            if (slcan->open || len != 1U) {
+                return CANSLCAN_ERROR;
+            }
+            slcan->open = true;
+            slcan->listen_only = p[0] == 'L';
+            return CANSLCAN_OK;
+        case 'C':
+            if (!slcan->open || len != 1U) {
+                return CANSLCAN_ERROR;
+            }
+            slcan->open = false;
+            return CANSLCAN_OK;
+        case 't':
+        case 'T':
+        case 'r':
+        case 'R':
+            return parse_frame(slcan, p, len, cmd);
+        case 'F':
+            return slcan->open && len == 1U ? CANSLCAN_STATUS : CANSLCAN_ERROR;
+        case 'Z':
+            if (slcan->open || len != 2U || (p[1] != '0' && p[1] != '1')) {
+                return CANSLCAN_ERROR;
+            }
+            slcan->timestamps = p[1] == '1';
+            return CANSLCAN_OK;
+        case 'V':
+            return CANSLCAN_VERSION;
+        case 'N':
+            return CANSLCAN_SERIAL;
+        case 'M':
+        case 'm':
+        case 'X':
+        case 'W':
+        case 'U':
+        case 'Q':
+            return CANSLCAN_OK;
+        default:
+            return CANSLCAN_ERROR;
+    }
+}
+
+uint32_t canslcan_put(canslcan_t *slcan, char c, canslcan_cmd_t *cmd)
+{
+    if (c == '\r') {
+        uint32_t result = slcan->overlong ? CANSLCAN_ERROR : parse(slcan, slcan->cmd, slcan->len, cmd);
+        slcan->len = 0;
+        slcan->overlong = false;
+        return result;
+    }
+    if (c == '\n') {
+        // Some hosts end lines with CR LF
+        return CANSLCAN_NONE;
+    }
+    if (slcan->len < CANSLCAN_CMD_MAX) {
+        slcan->cmd[slcan->len++] = c;
+    }
+    else {
+        slcan->overlong = true;
+    }
+
+    return CANSLCAN_NONE;
+}
+
+size_t canslcan_frame(const canslcan_t *slcan, char *line, uint64_t timestamp, bool ide, uint32_t arbitration_id,
+                      bool remote, uint8_t dlc, const uint8_t *data)
+{
+    char *p = line;
+    uint32_t len = dlc > 8U ? 8U : dlc;
+
+    if (ide) {
+        *p++ = remote ? 'R' : 'T';
+        p = put_hex(p, arbitration_id & 0x1fffffffU, 8U);
+    }
+    else {
+        *p++ = remote ? 'r' : 't';
+        p = put_hex(p, arbitration_id & 0x7ffU, 3U);
+    }
+    *p++ = hex_digits[len];
+    if (!remote) {
+        for (uint32_t i = 0; i < len; i++) {
+            p = put_hex(p, data[i], 2U);
+        }
+    }
+    if (slcan->timestamps) {
+        p = put_hex(p, (uint32_t)((timestamp / 1000U) % 60000U), 4U);
+    }
+    *p++ = '\r';
+
+    return (size_t)(p - line);
+}
+
+size_t canslcan_status(canslcan_t *slcan, char *line, uint8_t flags)
+{
+    line[0] = 'F';
+    put_hex(line + 1, flags | slcan->flags, 2U);
+    slcan->flags = 0;
+    line[3] = '\r';
+
+    return 4U;
+}
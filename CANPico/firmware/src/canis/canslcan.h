@@ -0,0 +1,111 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// SLCAN (Lawicel) protocol
+// ========================
+//
+// The ASCII protocol of the Lawicel CANUSB, understood by slcand and python-can. Commands are lines ending in
+// CR; the reply is CR for success or BEL for failure, with some commands replying with data first:
+//
+// - Sn: set the bit rate (n = 0 to 8 for 10K, 20K, 50K, 100K, 125K, 250K, 500K, 800K, 1M), only when closed
+// - O, L, C: open the channel (L opens it listen-only) or close it
+// - tiiildd.., Tiiiiiiiildd.., riiil, Riiiiiiiil: send a standard/extended data/remote frame, only when open
+//   (reply z or Z then CR)
+// - F: status flags (reply F and two hex digits then CR)
+// - Zn: timestamps off (0) or on (1), only when closed
+// - V, N: hardware and software version, serial number
+// - M, m, X, W, U, Q: accepted and ignored (acceptance filters are set up on the CAN instance)
+//
+// Received frames are sent to the host as the same lines as for sending, followed by a 16-bit millisecond
+// timestamp (wrapping at 60000) if timestamps are on.
+//
+// The parser keeps the protocol state (open, listen-only, timestamps) and checks the commands against it, so
+// that the caller only acts on the commands that need the CAN controller. This module is plain C with no
+// dependencies on the Pico SDK or MicroPython (test/test_canslcan.c runs it on the host).
+//
+// CAN.slcan() serves the protocol on USB CDC interface 1, which is also the MIN port (rp2_min.c). There is only
+// one second CDC interface, so SLCAN and MIN cannot run at the same time.
+
+#ifndef CANSLCAN_H
+#define CANSLCAN_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Longest command is an extended frame with 8 bytes and the CR
+#define CANSLCAN_CMD_MAX                    (27U)
+// Longest line sent to the host for a received frame
+#define CANSLCAN_LINE_MAX                   (32U)
+// Longest reply to a command (the V and N replies)
+#define CANSLCAN_REPLY_MAX                  (8U)
+
+// Commands returned by the parser
+#define CANSLCAN_NONE                       (0)         // Line not complete
+#define CANSLCAN_OK                         (1U)        // Done by the parser: reply CR
+#define CANSLCAN_ERROR                      (2U)        // Bad or not allowed: reply BEL
+#define CANSLCAN_BITRATE                    (3U)        // Set the bit rate to cmd->bitrate
+#define CANSLCAN_SEND                       (4U)        // Send the frame in cmd
+#define CANSLCAN_STATUS                     (5U)        // Reply with the status flags
+#define CANSLCAN_VERSION                    (6U)
+#define CANSLCAN_SERIAL                     (7U)
+
+// Status flags
+#define CANSLCAN_FLAG_RX_FULL               (0x01U)
+#define CANSLCAN_FLAG_TX_FULL               (0x02U)
+#define CANSLCAN_FLAG_ERROR_WARNING         (0x04U)
+#define CANSLCAN_FLAG_DATA_OVERRUN          (0x08U)
+#define CANSLCAN_FLAG_ERROR_PASSIVE         (0x20U)
+#define CANSLCAN_FLAG_ARBITRATION_LOST      (0x40U)
+#define CANSLCAN_FLAG_BUS_ERROR             (0x80U)
+
+typedef struct {
+    uint32_t bitrate;                           // Bits per second (S command)
+    bool ide;                                   // Frame to send (t, T, r, R commands)
+    uint32_t arbitration_id;
+    bool remote;
+    uint8_t dlc;
+    uint8_t data[8];
+} canslcan_cmd_t;
+
+typedef struct {
+    char cmd[CANSLCAN_CMD_MAX];                 // Command line so far
+    uint32_t len;
+    bool overlong;                              // Set if the line is too long (it is thrown away)
+    bool open;
+    bool listen_only;
+    bool timestamps;
+    uint8_t flags;                              // Status flags raised since the last F command
+} canslcan_t;
+
+/// \brief Initialize to closed with timestamps off
+void canslcan_init(canslcan_t *slcan);
+
+/// \brief Add a character from the host
+/// \return the command if this completes a line, CANSLCAN_NONE if not
+uint32_t canslcan_put(canslcan_t *slcan, char c, canslcan_cmd_t *cmd);
+
+/// \brief Format a received frame as a line for the host
+/// \param timestamp microseconds
+/// \return number of bytes put into the line
+size_t canslcan_frame(const canslcan_t *slcan, char *line, uint64_t timestamp, bool ide, uint32_t arbitration_id,
+                      bool remote, uint8_t dlc, const uint8_t *data);
+
+/// \brief Format the reply to the F command from the flags now and those raised since the last one (which are cleared)
+/// \return number of bytes put into the line
+size_t canslcan_status(canslcan_t *slcan, char *line, uint8_t flags);
+
+#endif // CANSLCAN_H
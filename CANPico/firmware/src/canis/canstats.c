@@ -0,0 +1,76 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "canbytes.h"
+#include "canstats.h"
+
+size_t canstats_table_size(size_t max_ids)
+{
+    return canfilter_idset_size(max_ids);
+}
+
+void canstats_init(canstats_t *stats, canstats_entry_t *entries, size_t size, size_t max_ids)
+{
+    for (size_t i = 0; i < size; i++) {
+        entries[i].key = CANFILTER_IDSET_EMPTY;
+    }
+    stats->entries = entries;
+    stats->mask = size - 1U;
+    stats->n_ids = 0;
+    stats->max_ids = max_ids;
+    stats->uncounted = 0;
+    stats->errors = 0;
+}
+
+size_t canstats_pack(const canstats_t *stats, size_t index, uint8_t *buf)
+{
+    const canstats_entry_t *e = &stats->entries[index];
+
+    if (e->key == CANFILTER_IDSET_EMPTY) {
+        return 0;
+    }
+
+    uint32_t id = e->key & 0x1fffffffU;
+    canbytes_put_word(buf, (e->key & 0x80000000U) ? ((1U << 29) | id) : (id << 18));
+    canbytes_put_word(buf + 4U, e->count);
+    if (e->count > 1U) {
+        canbytes_put_word(buf + 8U, e->last_period);
+        canbytes_put_word(buf + 12U, e->min_period);
+        canbytes_put_word(buf + 16U, e->max_period);
+        canbytes_put_word(buf + 20U, (uint32_t)(e->sum_period / (e->count - 1U)));
+    }
+    else {
+        canbytes_put_word(buf + 8U, 0);
+        canbytes_put_word(buf + 12U, 0);
+        canbytes_put_word(buf + 16U, 0);
+        canbytes_put_word(buf + 20U, 0);
+    }
+    canbytes_put_word(buf + 24U, e->count > 2U ? (uint32_t)(e->sum_jitter / (e->count - 2U)) : 0);
+    canbytes_put_word(buf + 28U, e->dlc_changes);
+    buf[32] = e->dlc;
+    buf[33] = 0;
+    buf[34] = 0;
+    buf[35] = 0;
+
+    return CANSTATS_RECORD_SIZE;
+}
+
+void canstats_pack_header(uint32_t n_records, uint32_t uncounted, uint32_t errors, uint8_t *buf)
+{
+    canbytes_put_word(buf, n_records);
+    canbytes_put_word(buf + 4U, uncounted);
+    canbytes_put_word(buf + 8U, errors);
+}
@@ -0,0 +1,155 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Per-ID traffic statistics
+// =========================
+//
+// An open-addressing hash table keyed by ID (the ID with the IDE flag in bit 31, as for the software ID set)
+// with linear probing, updated from the receive ISR for every frame. The table size is a power of two at least
+// twice the maximum number of IDs so there is always an empty slot to end a probe. Once the table holds the
+// maximum number of IDs, frames with new IDs are only counted as uncounted.
+//
+// An error frame does not carry the ID of the frame it destroyed, and the next frame received need not be
+// that frame sent again (its transmitter may have gone bus-off, or lost arbitration on the retry), so CAN
+// errors are counted in the header rather than against an ID.
+//
+// The snapshot is an 8-byte header followed by one record per ID, all big endian:
+//
+// Header:
+// Bytes 0-3:   Number of records
+// Bytes 4-7:   Frames not counted because the table was full
+// Bytes 8-11:  CAN errors (not attributed to an ID)
+//
+// Record:
+// Bytes 0-3:   CAN ID in 32-bit format (see rp2_can.h)
+// Bytes 4-7:   Number of frames
+// Bytes 8-11:  Last period (microseconds)
+// Bytes 12-15: Minimum period
+// Bytes 16-19: Maximum period
+// Bytes 20-23: Mean period
+// Bytes 24-27: Mean jitter (mean change in period from one frame to the next)
+// Bytes 28-31: Number of DLC changes
+// Byte 32:     Last DLC
+// Bytes 33-35: Reserved (0)
+//
+// The period fields are 0 until there are two frames, and the jitter until there are three.
+
+#ifndef CANSTATS_H
+#define CANSTATS_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "canfilter.h"
+
+#define CANSTATS_HEADER_SIZE                (12U)
+#define CANSTATS_RECORD_SIZE                (36U)
+
+typedef struct {
+    uint32_t key;                               // CANFILTER_IDSET_KEY() of the ID, CANFILTER_IDSET_EMPTY if unused
+    uint32_t count;
+    uint64_t last_timestamp;
+    uint32_t last_period;
+    uint32_t min_period;
+    uint32_t max_period;
+    uint64_t sum_period;                        // For the mean period
+    uint64_t sum_jitter;                        // For the mean jitter
+    uint32_t dlc_changes;
+    uint8_t dlc;
+} canstats_entry_t;
+
+typedef struct {
+    canstats_entry_t *entries;                  // Table of entries (NULL if statistics are off)
+    uint32_t mask;                              // Table size - 1
+    uint32_t n_ids;                             // Number of entries in use
+    uint32_t max_ids;
+    uint32_t uncounted;                         // Frames with a new ID when the table was full
+    uint32_t errors;                            // CAN errors
+} canstats_t;
+
+/// \brief Table size needed for a maximum number of IDs
+size_t canstats_table_size(size_t max_ids);
+
+/// \brief Initialize the statistics with a table of canstats_table_size() entries
+void canstats_init(canstats_t *stats, canstats_entry_t *entries, size_t size, size_t max_ids);
+
+/// \brief Write the record for the entry at a table index
+/// \return number of bytes written (0 if the entry is unused)
+size_t canstats_pack(const canstats_t *stats, size_t index, uint8_t *buf);
+
+/// \brief Write the snapshot header
+void canstats_pack_header(uint32_t n_records, uint32_t uncounted, uint32_t errors, uint8_t *buf);
+
+static inline void canstats_error(canstats_t *stats)
+{
+    stats->errors++;
+}
+
+static inline void canstats_frame(canstats_t *stats, uint32_t key, uint8_t dlc, uint64_t timestamp)
+{
+    uint32_t i = canfilter_idset_hash(key) & stats->mask;
+    canstats_entry_t *e;
+
+    for (;;) {
+        e = &stats->entries[i];
+        if (e->key == key) {
+            break;
+        }
+        if (e->key == CANFILTER_IDSET_EMPTY) {
+            if (stats->n_ids >= stats->max_ids) {
+                stats->uncounted++;
+                return;
+            }
+            stats->n_ids++;
+            e->key = key;
+            e->count = 0;
+            e->last_period = 0;
+            e->min_period = 0xffffffffU;
+            e->max_period = 0;
+            e->sum_period = 0;
+            e->sum_jitter = 0;
+            e->dlc_changes = 0;
+            e->dlc = dlc;
+            break;
+        }
+        i = (i + 1U) & stats->mask;
+    }
+
+    if (e->count > 0) {
+        uint64_t delta = timestamp - e->last_timestamp;
+        uint32_t period = delta > 0xffffffffULL ? 0xffffffffU : (uint32_t)delta;
+        if (e->count > 1U) {
+            e->sum_jitter += period > e->last_period ? period - e->last_period : e->last_period - period;
+        }
+        if (period < e->min_period) {
+            e->min_period = period;
+        }
+        if (period > e->max_period) {
+            e->max_period = period;
+        }
+        e->sum_period += period;
+        e->last_period = period;
+        if (dlc != e->dlc) {
+            e->dlc_changes++;
+            e->dlc = dlc;
+        }
+    }
+    e->last_timestamp = timestamp;
+    e->count++;
+}
+
+#endif // CANSTATS_H
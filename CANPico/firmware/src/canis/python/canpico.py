@@ -39,16 +39,13 @@ class CANPico:
     # Ping function that sends back a CAN frame
     def pinger(self):
         while True:
-            frames = self.c.recv()
+            frames = self.c.recv(timeout_ms=-1)
             for frame in frames:
                 self.c.send_frame(frame)
 
-    # Simple CAN bus monitor
-    def mon(self):
-        while True:
-            frames = self.c.recv()
-            for frame in frames:
-                print(frame)
+    # CAN bus monitor, printing every frame in candump log style (or Vector ASC style) until a keyboard interrupt
+    def mon(self, asc=False):
+        self.c.monitor(style=CAN.MONITOR_ASC if asc else CAN.MONITOR_CANDUMP)
 
     # Sends a frame repeatedly, if period_ms is None sends back-to-back
     def sender(self, f, period_ms=100):
@@ -65,9 +62,7 @@ class CANPico:
         if not isinstance(f, CANFrame):
             raise TypeError("f is not a CAN frame")
         self.c.send_frame(f)
-        while True:
-            if f.get_timestamp() is not None:
-                return
+        self.c.wait_sent(f)
 
     # Sends a frame and if queueing failed then keep trying until there is space
     def always_send(self, f):
@@ -76,19 +71,18 @@ class CANPico:
                 self.c.send_frame(f)
                 return
             except:
-                pass
+                self.c.wait_space(1)
 
     def always_send2(self, f):
-        while True:
-            if self.c.get_send_space() > 0:
-                self.c.send_frame(f)
-                return
+        self.c.wait_space(1)
+        self.c.send_frame(f)
 
     # Create a follow-up message with the timestamp in the payload
     def fup(self, f):
         if not isinstance(f, CANFrame):
             raise TypeError("f is not a CAN frame")
-        return CANFrame(CANID(0x101), data=pack('>I', f.get_timestamp()))
+        # Timestamps are 64-bit but the bottom 32 bits are enough to measure drift
+        return CANFrame(CANID(0x101), data=pack('>I', f.get_timestamp() & 0xffffffff))
 
     # Sends a heartbeat frame every 1s and a follow-up message containing the local transmit timestamp
     def heartbeat(self):
@@ -103,11 +97,11 @@ class CANPico:
         self.c.recv()  # Clear out old frames
         ts = None  # Don't know the first timestamp yet
         while True:
-            frames = self.c.recv()
+            frames = self.c.recv(timeout_ms=-1)
             for frame in frames:
                 if frame is not None:
                     if frame.get_arbitration_id() == 0x100:  # First frame
-                        ts = frame.get_timestamp()
+                        ts = frame.get_timestamp() & 0xffffffff
                     if frame.get_arbitration_id() == 0x101:  # Follow-up frame
                         sender_ts = unpack('>I', frame.get_data())[0]
                         if ts is not None:  # If the first timestamp is known then the offset can be computed
@@ -26,17 +26,31 @@
 
 #include "common.h"
 #include "rp2_can.h"
+#include "canfd.h"
+#include "rp2_cansched.h"
+#include "rp2_cansync.h"
+#include "rp2_perf.h"
+#ifdef CANHACK
+#include "rp2_canhack.h"
+#endif
 
 #include <hardware/irq.h>
 #include <hardware/gpio.h>
+#include <hardware/sync.h>
+#include <hardware/timer.h>
+#include <pico/time.h>
 #include <py/objstr.h>
 #include <py/stream.h>
 #include <py/runtime.h>
+#include <py/objint.h>
+#include <py/objarray.h>
 #include <py/mphal.h>
 #include <py/mperrno.h>
 #include <py/runtime.h>
 
 #include <hardware/structs/scb.h>
+#include <hardware/structs/iobank0.h>
+#include "tusb.h"
 
 // TODO faster FIFO implementation using power-of-two masks on index values
 // TODO more than TRIG pin 1 trigger with an OR condition between them
@@ -49,6 +63,15 @@
 
 #define FRAME_FROM_BYTES_NUM                (19U)
 
+// MCP25xxFD registers used to change the ID filters while the controller stays on the bus
+#define MCP25XXFD_C1FLTCON(n)               (0x1d0U + (n))          // One byte per filter
+#define MCP25XXFD_C1FLTOBJ(n)               (0x1f0U + ((n) * 8U))
+#define MCP25XXFD_C1MASK(n)                 (0x1f4U + ((n) * 8U))
+#define MCP25XXFD_FLTCON_FLTEN              (0x80U)
+#define MCP25XXFD_FLT_EXIDE                 (1U << 30)              // MIDE in the mask register
+#define MCP25XXFD_SPI_WRITE                 (0x20U)
+#define MCP25XXFD_SPI_READ                  (0x30U)
+
 #ifdef NOTDEF
 // Only used for debugging to print from outside MicroPython firmware
 void debug_printf( const char *format, ... )
@@ -62,39 +85,304 @@ void debug_printf( const char *format, ... )
 }
 #endif
 
+// The controller whose interrupt is being handled. The driver's callbacks do not say which controller they
+// are for, so the interrupt dispatcher sets this around the call to the driver's interrupt handler.
+STATIC rp2_can_obj_t *rp2_can_isr_obj;
+
+// The CAN instance that a driver callback is for
+STATIC rp2_can_obj_t *TIME_CRITICAL rp2_can_callback_obj(void)
+{
+    return rp2_can_isr_obj != NULL ? rp2_can_isr_obj : MP_STATE_PORT(rp2_can_obj[0]);
+}
+
+// Queue the responses to the remote frames seen by the receive callback. This is done once the driver's
+// interrupt handler has returned rather than from inside its callback so that the driver is not re-entered.
+STATIC void TIME_CRITICAL rp2_can_send_responses(rp2_can_obj_t *self)
+{
+    canresponder_t *responder = &self->responder;
+
+    for (uint32_t i = 0; i < self->n_responder_pending; i++) {
+        canresponder_entry_t *e = self->responder_pending[i];
+        can_frame_t frame;
+        can_make_frame(&frame, (e->key & 0x80000000U) != 0, e->key & 0x1fffffffU, e->dlc, e->data, false);
+        // Responses go in the priority queue so that they are not stuck behind the FIFO queue
+        if (rp2_can_send_frame_copy(self, &frame, 0, false, NULL) == CAN_ERC_NO_ERROR) {
+            e->responses++;
+            responder->responses++;
+        }
+        else {
+            responder->misses++;
+        }
+    }
+    self->n_responder_pending = 0;
+}
+
+// True if the GPIO interrupt from a controller is enabled (the driver disables it while using the SPI bus)
+STATIC bool TIME_CRITICAL rp2_can_irq_enabled(rp2_can_obj_t *self)
+{
+    uint32_t pin = self->controller.host_interface.spi_irq;
+    uint32_t inte = io_bank0_hw->proc0_irq_ctrl.inte[pin / 8U];
+
+    return ((inte >> (4U * (pin % 8U))) & 0xfU) != 0;
+}
+
+// Lock the SPI bus by disabling the interrupts from all the controllers that are set up, returning the ones
+// that were enabled (to pass to rp2_can_spi_unlock()). Locks nest.
+uint32_t TIME_CRITICAL rp2_can_spi_lock(void)
+{
+    uint32_t locked = 0;
+
+    for (uint32_t i = 0; i < CAN_MAX_CONTROLLERS; i++) {
+        rp2_can_obj_t *self = MP_STATE_PORT(rp2_can_obj[i]);
+        if (self != MP_OBJ_NULL && self->irq_active && rp2_can_irq_enabled(self)) {
+            mcp25xxfd_spi_gpio_disable_irq(&self->controller.host_interface);
+            locked |= 1U << i;
+        }
+    }
+
+    return locked;
+}
+
+void TIME_CRITICAL rp2_can_spi_unlock(uint32_t locked)
+{
+    for (uint32_t i = 0; i < CAN_MAX_CONTROLLERS; i++) {
+        rp2_can_obj_t *self = MP_STATE_PORT(rp2_can_obj[i]);
+        if (self != MP_OBJ_NULL && (locked & (1U << i)) != 0) {
+            mcp25xxfd_spi_gpio_enable_irq(&self->controller.host_interface);
+        }
+    }
+}
+
+// True if the thread was interrupted while using the SPI bus (for any controller). The scheduler alarm has the
+// same priority as the GPIO interrupt so neither can interrupt the other, and the ISR cannot run while the bus
+// is busy.
+bool TIME_CRITICAL rp2_can_spi_busy(void)
+{
+    for (uint32_t i = 0; i < CAN_MAX_CONTROLLERS; i++) {
+        rp2_can_obj_t *self = MP_STATE_PORT(rp2_can_obj[i]);
+        if (self != MP_OBJ_NULL && self->irq_active && !rp2_can_irq_enabled(self)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint32_t rp2_can_read_time(rp2_can_obj_t *self)
+{
+    uint32_t locked = rp2_can_spi_lock();
+    uint32_t time = can_get_time(&self->controller);
+    rp2_can_spi_unlock(locked);
+
+    return time;
+}
+
+can_status_t rp2_can_read_status(rp2_can_obj_t *self)
+{
+    uint32_t locked = rp2_can_spi_lock();
+    can_status_t status = can_get_status(&self->controller);
+    rp2_can_spi_unlock(locked);
+
+    return status;
+}
+
+// Shared GPIO interrupt dispatcher: services each controller with its interrupt line asserted. This runs on
+// core 0 only: the driver (and rp2_can_spi_lock()) keep the ISR off the SPI bus and the driver's FIFOs by
+// disabling the controllers' GPIO interrupts on core 0, which does nothing to stop core 1, so servicing the
+// interrupt on core 1 would need a cross-core lock inside the driver.
 STATIC void TIME_CRITICAL irq_handler(void)
 {
-    // Get a pointer to the CAN controller
-    rp2_can_obj_t *self = MP_STATE_PORT(rp2_can_obj[0]);
-    can_controller_t *controller = &self->controller;
+    for (uint32_t i = 0; i < CAN_MAX_CONTROLLERS; i++) {
+        rp2_can_obj_t *self = MP_STATE_PORT(rp2_can_obj[i]);
+        if (self == MP_OBJ_NULL) {
+            continue;
+        }
+        can_controller_t *controller = &self->controller;
+
+        // Work out if this interrupt is from the the MCP25xxFD. The bound interface
+        // defines the pin used for the interrupt line from the CAN controller.
+        uint8_t spi_irq = controller->host_interface.spi_irq;
+        uint32_t events = gpio_get_irq_event_mask(spi_irq);
+
+        if (events & GPIO_IRQ_LEVEL_LOW) {
+            rp2_can_isr_obj = self;
+            uint32_t perf_start = PERF_START();
+            mcp25xxfd_irq_handler(controller);
+            PERF_END(CANPERF_CAN_ISR, perf_start);
+            rp2_can_isr_obj = NULL;
+            if (self->n_responder_pending > 0) {
+                rp2_can_send_responses(self);
+            }
+        }
+    }
+}
+
+// Bind the host interface of a controller. The CANPico has one controller, so boards with more provide their
+// own version of this that sets up the SPI chip select and interrupt pin of each one.
+bool __attribute__((weak)) rp2_can_bind_interface(uint32_t index, can_interface_t *interface)
+{
+    if (index == 0) {
+        mcp25xxfd_spi_bind_canpico(interface);
+        return true;
+    }
+
+    return false;
+}
+
+// Returns true if no controller has been created (so the interrupt dispatcher is not installed)
+STATIC bool rp2_can_none_created(void)
+{
+    for (uint32_t i = 0; i < CAN_MAX_CONTROLLERS; i++) {
+        if (MP_STATE_PORT(rp2_can_obj[i]) != MP_OBJ_NULL) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// How often the timebase is sampled again when queueing frames, so that clock drift between the RP2040 and
+// the controller (up to about 100ppm) does not build up to more than a microsecond in queueing timestamps
+#define TIMEBASE_RESAMPLE_US                (10000U)
+
+// The 64-bit controller time now, estimated from the RP2040 timer (which ticks at the same rate)
+uint64_t TIME_CRITICAL rp2_can_estimate_time(rp2_can_obj_t *self)
+{
+    return self->timebase.controller + (time_us_64() - self->timebase.local);
+}
 
-    // Work out if this interrupt is from the the MCP25xxFD. The bound interface
-    // defines the pin used for the interrupt line from the CAN controller.
-    uint8_t spi_irq = controller->host_interface.spi_irq;
-    uint32_t events = gpio_get_irq_event_mask(spi_irq); 
+// Extend a 32-bit controller timestamp to 64 bits. The 64-bit controller time now is estimated from the
+// RP2040 timer and the timestamp is placed next to it. This is correct for timestamps within 35 minutes
+// of now, and the clock drift between samples of the timebase is far smaller.
+uint64_t TIME_CRITICAL rp2_can_extend_timestamp(rp2_can_obj_t *self, uint32_t timestamp)
+{
+    uint64_t now = rp2_can_estimate_time(self);
+
+    return now + (int64_t)(int32_t)(timestamp - (uint32_t)now);
+}
+
+// Sample the two clocks together to refresh the timebase. Returns the controller time as 64 bits.
+uint64_t rp2_can_sample_timebase(rp2_can_obj_t *self)
+{
+    // The controller time is read part way through the SPI transfer so is paired with the RP2040 time half
+    // way between the start and the end of the transfer
+    uint64_t before = time_us_64();
+    uint32_t controller = rp2_can_read_time(self);
+    uint64_t after = time_us_64();
+    uint64_t extended = rp2_can_extend_timestamp(self, controller);
+
+    uint32_t state = save_and_disable_interrupts();
+    self->timebase.controller = extended;
+    self->timebase.local = before + (after - before) / 2U;
+    restore_interrupts(state);
+
+    return extended;
+}
+
+// Controller time to record when a frame is queued (samples the timebase again if it has not been sampled
+// for a while)
+STATIC uint64_t rp2_can_queue_time(rp2_can_obj_t *self)
+{
+    if (time_us_64() - self->timebase.local > TIMEBASE_RESAMPLE_US) {
+        rp2_can_sample_timebase(self);
+    }
+
+    return rp2_can_estimate_time(self);
+}
 
-    if (events & GPIO_IRQ_LEVEL_LOW) {
-        mcp25xxfd_irq_handler(controller);
+// Get a 64-bit value from an int (mp_obj_get_int() is only 32 bits on the RP2040)
+uint64_t rp2_can_get_uint64(mp_obj_t obj)
+{
+    if (MP_OBJ_IS_SMALL_INT(obj)) {
+        return (uint64_t)(int64_t)MP_OBJ_SMALL_INT_VALUE(obj);
     }
+    if (!MP_OBJ_IS_TYPE(obj, &mp_type_int)) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_TypeError, "int expected"));
+    }
+    // The RP2040 is little-endian
+    uint64_t value = 0;
+    mp_obj_int_to_bytes_impl(obj, false, sizeof(value), (byte *)&value);
+
+    return value;
+}
+
+// mp_printf() has no 64-bit format so print timestamps via an int object
+STATIC void rp2_can_print_timestamp(const mp_print_t *print, uint64_t timestamp)
+{
+    mp_obj_print_helper(print, mp_obj_new_int_from_ull(timestamp), PRINT_STR);
 }
 
-// In the future there may be multiple CAN controllers on a CANPico board and
-// so they will all be initialized/de-initialized here.
+// Transmit slots of each controller: they hold no heap pointers, so they are kept out of the CAN object that
+// the garbage collector scans
+STATIC can_tx_slot_t rp2_can_tx_slots[CAN_MAX_CONTROLLERS][CAN_TX_SLOTS];
+
+// Storage for the deep receive FIFO: in BSS rather than the heap so the garbage collector does not scan it
+STATIC uint8_t rp2_can_rx_arena[CAN_RX_ARENA_FRAMES * CAN_RX_RECORD_SIZE];
+// Only one controller at a time can have a deep receive FIFO
+STATIC rp2_can_obj_t *rp2_can_rx_arena_owner;
+
+// All the CAN controllers are initialized/de-initialized here.
 void can_init(void) {
-    // Set up the root pointer to a null CAN controller object so that the memory is not allocate until CAN is used.
-    MP_STATE_PORT(rp2_can_obj[0]) = MP_OBJ_NULL;
+    // Set up the root pointers to null CAN controller objects so that the memory is not allocated until CAN is used.
+    for (uint32_t i = 0; i < CAN_MAX_CONTROLLERS; i++) {
+        MP_STATE_PORT(rp2_can_obj[i]) = MP_OBJ_NULL;
+    }
+    rp2_can_isr_obj = NULL;
+    can_sched_init();
+    canload_init_tables();
+    rp2_perf_init();
 }
 
 void can_deinit(void) {
     // Called when the system is soft reset (CTRL-D in REPL).
 
-    // If the controller is initialized then take it offline and deactivate it
-    rp2_can_obj_t *self = MP_STATE_PORT(rp2_can_obj[0]);
-    if (self != MP_OBJ_NULL) {
-        can_stop_controller(&self->controller);
+    // Stop any scheduled sends before the controllers go
+    can_sched_deinit();
+    // If a controller is initialized then take it offline and deactivate it
+    if (!rp2_can_none_created()) {
+        for (uint32_t i = 0; i < CAN_MAX_CONTROLLERS; i++) {
+            rp2_can_obj_t *self = MP_STATE_PORT(rp2_can_obj[i]);
+            if (self != MP_OBJ_NULL) {
+                uint32_t locked = rp2_can_spi_lock();
+                can_stop_controller(&self->controller);
+                self->irq_active = false;
+                rp2_can_spi_unlock(locked & ~(1U << i));
+            }
+            MP_STATE_PORT(rp2_can_obj[i]) = MP_OBJ_NULL;
+        }
         irq_remove_handler(IO_IRQ_BANK0, irq_handler);
     }
-    MP_STATE_PORT(rp2_can_obj[0]) = MP_OBJ_NULL;
+    rp2_can_rx_arena_owner = NULL;
+}
+
+// Checks a dict of CANIDFilter instances keyed by filter number and copies out the filters. Filters
+// not in the dict are disabled. Returns a bitmask of the filters that are in the dict.
+STATIC uint32_t rp2_can_get_id_filters(mp_obj_dict_t *mp_id_filters, can_id_filter_t *filters)
+{
+    if(!MP_OBJ_IS_TYPE(mp_id_filters, &mp_type_dict)) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_TypeError, "A dict expected for id_filters"));
+    }
+
+    uint32_t enabled = 0;
+    for(uint32_t idx = 0; idx < CAN_MAX_ID_FILTERS; idx++) {
+        mp_map_elem_t *elem = mp_map_lookup(&mp_id_filters->map, MP_OBJ_NEW_SMALL_INT(idx), MP_MAP_LOOKUP);
+        if (elem != NULL) {
+            if(!MP_OBJ_IS_TYPE(elem->value, &rp2_canidfilter_type)) {
+                nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_TypeError, "A CANIDFilter instance expected for filter %d", idx));
+            }
+            CAN_DEBUG_PRINT("Filter index=%d\n", idx);
+            rp2_canidfilter_obj_t *mp_filter = elem->value;
+            // Filter has already been made
+            filters[idx] = mp_filter->filter;
+            enabled |= 1U << idx;
+        }
+        else {
+            // Not defined, set a disabled filter
+            can_make_id_filter_disabled(&filters[idx]);
+        }
+    }
+
+    return enabled;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -103,6 +391,38 @@ void can_deinit(void) {
 
 ////////////////////////////////////// Start of CAN class //////////////////////////////////////
 
+// Nominal bit rate of a pre-defined bit rate profile (0 if not known)
+STATIC uint32_t rp2_can_profile_bitrate(uint32_t profile)
+{
+    switch (profile) {
+        case CAN_BITRATE_125K_75:
+        case CAN_BITRATE_125K_50:
+        case CAN_BITRATE_125K_875:
+            return 125000U;
+        case CAN_BITRATE_250K_75:
+        case CAN_BITRATE_250K_50:
+        case CAN_BITRATE_250K_875:
+            return 250000U;
+        case CAN_BITRATE_500K_75:
+        case CAN_BITRATE_500K_50:
+        case CAN_BITRATE_500K_875:
+            return 500000U;
+        case CAN_BITRATE_1M_75:
+        case CAN_BITRATE_1M_50:
+        case CAN_BITRATE_1M_875:
+            return 1000000U;
+        case CAN_BITRATE_2M_50:
+        case CAN_BITRATE_2M_80:
+            return 2000000U;
+        case CAN_BITRATE_2_5M_75:
+            return 2500000U;
+        case CAN_BITRATE_4M_90:
+            return 4000000U;
+        default:
+            return 0;
+    }
+}
+
 // Create the CAN instance and initialize the controller
 STATIC mp_obj_t rp2_can_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp_uint_t n_kw, const mp_obj_t *all_args)
 {
@@ -120,6 +440,8 @@ STATIC mp_obj_t rp2_can_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp
         {MP_QSTR_reject_remote,     MP_ARG_KW_ONLY | MP_ARG_BOOL,   {.u_bool = false}},
         {MP_QSTR_rx_callback_fn,    MP_ARG_KW_ONLY | MP_ARG_OBJ,    {.u_obj = mp_const_none}}, 
         {MP_QSTR_recv_overflows,    MP_ARG_KW_ONLY | MP_ARG_BOOL,   {.u_bool = false}},               
+        {MP_QSTR_rx_fifo_depth,     MP_ARG_KW_ONLY | MP_ARG_INT,    {.u_int = 0}},
+        {MP_QSTR_index,             MP_ARG_KW_ONLY | MP_ARG_INT,    {.u_int = 0}},
     };
 
     mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
@@ -138,6 +460,8 @@ STATIC mp_obj_t rp2_can_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp
     bool reject_remote = args[10].u_bool;
     mp_obj_t mp_rx_callback_fn = args[11].u_obj;
     bool recv_overflows = args[12].u_bool;
+    mp_int_t rx_fifo_depth = args[13].u_int;
+    mp_int_t index = args[14].u_int;
 
     can_bitrate_t bitrate = {.profile=profile,
                              .brp=brp,
@@ -154,54 +478,51 @@ STATIC mp_obj_t rp2_can_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp
     if (mp_rx_callback_fn != mp_const_none && !MP_OBJ_IS_FUN(mp_rx_callback_fn)) {
         nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_TypeError, "rx_callback_fn must be a function"));
     }
+    if (index < 0 || index >= (mp_int_t)CAN_MAX_CONTROLLERS) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "index must be 0 to %d", (int)CAN_MAX_CONTROLLERS - 1));
+    }
+    // A depth of 0 uses the driver's receive FIFO (of CAN_RX_FIFO_SIZE) for frames
+    if (rx_fifo_depth < 0 || rx_fifo_depth > (mp_int_t)CAN_RX_ARENA_FRAMES) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "rx_fifo_depth must be 0 to %d", (int)CAN_RX_ARENA_FRAMES));
+    }
+    if ((rx_fifo_depth & (rx_fifo_depth - 1)) != 0) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "rx_fifo_depth must be a power of two"));
+    }
 
-    if (mp_id_filters != mp_const_none) {
-        // Check dictionary is well-formed
-        if(!MP_OBJ_IS_TYPE(mp_id_filters, &mp_type_dict)) {
-            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_TypeError, "A dict expected for id_filters"));
-        }
+    // Up to 32 filters can be set
+    can_id_filter_t filters[CAN_MAX_ID_FILTERS];
+    uint32_t filters_enabled = 0;
 
-        for(uint32_t idx = 0; idx < CAN_MAX_ID_FILTERS; idx++) {
-            mp_map_elem_t *elem = mp_map_lookup(&mp_id_filters->map, MP_OBJ_NEW_SMALL_INT(idx), MP_MAP_LOOKUP);
-            if (elem != NULL) {
-                if(!MP_OBJ_IS_TYPE(elem->value, &rp2_canidfilter_type)) {
-                    nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_TypeError, "A CANIDFilter instance expected for filter %d", idx));
-                }
-            }
-        }
+    // Check the dictionary is well-formed and pull out the filters
+    if (mp_id_filters != mp_const_none) {
+        CAN_DEBUG_PRINT("Setting specific filters\n");
+        filters_enabled = rp2_can_get_id_filters(mp_id_filters, filters);
     }
 
     // Create class instance for controller
-    rp2_can_obj_t *self = MP_STATE_PORT(rp2_can_obj[0]);
+    rp2_can_obj_t *self = MP_STATE_PORT(rp2_can_obj[index]);
+
+    if (rx_fifo_depth > 0 && rp2_can_rx_arena_owner != NULL && rp2_can_rx_arena_owner != self) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Deep receive FIFO in use by controller %d", (int)rp2_can_rx_arena_owner->index));
+    }
 
     if (self == MP_OBJ_NULL) {
+        can_interface_t interface;
+        if (!rp2_can_bind_interface(index, &interface)) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "No controller %d on this board", (int)index));
+        }
         // Newly create object (we don't want it created always because it's a fairly large object, with
         // large receive FIFO and this shouldn't be allocated until needed).
+        bool first = rp2_can_none_created();
         self = m_new_obj(rp2_can_obj_t);
         self->base.type = &rp2_can_type;
-        MP_STATE_PORT(rp2_can_obj[0]) = self;
-        // Bind the interrupt handler from the GPIO port
-        irq_add_shared_handler(IO_IRQ_BANK0, irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
-    }
-
-    // Up to 32 filters can be set
-    can_id_filter_t filters[CAN_MAX_ID_FILTERS];
-
-    // Add in the filters
-    if (mp_id_filters != mp_const_none) {
-        CAN_DEBUG_PRINT("Setting specific filters\n");
-        for (uint32_t idx = 0; idx < CAN_MAX_ID_FILTERS; idx++) {
-            mp_map_elem_t *elem = mp_map_lookup(&mp_id_filters->map, MP_OBJ_NEW_SMALL_INT(idx), MP_MAP_LOOKUP);
-            if (elem != NULL) {
-                CAN_DEBUG_PRINT("Filter index=%d\n", idx);
-                rp2_canidfilter_obj_t *mp_filter = elem->value;
-                // Filter has already been made
-                filters[idx] = mp_filter->filter;
-            }
-            else {
-                // Not defined, set a disabled filter
-                can_make_id_filter_disabled(&filters[idx]);
-            }
+        self->index = index;
+        self->tx_slots = rp2_can_tx_slots[index];
+        self->irq_active = false;
+        MP_STATE_PORT(rp2_can_obj[index]) = self;
+        // Bind the interrupt dispatcher from the GPIO port (shared by all the controllers)
+        if (first) {
+            irq_add_shared_handler(IO_IRQ_BANK0, irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
         }
     }
 
@@ -225,10 +546,15 @@ STATIC mp_obj_t rp2_can_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp
     }
     options |= CAN_OPTION_RECORD_TX_EVENTS;
 
-    // Bind the host interface to the CANPico's pin layout
-    mcp25xxfd_spi_bind_canpico(&self->controller.host_interface);
+    // Bind the host interface to the board's pin layout for this controller
+    rp2_can_bind_interface(index, &self->controller.host_interface);
     // Can now call the initialize with the interface bound
+    // The other controllers are locked out of the SPI bus while this one is set up (and its own interrupt is
+    // only on again once the setup has succeeded)
+    self->irq_active = false;
+    uint32_t locked = rp2_can_spi_lock();
     can_errorcode_t rc = can_setup_controller(&self->controller, &bitrate, &all_filters, mode, options);
+    rp2_can_spi_unlock(locked);
     if (rc == CAN_ERC_BAD_INIT) {
         nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_RuntimeError, "Hardware error: Cannot put CAN controller into config mode"));
     }
@@ -242,12 +568,74 @@ STATIC mp_obj_t rp2_can_make_new(const mp_obj_type_t *type, mp_uint_t n_args, mp
     if (rc != CAN_ERC_NO_ERROR) {
         nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_RuntimeError, "Unknown error code: %d", rc));
     }
+    self->irq_active = true;
     // Set the callback function that will be called with a received frame
     self->mp_rx_callback_fn = mp_rx_callback_fn;
+    // All frames let through by the hardware filters are accepted until set_accept_ids() is called
+    self->accept.enabled = false;
+    self->accept.rejected = 0;
+    // Statistics are off until set_stats() is called
+    self->stats.entries = NULL;
+    // No receive policies until set_rx_policy() is called
+    self->policy.entries = NULL;
+    // No mailboxes until set_mailbox() is called
+    self->mailbox.records = NULL;
+    self->mailbox.n_slots = 0;
+    // Remote frames are not answered until set_rtr_responder() is called
+    self->responder.entries = NULL;
+    self->n_responder_pending = 0;
+    // Nothing is logged until set_log_file() is called
+    self->logger.log = NULL;
+    self->logger.spare = NULL;
+    self->logger.file = MP_OBJ_NULL;
+    // All frames go to the driver's FIFO until set_rx_lane() is called
+    memset(self->rx_lanes, 0, sizeof(self->rx_lanes));
+    memset(self->filter_lane, 0, sizeof(self->filter_lane));
+    self->lane_filters = 0;
+    // The deep receive FIFO starts empty (locked because the controller is already receiving)
+    uint32_t state = save_and_disable_interrupts();
+    memset(&self->rx_deep, 0, sizeof(self->rx_deep));
+    if (rx_fifo_depth > 0) {
+        self->rx_deep.records = rp2_can_rx_arena;
+        self->rx_deep.size = rx_fifo_depth;
+        rp2_can_rx_arena_owner = self;
+    }
+    else if (rp2_can_rx_arena_owner == self) {
+        rp2_can_rx_arena_owner = NULL;
+    }
+    restore_interrupts(state);
+    // The bus load meter needs to be told the bit rate if custom bit timings are used
+    self->bitrate = brp < 0 ? rp2_can_profile_bitrate(profile) : 0;
+    self->load.enabled = false;
+    // Transmit latency histograms start empty
+    memset(self->latency, 0, sizeof(self->latency));
+    // Keep a copy of the filters so that set_filters() only has to change the ones that are different
+    memcpy(self->id_filters, filters, sizeof(filters));
+    self->id_filters_enabled = filters_enabled;
+    self->id_filters_known = mp_id_filters != mp_const_none;
+    // Setting up the controller has flushed the transmit queues so all the slots are free
+    for (uint32_t i = 0; i < CAN_TX_SLOTS; i++) {
+        self->tx_slots[i].queued = false;
+    }
+    self->tx_slot_next = 0;
+    // Any schedule was for the old controller setup
+    can_sched_reset(self);
+    can_sync_reset(self);
+    // The 64-bit controller time starts from the controller's time now
+    self->timebase.controller = rp2_can_read_time(self);
+    self->timebase.local = time_us_64();
+    self->timebase.epoch_valid = false;
 
     return self;
 }
 
+void rp2_can_check_classic(const rp2_canframe_obj_t *mp_frame)
+{
+    if (mp_frame->fd) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "CAN FD frames cannot be sent: the CAN driver only sends classic frames"));
+    }
+}
+
 STATIC mp_obj_t rp2_can_send_frame(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
 {
     static const mp_arg_t allowed_args[] = {
@@ -267,9 +655,28 @@ STATIC mp_obj_t rp2_can_send_frame(mp_uint_t n_args, const mp_obj_t *pos_args, m
     if(!MP_OBJ_IS_TYPE(mp_frame, &rp2_canframe_type)) {
         nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_TypeError, "CANFrame expected"));
     }
+    rp2_can_check_classic(mp_frame);
+
+    // Record when the frame was queued (before queueing because the frame could be sent straight away)
+    mp_frame->queued_at = rp2_can_queue_time(self);
+    mp_frame->fifo = fifo;
 
     // C API call
+    uint32_t start = PERF_START();
+    uint32_t locked = rp2_can_spi_lock();
+    // The timestamp of an earlier send is cleared with the ISR locked out, so that wait_sent() waits for this
+    // one (and is kept if the frame could not be queued)
+    bool timestamp_valid = mp_frame->timestamp_valid;
+    bool latency_valid = mp_frame->latency_valid;
+    mp_frame->timestamp_valid = false;
+    mp_frame->latency_valid = false;
     can_errorcode_t rc = can_send_frame(controller, &mp_frame->frame, fifo);
+    if (rc != CAN_ERC_NO_ERROR) {
+        mp_frame->timestamp_valid = timestamp_valid;
+        mp_frame->latency_valid = latency_valid;
+    }
+    rp2_can_spi_unlock(locked);
+    PERF_END(CANPERF_CAN_SEND, start);
 
     if (rc == CAN_ERC_NO_ROOM_FIFO) {
         nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "No room in FIFO queue"));
@@ -308,12 +715,20 @@ STATIC mp_obj_t rp2_can_send_frames(mp_uint_t n_args, const mp_obj_t *pos_args,
         if(!MP_OBJ_IS_TYPE(mp_frame, &rp2_canframe_type)) {
             nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_TypeError, "CANFrame expected"));
         }
+        rp2_can_check_classic(mp_frame);
     }
 
     if (can_is_space(controller, frames->len, fifo)) {
+        uint64_t queued_at = rp2_can_queue_time(self);
         for (uint32_t i = 0; i < frames->len; i++) {
             rp2_canframe_obj_t *mp_frame = frames->items[i];
+            mp_frame->queued_at = queued_at;
+            mp_frame->fifo = fifo;
+            uint32_t locked = rp2_can_spi_lock();
+            mp_frame->timestamp_valid = false;
+            mp_frame->latency_valid = false;
             can_send_frame(controller, &mp_frame->frame, fifo);
+            rp2_can_spi_unlock(locked);
         }
     }
     else {
@@ -324,108 +739,1983 @@ STATIC mp_obj_t rp2_can_send_frames(mp_uint_t n_args, const mp_obj_t *pos_args,
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_send_frames_obj, 1, rp2_can_send_frames);
 
-STATIC mp_obj_t rp2_can_recv(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+// Returns true if the uref of a transmitted frame points to a transmit slot rather than a CANFrame instance
+STATIC bool TIME_CRITICAL rp2_can_is_tx_slot(rp2_can_obj_t *self, void *ref)
+{
+    return (self != MP_OBJ_NULL) &&
+           ((can_tx_slot_t *)ref >= &self->tx_slots[0]) &&
+           ((can_tx_slot_t *)ref < &self->tx_slots[CAN_TX_SLOTS]);
+}
+
+// The controller owning a transmit slot, or NULL if the uref is not a transmit slot
+STATIC rp2_can_obj_t *TIME_CRITICAL rp2_can_tx_slot_owner(void *ref)
+{
+    for (uint32_t i = 0; i < CAN_MAX_CONTROLLERS; i++) {
+        rp2_can_obj_t *self = MP_STATE_PORT(rp2_can_obj[i]);
+        if (rp2_can_is_tx_slot(self, ref)) {
+            return self;
+        }
+    }
+
+    return NULL;
+}
+
+// Find a free transmit slot (called with interrupts locked). A slot is in use from being queued until the
+// frame is transmitted. After that its tag and timestamp stay readable until the slot comes round again, which
+// is long enough for the transmit event to be read unless the transmit event FIFO is overflowing.
+STATIC can_tx_slot_t * TIME_CRITICAL rp2_can_alloc_tx_slot(rp2_can_obj_t *self)
+{
+    for (uint32_t i = 0; i < CAN_TX_SLOTS; i++) {
+        uint32_t idx = (self->tx_slot_next + i) % CAN_TX_SLOTS;
+        if (!self->tx_slots[idx].queued) {
+            self->tx_slot_next = (idx + 1U) % CAN_TX_SLOTS;
+            return &self->tx_slots[idx];
+        }
+    }
+
+    return NULL;
+}
+
+// Send a copy of a frame, so that there is no CANFrame instance to keep alive. The transmit event is
+// reported with the tag given and, if the frame had a deadline (controller time), with the difference
+// between the transmit time and the deadline. Can be called from interrupt context.
+can_errorcode_t TIME_CRITICAL rp2_can_send_frame_copy(rp2_can_obj_t *self, const can_frame_t *frame, uint32_t tag, bool fifo, const uint32_t *deadline)
+{
+    uint32_t state = save_and_disable_interrupts();
+    can_tx_slot_t *slot = rp2_can_alloc_tx_slot(self);
+    if (slot == NULL) {
+        restore_interrupts(state);
+        return CAN_ERC_NO_ROOM;
+    }
+    slot->frame = *frame;
+    slot->tag = tag;
+    slot->timed = deadline != NULL;
+    slot->deadline = deadline != NULL ? *deadline : 0;
+    can_frame_set_uref(&slot->frame, slot);
+    slot->fifo = fifo;
+    slot->queued_at = rp2_can_estimate_time(self);
+    slot->queued = true;
+    restore_interrupts(state);
+
+    uint32_t locked = rp2_can_spi_lock();
+    can_errorcode_t rc = can_send_frame(&self->controller, &slot->frame, fifo);
+    rp2_can_spi_unlock(locked);
+    if (rc != CAN_ERC_NO_ERROR) {
+        slot->queued = false;
+    }
+
+    return rc;
+}
+
+// Send frames given in the binary format used by CANFrame.from_bytes() (see rp2_can.h) without creating
+// CANFrame instances. Queues as many frames as will fit and returns the number of frames queued. The
+// transmit events for these frames are reported with the tag from the bytes.
+STATIC mp_obj_t rp2_can_send_bytes(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
 {
     static const mp_arg_t allowed_args[] = {
-        {MP_QSTR_limit,         MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = CAN_RX_FIFO_SIZE}},
-        {MP_QSTR_as_bytes,      MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
+        {MP_QSTR_frames,   MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = mp_const_none}},
+        {MP_QSTR_fifo,     MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
     };
 
     rp2_can_obj_t *self = pos_args[0];
-    can_controller_t *controller = &self->controller;
     mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
     mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
 
-    // rx_fifo.free is safe to access outside the ISR because it's an atomic word and can only decrease so num_frames can only increase
-        
-    uint32_t limit = args[0].u_int;
-    bool as_bytes = args[1].u_bool;
+    bool fifo = args[1].u_bool;
 
-    uint32_t num_events = can_recv_pending(controller);
-    if (limit > num_events) {
-        limit = num_events;
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[0].u_obj, &bufinfo, MP_BUFFER_READ);
+
+    if ((bufinfo.len % FRAME_FROM_BYTES_NUM) != 0) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Frames must be a multiple of %d bytes", FRAME_FROM_BYTES_NUM));
     }
+    size_t num_frames = bufinfo.len / FRAME_FROM_BYTES_NUM;
+    const uint8_t *buf_ptr = bufinfo.buf;
+    size_t sent = 0;
 
-    // If the queue is empty then return a result that does not use the heap: otherwise spinning
-    // on recv() will invoke the garbage collector.
+    for (size_t i = 0; i < num_frames; i++) {
+        if (buf_ptr[i * FRAME_FROM_BYTES_NUM] & CANFD_FLAG_FD) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "CAN FD frames cannot be sent: the CAN driver only sends classic frames"));
+        }
+    }
 
-    if (num_events == 0) {
-        if (as_bytes) {
-            return mp_const_empty_bytes;
+    while (sent < num_frames) {
+        // Turn the bytes into a CAN frame (this stores the tag in uref)
+        can_frame_t frame;
+        can_make_frame_from_bytes(&frame, (uint8_t *)buf_ptr);
+        uint32_t tag = (uint32_t)(can_frame_get_uref(&frame).ref);
+
+        if (rp2_can_send_frame_copy(self, &frame, tag, fifo, NULL) != CAN_ERC_NO_ERROR) {
+            // No room: the rest of the frames are left for the caller to send later
+            break;
         }
-        else {
-            return mp_const_empty_tuple;
+        sent++;
+        buf_ptr += FRAME_FROM_BYTES_NUM;
+    }
+
+    return MP_OBJ_NEW_SMALL_INT(sent);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_send_bytes_obj, 1, rp2_can_send_bytes);
+
+// Gets an ID or an inclusive range of IDs from an integer, a CANID or a (lo, hi) tuple of integers
+void rp2_can_get_id_range(mp_obj_t item, bool extended_default, bool *extended, uint32_t *lo, uint32_t *hi)
+{
+    if (MP_OBJ_IS_TYPE(item, &rp2_canid_type)) {
+        rp2_canid_obj_t *canid = item;
+        *extended = canid->extended;
+        *lo = canid->arbitration_id;
+        *hi = canid->arbitration_id;
+        return;
+    }
+
+    *extended = extended_default;
+    if (MP_OBJ_IS_TYPE(item, &mp_type_tuple)) {
+        size_t len;
+        mp_obj_t *elems;
+        mp_obj_tuple_get(item, &len, &elems);
+        if (len != 2U) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "ID range must be a (lo, hi) tuple"));
         }
+        *lo = (uint32_t)mp_obj_get_int(elems[0]);
+        *hi = (uint32_t)mp_obj_get_int(elems[1]);
+    }
+    else {
+        *lo = (uint32_t)mp_obj_get_int(item);
+        *hi = *lo;
     }
 
-    if (as_bytes) {
-        // Temporary buffer to store some frames
-        uint8_t buf[255];
+    // Negative values become large unsigned values and are caught here too
+    if ((*lo > *hi) || (*hi > (*extended ? CAN_ID_ARBITRATION_ID : 0x7ffU))) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "ID out of range"));
+    }
+}
 
-        size_t remaining = sizeof(buf);
-        size_t n = 0;
+// Software acceptance of a frame, called from the ISR and from recv(). Returns false if the frame
+// was let through by the hardware filters but its ID was not asked for. Only recv() counts the rejected
+// frames because the ISR sees the same frames first.
+STATIC bool TIME_CRITICAL rp2_can_accept_id(can_accept_t *accept, bool ide, uint32_t arbitration_id, bool count)
+{
+    if (!accept->enabled) {
+        return true;
+    }
 
-        // Pull frames from the FIFO up to a limit, keeping track of the bytes added so that if
-        // there aren't enough bytes then that's the number returned
-        for (uint32_t i = 0; i < limit; i++) {
-            size_t added = can_recv_as_bytes(controller, buf + n, remaining);
-            if (added > 0) {
-                n += added;
-                remaining -= added;
-            }
-            else {
-                break;
-            }
+    uint32_t key = CANFILTER_IDSET_KEY(ide, arbitration_id);
+    if (canfilter_idset_contains(&accept->ids, key)) {
+        return true;
+    }
+    for (uint32_t i = 0; i < accept->n_ranges; i++) {
+        if (key >= accept->range_lo[i] && key <= accept->range_hi[i]) {
+            return true;
         }
-        // Return bytes for the block of frames (might be zero)
-        return make_mp_bytes(buf, n);
     }
-    else {
-        // Frames that will be pulled are the minimum of the limit or the number of frames in the RX FIFO
-        // Will return an empty list if there are no frames
+    if (count) {
+        accept->rejected++;
+    }
+
+    return false;
+}
+
+STATIC bool TIME_CRITICAL rp2_can_accept_frame(can_accept_t *accept, can_frame_t *frame, bool count)
+{
+    return rp2_can_accept_id(accept, can_frame_is_extended(frame), can_frame_get_arbitration_id(frame), count);
+}
+
+// Same as above but for a frame in the binary format (see rp2_can.h)
+STATIC bool rp2_can_accept_bytes(can_accept_t *accept, const uint8_t *buf)
+{
+    if ((buf[0] & 0x0fU) != CAN_EVENT_TYPE_RECEIVED_FRAME) {
+        return true;
+    }
+
+    uint32_t id_word = BIG_ENDIAN_WORD(buf + 7U);
+    bool ide = (id_word & (1U << 29U)) != 0;
+    uint32_t arbitration_id = ide ? (id_word & 0x1fffffffU) : ((id_word >> 18) & 0x7ffU);
+
+    return rp2_can_accept_id(accept, ide, arbitration_id, true);
+}
+
+// Apply any receive policy to a received frame (see canpolicy.h), returning true if the frame is delivered
+STATIC bool rp2_can_policy_frame(rp2_can_obj_t *self, can_frame_t *frame, uint64_t timestamp)
+{
+    if (self->policy.entries == NULL) {
+        return true;
+    }
+    uint32_t key = CANFILTER_IDSET_KEY(can_frame_is_extended(frame), can_frame_get_arbitration_id(frame));
+
+    return canpolicy_check(&self->policy, key, can_frame_get_id_filter(frame), can_frame_get_dlc(frame),
+                           can_frame_get_data(frame), can_frame_get_data_len(frame), timestamp);
+}
+
+// Same as above but for an event in the binary format (see rp2_can.h)
+STATIC bool rp2_can_policy_bytes(rp2_can_obj_t *self, const uint8_t *buf)
+{
+    if (self->policy.entries == NULL || (buf[0] & 0x0fU) != CAN_EVENT_TYPE_RECEIVED_FRAME) {
+        return true;
+    }
+
+    uint32_t id_word = BIG_ENDIAN_WORD(buf + 7U);
+    bool ide = (id_word & (1U << 29U)) != 0;
+    uint32_t arbitration_id = ide ? (id_word & 0x1fffffffU) : ((id_word >> 18) & 0x7ffU);
+    bool remote = (buf[0] & 0x80U) != 0;
+    uint8_t dlc = buf[5];
+    uint8_t len = remote ? 0 : (dlc > 8U ? 8U : dlc);
+    uint64_t timestamp = rp2_can_extend_timestamp(self, BIG_ENDIAN_WORD(buf + 1U));
+
+    return canpolicy_check(&self->policy, CANFILTER_IDSET_KEY(ide, arbitration_id), buf[6], dlc, buf + 11U, len, timestamp);
+}
+
+// Returns true if a received frame in the driver's FIFO belongs to a priority lane (so is returned from there)
+STATIC bool TIME_CRITICAL rp2_can_on_lane(rp2_can_obj_t *self, uint32_t filter)
+{
+    return filter < CAN_MAX_ID_FILTERS && (self->lane_filters & (1U << filter)) != 0;
+}
+
+// Same as above but for an event in the binary format (see rp2_can.h)
+STATIC bool rp2_can_on_lane_bytes(rp2_can_obj_t *self, const uint8_t *buf)
+{
+    return (buf[0] & 0x0fU) == CAN_EVENT_TYPE_RECEIVED_FRAME && rp2_can_on_lane(self, buf[6]);
+}
+
+// Write a received frame in the binary format (see rp2_can.h)
+STATIC void TIME_CRITICAL rp2_can_pack_rx_frame(const can_frame_t *frame, uint32_t timestamp, uint8_t *buf)
+{
+    uint32_t id = can_frame_get_arbitration_id(frame);
+    bool ide = can_frame_is_extended(frame);
+    uint32_t len = can_frame_get_data_len(frame);
+
+    buf[0] = CAN_EVENT_TYPE_RECEIVED_FRAME | (can_frame_is_remote(frame) ? 0x80U : 0);
+    BIG_ENDIAN_BUF(buf + 1U, timestamp);
+    buf[5] = can_frame_get_dlc(frame);
+    buf[6] = can_frame_get_id_filter(frame);
+    BIG_ENDIAN_BUF(buf + 7U, ide ? ((1U << 29) | id) : (id << 18));
+    for (uint32_t i = 0; i < 8U; i++) {
+        buf[11U + i] = i < len ? can_frame_get_data(frame)[i] : 0;
+    }
+}
+
+// Put a received frame in the deep receive FIFO (called from the receive ISR)
+STATIC void TIME_CRITICAL rp2_can_deep_put(rp2_can_obj_t *self, can_frame_t *frame, uint64_t timestamp)
+{
+    can_rx_deep_t *deep = &self->rx_deep;
+
+    if (deep->head - deep->tail >= deep->size) {
+        deep->overflows++;
+        return;
+    }
+    uint8_t *record = deep->records + (deep->head & (deep->size - 1U)) * CAN_RX_RECORD_SIZE;
+    rp2_can_pack_rx_frame(frame, (uint32_t)timestamp, record);
+    record[CAN_RX_RECORD_BYTES] = 0;
+    BIG_ENDIAN_BUF(record + 20U, (uint32_t)(timestamp >> 32));
+    deep->head++;
+}
+
+// Put a received frame in its receive lane (called from the receive ISR)
+STATIC void TIME_CRITICAL rp2_can_lane_put(rp2_can_obj_t *self, can_frame_t *frame, uint64_t timestamp)
+{
+    uint32_t filter = can_frame_get_id_filter(frame);
+
+    if (filter >= CAN_MAX_ID_FILTERS || self->filter_lane[filter] == 0) {
+        return;
+    }
+    can_rx_lane_t *lane = &self->rx_lanes[self->filter_lane[filter] - 1U];
+    if (lane->head - lane->tail >= lane->size) {
+        lane->overflows++;
+        return;
+    }
+    can_rx_lane_entry_t *e = &lane->entries[lane->head & (lane->size - 1U)];
+    e->frame = *frame;
+    e->timestamp = timestamp;
+    lane->head++;
+    lane->received++;
+}
+
+// Receive from a priority lane, in the same formats as the driver's FIFO
+STATIC mp_obj_t rp2_can_recv_lane(rp2_can_obj_t *self, can_rx_lane_t *lane, uint32_t limit, bool as_bytes)
+{
+    uint32_t pending = lane->head - lane->tail;
+    uint32_t overflows = lane->overflows - lane->overflows_reported;
+
+    if (limit > pending) {
+        limit = pending;
+    }
+    if (limit == 0 && overflows == 0) {
+        return as_bytes ? mp_const_empty_bytes : mp_const_empty_tuple;
+    }
+
+    if (as_bytes) {
+        // Same size of block as the driver's FIFO returns
+        uint8_t buf[255];
+        size_t n = 0;
+
+        for (uint32_t i = 0; i < limit && n + CAN_RX_RECORD_BYTES <= sizeof(buf); i++) {
+            can_rx_lane_entry_t *e = &lane->entries[lane->tail & (lane->size - 1U)];
+            rp2_can_pack_rx_frame(&e->frame, (uint32_t)e->timestamp, buf + n);
+            lane->tail++;
+            n += CAN_RX_RECORD_BYTES;
+        }
+        // Overflows are only counted (see get_rx_lane_status())
+        lane->overflows_reported += overflows;
+
+        return make_mp_bytes(buf, n);
+    }
+    else {
+        mp_obj_list_t *list = mp_obj_new_list(limit + (overflows > 0 ? 1U : 0), NULL);
+        size_t n = 0;
+
+        for (uint32_t i = 0; i < limit; i++) {
+            can_rx_lane_entry_t *e = &lane->entries[lane->tail & (lane->size - 1U)];
+            rp2_canframe_obj_t *mp_frame = m_new_obj(rp2_canframe_obj_t);
+            mp_frame->base.type = &rp2_canframe_type;
+            mp_frame->frame = e->frame;
+            mp_frame->timestamp = e->timestamp;
+            mp_frame->timestamp_valid = true;
+            mp_frame->sync_valid = can_sync_master_time(self, e->timestamp, &mp_frame->sync_timestamp);
+            mp_frame->latency_valid = false;
+            lane->tail++;
+            list->items[n++] = mp_frame;
+        }
+        if (overflows > 0) {
+            rp2_canoverflow_obj_t *mp_overflow = m_new_obj(rp2_canoverflow_obj_t);
+            mp_overflow->base.type = &rp2_canoverflow_type;
+            mp_overflow->receive = true;
+            mp_overflow->error_cnt = 0;
+            mp_overflow->frame_cnt = overflows;
+            mp_overflow->timestamp = rp2_can_estimate_time(self);
+            list->items[n++] = mp_overflow;
+            lane->overflows_reported += overflows;
+        }
+        list->len = n;
+
+        return list;
+    }
+}
+
+// Receive from the deep receive FIFO. Frames come from the deep FIFO and CAN errors from the driver's FIFO
+// (which is emptied, its copies of the frames and its overflow records being dropped), so the errors in a
+// batch come first and their order against the frames is given by the timestamps.
+STATIC mp_obj_t rp2_can_recv_deep(rp2_can_obj_t *self, uint32_t limit, bool as_bytes)
+{
+    can_controller_t *controller = &self->controller;
+    can_rx_deep_t *deep = &self->rx_deep;
+    uint32_t num_events = can_recv_pending(controller);
+    uint32_t pending = deep->head - deep->tail;
+    uint32_t overflows = deep->overflows - deep->overflows_reported;
+
+    if (limit > pending) {
+        limit = pending;
+    }
+    if (num_events == 0 && limit == 0 && overflows == 0) {
+        return as_bytes ? mp_const_empty_bytes : mp_const_empty_tuple;
+    }
+
+    if (as_bytes) {
+        // Not limited to one small block as for the driver's FIFO so that a backlog can be cleared quickly
+        uint8_t event[CAN_RX_RECORD_SIZE];
+        vstr_t vstr;
+        vstr_init(&vstr, (limit + (overflows > 0 ? 1U : 0)) * CAN_RX_RECORD_BYTES);
+
+        for (uint32_t i = 0; i < num_events; i++) {
+            size_t added = can_recv_as_bytes(controller, event, sizeof(event));
+            if (added == 0) {
+                break;
+            }
+            if ((event[0] & 0x0fU) == CAN_EVENT_TYPE_CAN_ERROR) {
+                vstr_add_strn(&vstr, (const char *)event, added);
+            }
+        }
+        // Frames dropped by the filter or a policy do not count against the limit
+        uint32_t delivered = 0;
+        for (uint32_t i = 0; i < pending && delivered < limit; i++) {
+            uint8_t *record = deep->records + (deep->tail & (deep->size - 1U)) * CAN_RX_RECORD_SIZE;
+            if (rp2_can_accept_bytes(&self->accept, record) && rp2_can_policy_bytes(self, record)) {
+                vstr_add_strn(&vstr, (const char *)record, CAN_RX_RECORD_BYTES);
+                delivered++;
+            }
+            deep->tail++;
+        }
+        if (overflows > 0) {
+            memset(event, 0, CAN_RX_RECORD_BYTES);
+            event[0] = CAN_EVENT_TYPE_OVERFLOW;
+            BIG_ENDIAN_BUF(event + 1U, (uint32_t)rp2_can_estimate_time(self));
+            BIG_ENDIAN_BUF(event + 7U, overflows);
+            vstr_add_strn(&vstr, (const char *)event, CAN_RX_RECORD_BYTES);
+            deep->overflows_reported += overflows;
+        }
+
+        return mp_obj_new_bytes_from_vstr(&vstr);
+    }
+    else {
+        mp_obj_list_t *list = mp_obj_new_list(num_events + limit + (overflows > 0 ? 1U : 0), NULL);
+        size_t n = 0;
+
+        for (uint32_t i = 0; i < num_events; i++) {
+            can_rx_event_t event;
+            can_rx_event_t *ev = &event;
+            if (!can_recv(controller, ev)) {
+                break;
+            }
+            if (can_event_is_error(ev)) {
+                rp2_canerror_obj_t *mp_error = m_new_obj(rp2_canerror_obj_t);
+                mp_error->base.type = &rp2_canerror_type;
+                mp_error->error = *can_event_get_error(ev); // Make a copy (ev is temporary)
+                mp_error->timestamp = rp2_can_extend_timestamp(self, can_event_get_timestamp(ev));
+                list->items[n++] = mp_error;
+            }
+        }
+        // Frames dropped by the filter or a policy do not count against the limit
+        uint32_t delivered = 0;
+        for (uint32_t i = 0; i < pending && delivered < limit; i++) {
+            uint8_t *record = deep->records + (deep->tail & (deep->size - 1U)) * CAN_RX_RECORD_SIZE;
+            // The whole record (including the high timestamp word) is copied before the slot is freed for the ISR
+            uint8_t buf[CAN_RX_RECORD_SIZE];
+            memcpy(buf, record, CAN_RX_RECORD_SIZE);
+            deep->tail++;
+
+            if (!rp2_can_accept_bytes(&self->accept, buf) || !rp2_can_policy_bytes(self, buf)) {
+                continue;
+            }
+            uint64_t timestamp = ((uint64_t)BIG_ENDIAN_WORD(buf + 20U) << 32) | BIG_ENDIAN_WORD(buf + 1U);
+            // The record is in the transmit format apart from the event type
+            buf[0] &= 0x80U;
+            rp2_canframe_obj_t *mp_frame = m_new_obj(rp2_canframe_obj_t);
+            mp_frame->base.type = &rp2_canframe_type;
+            can_make_frame_from_bytes(&mp_frame->frame, buf);
+            can_frame_set_uref(&mp_frame->frame, mp_frame);
+            mp_frame->tag = 0;
+            mp_frame->timestamp = timestamp;
+            mp_frame->timestamp_valid = true;
+            mp_frame->sync_valid = can_sync_master_time(self, timestamp, &mp_frame->sync_timestamp);
+            mp_frame->latency_valid = false;
+            list->items[n++] = mp_frame;
+            delivered++;
+        }
+        if (overflows > 0) {
+            rp2_canoverflow_obj_t *mp_overflow = m_new_obj(rp2_canoverflow_obj_t);
+            mp_overflow->base.type = &rp2_canoverflow_type;
+            mp_overflow->receive = true;
+            mp_overflow->error_cnt = 0;
+            mp_overflow->frame_cnt = overflows;
+            mp_overflow->timestamp = rp2_can_estimate_time(self);
+            list->items[n++] = mp_overflow;
+            deep->overflows_reported += overflows;
+        }
+        list->len = n;
+
+        return list;
+    }
+}
+
+// Deadline for a wait of timeout_ms milliseconds (negative waits for ever)
+STATIC absolute_time_t rp2_can_wait_until(mp_int_t timeout_ms)
+{
+    return timeout_ms < 0 ? at_the_end_of_time : make_timeout_time_ms(timeout_ms);
+}
+
+// Sleep the core with WFE until an interrupt (such as the controller's) or the deadline, first running any
+// scheduled callbacks and letting a keyboard interrupt end the wait. Returns false once the deadline is
+// reached, so the caller loops checking its condition. An interrupt taken between checking the condition
+// and the WFE sets the event register so the WFE returns at once.
+STATIC bool rp2_can_wait_event(absolute_time_t until)
+{
+    mp_handle_pending(true);
+    if (time_reached(until)) {
+        return false;
+    }
+    best_effort_wfe_or_timeout(until);
+
+    return true;
+}
+
+// Number of events waiting to be read from the deep FIFO or the driver's FIFO
+STATIC uint32_t rp2_can_rx_pending(rp2_can_obj_t *self)
+{
+    if (self->rx_deep.records != NULL) {
+        return self->rx_deep.head - self->rx_deep.tail;
+    }
+
+    return can_recv_pending(&self->controller);
+}
+
+// Pulls up to a limit of events from a lane, the deep FIFO or the driver's FIFO
+STATIC mp_obj_t rp2_can_recv_events(rp2_can_obj_t *self, mp_int_t lane, uint32_t limit, bool as_bytes)
+{
+    can_controller_t *controller = &self->controller;
+
+    if (lane > 0) {
+        return rp2_can_recv_lane(self, &self->rx_lanes[lane - 1], limit, as_bytes);
+    }
+    if (self->rx_deep.records != NULL) {
+        return rp2_can_recv_deep(self, limit, as_bytes);
+    }
+
+    uint32_t num_events = can_recv_pending(controller);
+    if (limit > num_events) {
+        limit = num_events;
+    }
+
+    // If the queue is empty then return a result that does not use the heap: otherwise spinning
+    // on recv() will invoke the garbage collector.
+
+    if (num_events == 0) {
+        if (as_bytes) {
+            return mp_const_empty_bytes;
+        }
+        else {
+            return mp_const_empty_tuple;
+        }
+    }
+
+    if (as_bytes) {
+        // Temporary buffer to store some frames
+        uint8_t buf[255];
+
+        size_t remaining = sizeof(buf);
+        size_t n = 0;
+        uint32_t delivered = 0;
+
+        // Pull frames from the FIFO up to a limit, keeping track of the bytes added so that if
+        // there aren't enough bytes then that's the number returned. Only frames delivered count
+        // against the limit: dropped ones are drained without using it up.
+        for (uint32_t i = 0; i < num_events && delivered < limit; i++) {
+            size_t added = can_recv_as_bytes(controller, buf + n, remaining);
+            if (added > 0) {
+                // A frame not accepted is overwritten by the next one
+                if (!rp2_can_on_lane_bytes(self, buf + n) && rp2_can_accept_bytes(&self->accept, buf + n) &&
+                    rp2_can_policy_bytes(self, buf + n)) {
+                    n += added;
+                    remaining -= added;
+                    delivered++;
+                }
+            }
+            else {
+                break;
+            }
+        }
+        // Return bytes for the block of frames (might be zero)
+        return make_mp_bytes(buf, n);
+    }
+    else {
+        // Frames that will be pulled are the minimum of the limit or the number of frames in the RX FIFO
+        // Will return an empty list if there are no frames
+
+        mp_obj_list_t *list = mp_obj_new_list(limit, NULL);
+        size_t n = 0;
+
+        // Pull events from the FIFO until the limit is delivered or the pending events are drained
+        // (dropped frames do not count against the limit)
+        for (uint32_t i = 0; i < num_events && n < limit; i++) {
+            can_rx_event_t event;
+            can_rx_event_t *ev = &event;
+            if (can_recv(controller, ev)) {
+                if (can_event_is_frame(ev)) {
+                    // Frames not accepted are dropped before any objects are created for them
+                    uint64_t timestamp = rp2_can_extend_timestamp(self, can_event_get_timestamp(ev));
+                    if (rp2_can_on_lane(self, can_frame_get_id_filter(can_event_get_frame(ev))) ||
+                        !rp2_can_accept_frame(&self->accept, can_event_get_frame(ev), true) ||
+                        !rp2_can_policy_frame(self, can_event_get_frame(ev), timestamp)) {
+                        continue;
+                    }
+                    rp2_canframe_obj_t *mp_frame = m_new_obj(rp2_canframe_obj_t);
+                    mp_frame->base.type = &rp2_canframe_type;
+                    mp_frame->frame = *can_event_get_frame(ev); // Make a copy (ev is temporary)
+                    mp_frame->timestamp = timestamp;
+                    mp_frame->timestamp_valid = true;
+                    mp_frame->sync_valid = can_sync_master_time(self, timestamp, &mp_frame->sync_timestamp);
+                    mp_frame->latency_valid = false;
+                    list->items[n++] = mp_frame;
+                }
+                else if (can_event_is_error(ev)) {
+                    rp2_canerror_obj_t *mp_error = m_new_obj(rp2_canerror_obj_t);
+                    mp_error->base.type = &rp2_canerror_type;
+                    mp_error->error = *can_event_get_error(ev); // Make a copy (ev is temporary)
+                    mp_error->timestamp = rp2_can_extend_timestamp(self, can_event_get_timestamp(ev));
+                    list->items[n++] = mp_error;
+                }
+                else if (can_event_is_overflow(ev)) {
+                    rp2_canoverflow_obj_t *mp_overflow = m_new_obj(rp2_canoverflow_obj_t);
+                    mp_overflow->base.type = &rp2_canoverflow_type;
+                    mp_overflow->receive = true;
+                    mp_overflow->error_cnt = can_rx_overflow_get_error_cnt(&ev->event.overflow);
+                    mp_overflow->frame_cnt = can_rx_overflow_get_frame_cnt(&ev->event.overflow);
+                    mp_overflow->timestamp = rp2_can_extend_timestamp(self, can_event_get_timestamp(ev));
+                    list->items[n++] = mp_overflow;
+                }
+                else {
+                    // Unknown event type, should never happen, but we set the list item
+                    // to none just in case
+                    list->items[n++] = mp_const_none;
+                }
+            }
+            else {
+                break;
+            }
+        }
+        // Shrink the list if there were fewer frames than expected
+        list->len = n;
+
+        return list;
+    }
+}
+
+// Number of items in a result of rp2_can_recv_events(), adding the number that are frames to n_frames
+STATIC uint32_t rp2_can_count_items(mp_obj_t result, bool as_bytes, uint32_t *n_frames)
+{
+    size_t len;
+    if (as_bytes) {
+        const uint8_t *buf = (const uint8_t *)mp_obj_str_get_data(result, &len);
+        for (size_t i = 0; i + CAN_RX_RECORD_BYTES <= len; i += CAN_RX_RECORD_BYTES) {
+            if ((buf[i] & 0x0fU) == CAN_EVENT_TYPE_RECEIVED_FRAME) {
+                (*n_frames)++;
+            }
+        }
+        return len / CAN_RX_RECORD_BYTES;
+    }
+    mp_obj_t *items;
+    mp_obj_get_array(result, &len, &items);
+    for (size_t i = 0; i < len; i++) {
+        if (MP_OBJ_IS_TYPE(items[i], &rp2_canframe_type)) {
+            (*n_frames)++;
+        }
+    }
+
+    return len;
+}
+
+STATIC mp_obj_t rp2_can_recv(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_limit,         MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = CAN_RX_FIFO_SIZE}},
+        {MP_QSTR_as_bytes,      MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
+        {MP_QSTR_lane,          MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0}},
+        {MP_QSTR_timeout_ms,    MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0}},
+        {MP_QSTR_min_frames,    MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 1}},
+    };
+
+    rp2_can_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    // rx_fifo.free is safe to access outside the ISR because it's an atomic word and can only decrease so num_frames can only increase
+        
+    uint32_t limit = args[0].u_int;
+    bool as_bytes = args[1].u_bool;
+    mp_int_t lane = args[2].u_int;
+
+    if (lane < 0 || lane >= (mp_int_t)CAN_RX_LANES) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Lane must be 0 to %d", (int)CAN_RX_LANES - 1));
+    }
+    if (lane > 0 && self->rx_lanes[lane - 1].size == 0) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Lane not set up"));
+    }
+
+    // With a timeout, keep taking events and sleeping until min_frames frames have been delivered (or the
+    // limit is reached or the timeout). Frames dropped by the filter, a policy or a lane do not count.
+    mp_int_t timeout_ms = args[3].u_int;
+    uint32_t min_frames = args[4].u_int;
+    absolute_time_t until = rp2_can_wait_until(timeout_ms);
+    mp_obj_t result = as_bytes ? mp_const_empty_bytes : mp_const_empty_tuple;
+    uint32_t n_items = 0;
+    uint32_t n_frames = 0;
+
+    do {
+        uint32_t start = PERF_START();
+        mp_obj_t more = rp2_can_recv_events(self, lane, limit - n_items, as_bytes);
+        PERF_END(CANPERF_CAN_RECV, start);
+
+        uint32_t n_more = rp2_can_count_items(more, as_bytes, &n_frames);
+        if (n_more > 0) {
+            // Batches after the first are joined on (only when waiting, so the usual call allocates once)
+            result = n_items == 0 ? more : mp_binary_op(MP_BINARY_OP_ADD, result, more);
+            n_items += n_more;
+        }
+    } while (timeout_ms != 0 && n_frames < min_frames && n_items < limit && rp2_can_wait_event(until));
+
+    return result;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_recv_obj, 1, rp2_can_recv);
+
+// The REPL's CDC port
+#define CAN_MONITOR_CDC_ITF                 (0)
+
+// Line buffer for monitor() and slcan() (only one runs at a time). Static to keep it off the stack.
+STATIC char rp2_can_monitor_buf[CAN_MONITOR_BUF_SIZE];
+
+// Format an event in the binary format (see rp2_can.h) as a monitor line, or as an SLCAN line if there is an
+// SLCAN server, returning its length (0 if it has none)
+STATIC size_t rp2_can_monitor_line(rp2_can_obj_t *self, uint32_t style, canslcan_t *slcan, const uint8_t *buf, char *line)
+{
+    uint32_t type = buf[0] & 0x0fU;
+    uint64_t timestamp = rp2_can_extend_timestamp(self, BIG_ENDIAN_WORD(buf + 1U));
+
+    if (type == CAN_EVENT_TYPE_RECEIVED_FRAME) {
+        if (rp2_can_on_lane_bytes(self, buf) || !rp2_can_accept_bytes(&self->accept, buf) || !rp2_can_policy_bytes(self, buf)) {
+            return 0;
+        }
+        uint32_t id_word = BIG_ENDIAN_WORD(buf + 7U);
+        bool ide = (id_word & (1U << 29U)) != 0;
+        uint32_t arbitration_id = ide ? (id_word & 0x1fffffffU) : ((id_word >> 18) & 0x7ffU);
+        bool remote = (buf[0] & 0x80U) != 0;
+
+        if (slcan != NULL) {
+            // Frames are thrown away while the channel is closed
+            return slcan->open ? canslcan_frame(slcan, line, timestamp, ide, arbitration_id, remote, buf[5], buf + 11U) : 0;
+        }
+        return canmon_frame(style, line, timestamp, ide, arbitration_id, remote, buf[5], buf + 11U);
+    }
+    else if (type == CAN_EVENT_TYPE_CAN_ERROR) {
+        if (slcan != NULL) {
+            slcan->flags |= CANSLCAN_FLAG_BUS_ERROR;
+            return 0;
+        }
+        return canmon_error(style, line, timestamp);
+    }
+    else if (type == CAN_EVENT_TYPE_OVERFLOW) {
+        self->monitor.overflows += BIG_ENDIAN_WORD(buf + 7U);
+    }
+
+    return 0;
+}
+
+// Format an event onto the end of the line buffer, dropping the line if it does not fit, and return the new
+// length of the buffer
+STATIC size_t rp2_can_monitor_add(rp2_can_obj_t *self, uint32_t style, canslcan_t *slcan, const uint8_t *event, char *buf, size_t n)
+{
+    char line[CANMON_LINE_MAX];
+    size_t len = rp2_can_monitor_line(self, style, slcan, event, line);
+
+    if (len > 0) {
+        if (n + len > CAN_MONITOR_BUF_SIZE) {
+            self->monitor.dropped++;
+            if (slcan != NULL) {
+                slcan->flags |= CANSLCAN_FLAG_DATA_OVERRUN;
+            }
+        }
+        else {
+            memcpy(buf + n, line, len);
+            n += len;
+            self->monitor.lines++;
+        }
+    }
+
+    return n;
+}
+
+// Pull received events and format them into the line buffer
+STATIC size_t rp2_can_monitor_fill(rp2_can_obj_t *self, uint32_t style, canslcan_t *slcan, char *buf, size_t n)
+{
+    can_controller_t *controller = &self->controller;
+    can_rx_deep_t *deep = &self->rx_deep;
+    uint8_t event[CAN_RX_RECORD_SIZE];
+
+    // With the deep FIFO on, only errors and overflows are left in the driver's FIFO
+    uint32_t num_events = can_recv_pending(controller);
+    for (uint32_t i = 0; i < num_events; i++) {
+        if (can_recv_as_bytes(controller, event, sizeof(event)) == 0) {
+            break;
+        }
+        n = rp2_can_monitor_add(self, style, slcan, event, buf, n);
+    }
+    if (deep->records != NULL) {
+        uint32_t pending = deep->head - deep->tail;
+        for (uint32_t i = 0; i < pending; i++) {
+            n = rp2_can_monitor_add(self, style, slcan, deep->records + (deep->tail & (deep->size - 1U)) * CAN_RX_RECORD_SIZE, buf, n);
+            deep->tail++;
+        }
+        uint32_t overflows = deep->overflows - deep->overflows_reported;
+        self->monitor.overflows += overflows;
+        deep->overflows_reported += overflows;
+    }
+
+    return n;
+}
+
+// Write as much of the line buffer to a USB CDC port as it will take, keeping the rest for next time, and
+// return what is left. If the port is not connected then the lines are dropped.
+STATIC size_t rp2_can_monitor_write(rp2_can_obj_t *self, uint32_t itf, char *buf, size_t n)
+{
+    if (n == 0) {
+        return 0;
+    }
+    if (!tud_cdc_n_connected(itf)) {
+        for (size_t i = 0; i < n; i++) {
+            // Monitor lines end with CR LF and SLCAN lines with CR
+            if (buf[i] == '\r') {
+                self->monitor.dropped++;
+            }
+        }
+        return 0;
+    }
+
+    uint32_t written = tud_cdc_n_write(itf, buf, n);
+    tud_task();
+    tud_cdc_n_write_flush(itf);
+    if (written < n) {
+        // The rest is kept for when the host has taken some more
+        self->monitor.stalls++;
+        memmove(buf, buf + written, n - written);
+    }
+    self->monitor.bytes += written;
+
+    return n - written;
+}
+
+// Sleep until the controller or the USB interrupts (or the deadline), handling any keyboard interrupt even if
+// the bus is busy. Returns false once the deadline is reached.
+STATIC bool rp2_can_monitor_wait(rp2_can_obj_t *self, absolute_time_t until)
+{
+    mp_handle_pending(true);
+    if (time_reached(until)) {
+        return false;
+    }
+    if (rp2_can_rx_pending(self) == 0) {
+        best_effort_wfe_or_timeout(until);
+    }
+
+    return true;
+}
+
+// Returns (lines, bytes, dropped, stalls, overflows) for the last run of monitor() or slcan()
+STATIC mp_obj_t rp2_can_get_monitor_stats(mp_obj_t self_in)
+{
+    rp2_can_obj_t *self = self_in;
+    mp_obj_t tuple[5];
+
+    tuple[0] = mp_obj_new_int_from_uint(self->monitor.lines);
+    tuple[1] = mp_obj_new_int_from_uint(self->monitor.bytes);
+    tuple[2] = mp_obj_new_int_from_uint(self->monitor.dropped);
+    tuple[3] = mp_obj_new_int_from_uint(self->monitor.stalls);
+    tuple[4] = mp_obj_new_int_from_uint(self->monitor.overflows);
+
+    return mp_obj_new_tuple(5, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_can_get_monitor_stats_obj, rp2_can_get_monitor_stats);
+
+// Stream received frames as text lines to the REPL's USB CDC port (candump log style, or Vector ASC style with
+// MONITOR_ASC) until the duration is up or there is a keyboard interrupt. Frames are taken straight from the
+// receive FIFO and formatted into a line buffer without creating any Python objects, and the buffer is written
+// to the USB in chunks as big as it will take. If the host does not keep up then lines are dropped rather than
+// letting the receive FIFO overflow. The same software filters and policies as recv() apply, and frames on a
+// priority lane are left for recv(lane=...). Returns (lines, bytes, dropped, stalls, overflows), also kept for
+// get_monitor_stats() in case the monitor is stopped with a keyboard interrupt.
+STATIC mp_obj_t rp2_can_monitor(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_style,         MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = CANMON_CANDUMP}},
+        {MP_QSTR_duration_ms,   MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = -1}},
+    };
+
+    rp2_can_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    uint32_t style = args[0].u_int;
+    if (style != CANMON_CANDUMP && style != CANMON_ASC) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Invalid monitor style"));
+    }
+    absolute_time_t until = rp2_can_wait_until(args[1].u_int);
+
+    char *buf = rp2_can_monitor_buf;
+    size_t n = 0;
+
+    memset(&self->monitor, 0, sizeof(self->monitor));
+    do {
+        n = rp2_can_monitor_fill(self, style, NULL, buf, n);
+        n = rp2_can_monitor_write(self, CAN_MONITOR_CDC_ITF, buf, n);
+    } while (rp2_can_monitor_wait(self, until));
+
+    return rp2_can_get_monitor_stats(self);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_monitor_obj, 1, rp2_can_monitor);
+
+// The SLCAN server needs the second USB CDC port, which tusb_config.h only declares
+// (CFG_TUD_CDC == 2) on boards that set MICROPY_HW_USB_CDC_SECOND; elsewhere
+// CAN.slcan() is not built
+#if CFG_TUD_CDC > 1
+// The second CDC port (shared with MIN, so the two cannot be used at once)
+#define CAN_SLCAN_CDC_ITF                   (1U)
+
+STATIC size_t rp2_can_slcan_reply(char *buf, size_t n, const char *reply)
+{
+    while (*reply) {
+        buf[n++] = *reply++;
+    }
+
+    return n;
+}
+
+// Carry out a command from the host, putting the reply into the line buffer
+STATIC size_t rp2_can_slcan_command(rp2_can_obj_t *self, canslcan_t *slcan, uint32_t command, canslcan_cmd_t *cmd, char *buf, size_t n)
+{
+    switch (command) {
+        case CANSLCAN_OK:
+            return rp2_can_slcan_reply(buf, n, "\r");
+        case CANSLCAN_BITRATE:
+            // The bit rate is set up when the CAN instance is created so only that rate is accepted (any rate is
+            // accepted if the controller has custom bit timings)
+            return rp2_can_slcan_reply(buf, n, self->bitrate == 0 || self->bitrate == cmd->bitrate ? "\r" : "\a");
+        case CANSLCAN_SEND: {
+            can_frame_t frame;
+            can_make_frame(&frame, cmd->ide, cmd->arbitration_id, cmd->dlc, cmd->data, cmd->remote);
+            if (rp2_can_send_frame_copy(self, &frame, 0, true, NULL) != CAN_ERC_NO_ERROR) {
+                slcan->flags |= CANSLCAN_FLAG_TX_FULL;
+                return rp2_can_slcan_reply(buf, n, "\a");
+            }
+            return rp2_can_slcan_reply(buf, n, cmd->ide ? "Z\r" : "z\r");
+        }
+        case CANSLCAN_STATUS: {
+            can_status_t status = rp2_can_read_status(self);
+            uint8_t flags = 0;
+            if (can_status_is_error_warn(status)) {
+                flags |= CANSLCAN_FLAG_ERROR_WARNING;
+            }
+            if (can_status_is_error_passive(status)) {
+                flags |= CANSLCAN_FLAG_ERROR_PASSIVE;
+            }
+            if (can_status_is_bus_off(status)) {
+                flags |= CANSLCAN_FLAG_BUS_ERROR;
+            }
+            return n + canslcan_status(slcan, buf + n, flags);
+        }
+        case CANSLCAN_VERSION:
+            return rp2_can_slcan_reply(buf, n, "V1013\r");
+        case CANSLCAN_SERIAL:
+            return rp2_can_slcan_reply(buf, n, "NCP00\r");
+        default:
+            return rp2_can_slcan_reply(buf, n, "\a");
+    }
+}
+
+// Run an SLCAN (Lawicel) server on the second USB CDC port until the duration is up or there is a keyboard
+// interrupt (see canslcan.h), so that host tools such as slcand and python-can can use the CAN instance. The bit
+// rate, ID filters and mode are those of the CAN instance: the S command only accepts its bit rate, and L stops
+// the host from sending rather than changing the mode. Received frames are sent to the host as for monitor(),
+// batched into as few USB packets as possible, with lines dropped (and the data overrun flag raised) if the
+// host falls behind. MIN cannot be used while the server runs. Returns the same statistics as monitor().
+STATIC mp_obj_t rp2_can_slcan(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_duration_ms,   MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = -1}},
+    };
+
+    rp2_can_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    absolute_time_t until = rp2_can_wait_until(args[0].u_int);
+    char *buf = rp2_can_monitor_buf;
+    size_t n = 0;
+    canslcan_t slcan;
+    canslcan_cmd_t cmd;
+
+    canslcan_init(&slcan);
+    memset(&self->monitor, 0, sizeof(self->monitor));
+    do {
+        // Commands are only taken while there is room for the reply
+        while (n + CANSLCAN_REPLY_MAX <= CAN_MONITOR_BUF_SIZE && tud_cdc_n_available(CAN_SLCAN_CDC_ITF)) {
+            int32_t c = tud_cdc_n_read_char(CAN_SLCAN_CDC_ITF);
+            if (c < 0) {
+                break;
+            }
+            uint32_t command = canslcan_put(&slcan, (char)c, &cmd);
+            if (command != CANSLCAN_NONE) {
+                n = rp2_can_slcan_command(self, &slcan, command, &cmd, buf, n);
+            }
+        }
+
+        uint32_t overflows = self->monitor.overflows;
+        n = rp2_can_monitor_fill(self, CANMON_CANDUMP, &slcan, buf, n);
+        if (self->monitor.overflows != overflows) {
+            slcan.flags |= CANSLCAN_FLAG_DATA_OVERRUN;
+        }
+        n = rp2_can_monitor_write(self, CAN_SLCAN_CDC_ITF, buf, n);
+    } while (rp2_can_monitor_wait(self, until));
+
+    return rp2_can_get_monitor_stats(self);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_slcan_obj, 1, rp2_can_slcan);
+#endif
+
+// Set up a priority receive lane (1 to CAN_RX_LANES - 1) with its own FIFO of the given size (a power of
+// two), filled from the receive ISR with frames let through by the given ID filter indexes. These frames are
+// then returned by recv(lane=lane) rather than by recv(). A size of 0 turns the lane off.
+STATIC mp_obj_t rp2_can_set_rx_lane(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_lane,          MP_ARG_REQUIRED | MP_ARG_INT, {.u_int = 1}},
+        {MP_QSTR_filters,       MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_empty_tuple}},
+        {MP_QSTR_size,          MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 32}},
+    };
+
+    rp2_can_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_int_t lane = args[0].u_int;
+    mp_int_t size = args[2].u_int;
+
+    if (lane < 1 || lane >= (mp_int_t)CAN_RX_LANES) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Lane must be 1 to %d", (int)CAN_RX_LANES - 1));
+    }
+    if (size < 0 || size > (mp_int_t)CAN_RX_LANE_MAX_SIZE) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Size must be 0 to %d", (int)CAN_RX_LANE_MAX_SIZE));
+    }
+    // The ring indexes are free-running counters, so the size must divide 2^32
+    if ((size & (size - 1)) != 0) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Size must be a power of two"));
+    }
+
+    uint32_t filters = 0;
+    size_t len;
+    mp_obj_t *elems;
+    mp_obj_get_array(args[1].u_obj, &len, &elems);
+    for (size_t i = 0; i < len; i++) {
+        mp_int_t idx = mp_obj_get_int(elems[i]);
+        if (idx < 0 || idx >= CAN_MAX_ID_FILTERS) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Filter index must be 0 to %d", CAN_MAX_ID_FILTERS - 1));
+        }
+        filters |= 1U << idx;
+    }
+    if (size == 0) {
+        filters = 0;
+    }
+    for (uint32_t i = 0; i < CAN_RX_LANES - 1U; i++) {
+        if (i != (uint32_t)lane - 1U && (self->rx_lanes[i].filters & filters) != 0) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Filter already assigned to lane %d", (int)i + 1));
+        }
+    }
+
+    can_rx_lane_t new_lane;
+    memset(&new_lane, 0, sizeof(new_lane));
+    if (size > 0) {
+        new_lane.entries = m_new(can_rx_lane_entry_t, size);
+        new_lane.size = size;
+        new_lane.filters = filters;
+    }
+
+    uint32_t state = save_and_disable_interrupts();
+    self->rx_lanes[lane - 1] = new_lane;
+    self->lane_filters = 0;
+    for (uint32_t i = 0; i < CAN_MAX_ID_FILTERS; i++) {
+        self->filter_lane[i] = 0;
+        for (uint32_t j = 0; j < CAN_RX_LANES - 1U; j++) {
+            if (self->rx_lanes[j].filters & (1U << i)) {
+                self->filter_lane[i] = j + 1U;
+                self->lane_filters |= 1U << i;
+                break;
+            }
+        }
+    }
+    restore_interrupts(state);
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_set_rx_lane_obj, 1, rp2_can_set_rx_lane);
+
+// Return a tuple of (pending, received, overflows) for a priority receive lane
+STATIC mp_obj_t rp2_can_get_rx_lane_status(mp_obj_t self_in, mp_obj_t lane_in)
+{
+    rp2_can_obj_t *self = self_in;
+    mp_int_t lane = mp_obj_get_int(lane_in);
+
+    if (lane < 1 || lane >= (mp_int_t)CAN_RX_LANES) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Lane must be 1 to %d", (int)CAN_RX_LANES - 1));
+    }
+    can_rx_lane_t *l = &self->rx_lanes[lane - 1];
+
+    uint32_t state = save_and_disable_interrupts();
+    uint32_t pending = l->head - l->tail;
+    uint32_t received = l->received;
+    uint32_t overflows = l->overflows;
+    restore_interrupts(state);
+
+    mp_obj_tuple_t *tuple = mp_obj_new_tuple(3U, NULL);
+    tuple->items[0] = mp_obj_new_int_from_uint(pending);
+    tuple->items[1] = mp_obj_new_int_from_uint(received);
+    tuple->items[2] = mp_obj_new_int_from_uint(overflows);
+
+    return tuple;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(rp2_can_get_rx_lane_status_obj, rp2_can_get_rx_lane_status);
+
+// Direct access to MCP25xxFD registers for changes the driver does not support while on-bus. The caller must
+// have disabled the controller's GPIO interrupt so that the ISR does not use the SPI bus at the same time.
+STATIC void rp2_can_spi_write_reg(can_interface_t *spi, uint32_t addr, uint32_t word, size_t len)
+{
+    uint8_t cmd[6];
+
+    cmd[0] = MCP25XXFD_SPI_WRITE | ((addr >> 8U) & 0xfU);
+    cmd[1] = addr & 0xffU;
+    // Registers are little-endian
+    cmd[2] = word & 0xffU;
+    cmd[3] = (word >> 8) & 0xffU;
+    cmd[4] = (word >> 16) & 0xffU;
+    cmd[5] = (word >> 24) & 0xffU;
+
+    uint32_t start = PERF_START();
+    mcp25xxfd_spi_select(spi);
+    mcp25xxfd_spi_write(spi, cmd, 2U + len);
+    mcp25xxfd_spi_deselect(spi);
+    PERF_END(CANPERF_CAN_SPI, start);
+}
+
+STATIC uint8_t rp2_can_spi_read_reg_byte(can_interface_t *spi, uint32_t addr)
+{
+    uint8_t cmd[3];
+    uint8_t resp[3];
+
+    cmd[0] = MCP25XXFD_SPI_READ | ((addr >> 8U) & 0xfU);
+    cmd[1] = addr & 0xffU;
+    cmd[2] = 0;
+
+    uint32_t start = PERF_START();
+    mcp25xxfd_spi_select(spi);
+    mcp25xxfd_spi_read_write(spi, cmd, resp, sizeof(cmd));
+    mcp25xxfd_spi_deselect(spi);
+    PERF_END(CANPERF_CAN_SPI, start);
+
+    return resp[2];
+}
+
+// Rewrites one filter. The filter object and mask can only be changed while the filter is disabled, so
+// a frame arriving during the change that only this filter would accept is lost. The other filters are
+// untouched and the controller stays on the bus. The FIFO that the filter points to is left as set by
+// the driver.
+STATIC void rp2_can_write_id_filter(can_interface_t *spi, uint32_t idx, can_id_filter_t *filter, bool enable)
+{
+    uint8_t fltcon = rp2_can_spi_read_reg_byte(spi, MCP25XXFD_C1FLTCON(idx));
+    fltcon &= ~MCP25XXFD_FLTCON_FLTEN;
+    rp2_can_spi_write_reg(spi, MCP25XXFD_C1FLTCON(idx), fltcon, 1U);
+
+    if (!enable) {
+        return;
+    }
+
+    uint32_t fltobj = 0;
+    uint32_t mask = 0;
+    if (!can_id_filter_is_all(filter)) {
+        uint32_t id_match = can_id_filter_get_match(filter);
+        uint32_t id_mask = can_id_filter_get_mask(filter);
+        if (can_id_filter_is_extended(filter)) {
+            // Top 11 bits of an extended ID are in SID, the bottom 18 bits are in EID
+            fltobj = ((id_match >> 18) & 0x7ffU) | ((id_match & 0x3ffffU) << 11) | MCP25XXFD_FLT_EXIDE;
+            mask = ((id_mask >> 18) & 0x7ffU) | ((id_mask & 0x3ffffU) << 11) | MCP25XXFD_FLT_EXIDE;
+        }
+        else {
+            fltobj = id_match & 0x7ffU;
+            mask = (id_mask & 0x7ffU) | MCP25XXFD_FLT_EXIDE;
+        }
+    }
+    rp2_can_spi_write_reg(spi, MCP25XXFD_C1FLTOBJ(idx), fltobj, 4U);
+    rp2_can_spi_write_reg(spi, MCP25XXFD_C1MASK(idx), mask, 4U);
+    rp2_can_spi_write_reg(spi, MCP25XXFD_C1FLTCON(idx), fltcon | MCP25XXFD_FLTCON_FLTEN, 1U);
+}
+
+// Change the ID filters without taking the controller off the bus (constructing CAN() again goes through
+// configuration mode and loses frames). Takes a dict of CANIDFilter instances as for the id_filters parameter
+// of CAN(). Only the filters that have changed are written. Returns the number of filters written.
+STATIC mp_obj_t rp2_can_set_filters(mp_obj_t self_in, mp_obj_t id_filters_in)
+{
+    rp2_can_obj_t *self = self_in;
+    can_controller_t *controller = &self->controller;
+    can_interface_t *spi = &controller->host_interface;
+
+    can_id_filter_t filters[CAN_MAX_ID_FILTERS];
+    uint32_t enabled = 0;
+    if (id_filters_in == mp_const_none) {
+        // None sets a single filter that accepts all frames
+        can_make_id_filter_all(&filters[0]);
+        enabled = 1U;
+        for (uint32_t idx = 1U; idx < CAN_MAX_ID_FILTERS; idx++) {
+            can_make_id_filter_disabled(&filters[idx]);
+        }
+    }
+    else {
+        enabled = rp2_can_get_id_filters(id_filters_in, filters);
+    }
+
+    uint32_t written = 0;
+    uint32_t locked = rp2_can_spi_lock();
+    for (uint32_t idx = 0; idx < CAN_MAX_ID_FILTERS; idx++) {
+        bool enable = (enabled & (1U << idx)) != 0;
+        bool was_enabled = (self->id_filters_enabled & (1U << idx)) != 0;
+        bool changed = !self->id_filters_known || (enable != was_enabled) ||
+                       (enable && memcmp(&filters[idx], &self->id_filters[idx], sizeof(can_id_filter_t)) != 0);
+        if (changed) {
+            rp2_can_write_id_filter(spi, idx, &filters[idx], enable);
+            written++;
+        }
+    }
+    rp2_can_spi_unlock(locked);
+
+    memcpy(self->id_filters, filters, sizeof(filters));
+    self->id_filters_enabled = enabled;
+    self->id_filters_known = true;
+
+    return MP_OBJ_NEW_SMALL_INT(written);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(rp2_can_set_filters_obj, rp2_can_set_filters);
+
+// Set the IDs accepted in software. The hardware ID filters are limited in number so a long list of IDs
+// is usually compiled into filters that let in other IDs too (see CANIDFilter.compile()). Frames with IDs not
+// in this list are dropped by recv() and are not passed to the receive callback. Each item is an integer, a
+// CANID or a (lo, hi) tuple for an inclusive range. Passing None accepts all frames.
+STATIC mp_obj_t rp2_can_set_accept_ids(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_ids,           MP_ARG_OBJ, {.u_obj = mp_const_none}},
+        {MP_QSTR_extended,      MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
+    };
+
+    rp2_can_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_obj_t ids = args[0].u_obj;
+    bool extended_default = args[1].u_bool;
+
+    can_accept_t accept;
+    accept.enabled = false;
+    accept.n_ranges = 0;
+    accept.ids.keys = NULL;
+    accept.ids.mask = 0;
+
+    if (ids != mp_const_none) {
+        size_t n_items;
+        mp_obj_t *items;
+        mp_obj_get_array(ids, &n_items, &items);
+
+        // First pass checks the items, stores the ranges and counts the single IDs
+        size_t n_ids = 0;
+        for (size_t i = 0; i < n_items; i++) {
+            bool extended;
+            uint32_t lo;
+            uint32_t hi;
+            rp2_can_get_id_range(items[i], extended_default, &extended, &lo, &hi);
+            if (lo == hi) {
+                n_ids++;
+            }
+            else {
+                if (accept.n_ranges >= CAN_ACCEPT_MAX_RANGES) {
+                    nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Too many ID ranges (max %d)", (int)CAN_ACCEPT_MAX_RANGES));
+                }
+                accept.range_lo[accept.n_ranges] = CANFILTER_IDSET_KEY(extended, lo);
+                accept.range_hi[accept.n_ranges] = CANFILTER_IDSET_KEY(extended, hi);
+                accept.n_ranges++;
+            }
+        }
+
+        // Second pass fills in the hash table (kept on the heap and reachable from this object)
+        size_t size = canfilter_idset_size(n_ids);
+        uint32_t *keys = m_new(uint32_t, size);
+        canfilter_idset_init(&accept.ids, keys, size);
+        for (size_t i = 0; i < n_items; i++) {
+            bool extended;
+            uint32_t lo;
+            uint32_t hi;
+            rp2_can_get_id_range(items[i], extended_default, &extended, &lo, &hi);
+            if (lo == hi) {
+                canfilter_idset_add(&accept.ids, CANFILTER_IDSET_KEY(extended, lo));
+            }
+        }
+        accept.enabled = true;
+    }
+
+    // Locked so that the ISR never sees a half-updated set
+    uint32_t state = save_and_disable_interrupts();
+    accept.rejected = self->accept.rejected;
+    self->accept = accept;
+    restore_interrupts(state);
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_set_accept_ids_obj, 1, rp2_can_set_accept_ids);
+
+// Return the number of frames dropped because their IDs were not in the set given to set_accept_ids()
+STATIC mp_obj_t rp2_can_get_accept_rejected(mp_obj_t self_in)
+{
+    rp2_can_obj_t *self = self_in;
+
+    return mp_obj_new_int_from_uint(self->accept.rejected);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_can_get_accept_rejected_obj, rp2_can_get_accept_rejected);
+
+// Collect per-ID statistics on received frames for up to max_ids IDs (0 turns statistics off). Calling it
+// again starts the statistics afresh.
+STATIC mp_obj_t rp2_can_set_stats(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_max_ids,       MP_ARG_INT, {.u_int = 0}},
+    };
+
+    rp2_can_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_int_t max_ids = args[0].u_int;
+    if (max_ids < 0 || max_ids > (mp_int_t)CAN_STATS_MAX_IDS) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "max_ids must be 0 to %d", (int)CAN_STATS_MAX_IDS));
+    }
+
+    canstats_t stats;
+    stats.entries = NULL;
+    if (max_ids > 0) {
+        size_t size = canstats_table_size(max_ids);
+        canstats_entry_t *entries = m_new(canstats_entry_t, size);
+        canstats_init(&stats, entries, size, max_ids);
+    }
+
+    uint32_t state = save_and_disable_interrupts();
+    self->stats = stats;
+    restore_interrupts(state);
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_set_stats_obj, 1, rp2_can_set_stats);
+
+// Return a snapshot of the per-ID statistics as bytes (see canstats.h for the layout), or None if statistics
+// are off. Each record is taken with interrupts locked so is consistent, but the records are not all from
+// the same instant.
+STATIC mp_obj_t rp2_can_get_stats(mp_obj_t self_in)
+{
+    rp2_can_obj_t *self = self_in;
+    canstats_t *stats = &self->stats;
+
+    if (stats->entries == NULL) {
+        return mp_const_none;
+    }
+
+    // IDs added after this are left for the next snapshot
+    uint32_t max_records = stats->n_ids;
+    vstr_t vstr;
+    vstr_init_len(&vstr, CANSTATS_HEADER_SIZE + max_records * CANSTATS_RECORD_SIZE);
+    uint8_t *buf = (uint8_t *)vstr.buf;
+
+    uint32_t n_records = 0;
+    for (size_t i = 0; i <= stats->mask && n_records < max_records; i++) {
+        uint32_t state = save_and_disable_interrupts();
+        size_t added = canstats_pack(stats, i, buf + CANSTATS_HEADER_SIZE + n_records * CANSTATS_RECORD_SIZE);
+        restore_interrupts(state);
+        if (added > 0) {
+            n_records++;
+        }
+    }
+    canstats_pack_header(n_records, stats->uncounted, stats->errors, buf);
+    vstr.len = CANSTATS_HEADER_SIZE + n_records * CANSTATS_RECORD_SIZE;
+
+    return mp_obj_new_bytes_from_vstr(&vstr);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_can_get_stats_obj, rp2_can_get_stats);
+
+// Gets a (kind, param) policy tuple
+STATIC void rp2_can_get_policy(mp_obj_t obj, uint8_t *kind, uint32_t *param)
+{
+    size_t len;
+    mp_obj_t *elems;
+    mp_obj_get_array(obj, &len, &elems);
+    if (len != 2U) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Policy must be (kind, param)"));
+    }
+    mp_int_t k = mp_obj_get_int(elems[0]);
+    mp_int_t p = mp_obj_get_int(elems[1]);
+    if (k != CANPOLICY_CHANGED && k != CANPOLICY_EVERY_NTH && k != CANPOLICY_INTERVAL) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Unknown policy"));
+    }
+    if (p < 0 || (k == CANPOLICY_EVERY_NTH && p < 1)) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Bad policy parameter"));
+    }
+    *kind = k;
+    *param = p;
+}
+
+// Set receive policies that suppress frames in recv(): ids is a dictionary of ID (an integer or CANID) to a
+// policy, and filters is a dictionary of ID filter index to a policy that applies to each ID let through by
+// that filter. A policy is a tuple of (kind, param): (CAN.POLICY_CHANGED, 0) delivers a frame only if its
+// payload has changed, (CAN.POLICY_EVERY_NTH, n) delivers every nth frame and (CAN.POLICY_INTERVAL, t) delivers
+// at most one frame every t microseconds. State is kept for up to max_ids IDs. Passing no policies turns off
+// the policies (frames passed to the receive callback are not affected).
+STATIC mp_obj_t rp2_can_set_rx_policy(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_ids,           MP_ARG_OBJ, {.u_obj = mp_const_none}},
+        {MP_QSTR_filters,       MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none}},
+        {MP_QSTR_max_ids,       MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 64}},
+        {MP_QSTR_extended,      MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
+    };
+
+    rp2_can_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_obj_t ids = args[0].u_obj;
+    mp_obj_t filters = args[1].u_obj;
+    mp_int_t max_ids = args[2].u_int;
+    bool extended_default = args[3].u_bool;
+
+    canpolicy_t policy;
+    policy.entries = NULL;
+
+    if (ids != mp_const_none || filters != mp_const_none) {
+        if (ids != mp_const_none && !MP_OBJ_IS_TYPE(ids, &mp_type_dict)) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_TypeError, "ids must be a dict"));
+        }
+        if (filters != mp_const_none && !MP_OBJ_IS_TYPE(filters, &mp_type_dict)) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_TypeError, "filters must be a dict"));
+        }
+        if (max_ids < 1 || max_ids > (mp_int_t)CAN_POLICY_MAX_IDS) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "max_ids must be 1 to %d", (int)CAN_POLICY_MAX_IDS));
+        }
+        size_t size = canfilter_idset_size(max_ids);
+        canpolicy_entry_t *entries = m_new(canpolicy_entry_t, size);
+        canpolicy_init(&policy, entries, size, max_ids);
+
+        if (ids != mp_const_none) {
+            mp_map_t *map = mp_obj_dict_get_map(ids);
+            for (size_t i = 0; i < map->alloc; i++) {
+                if (mp_map_slot_is_filled(map, i)) {
+                    bool extended;
+                    uint32_t lo;
+                    uint32_t hi;
+                    rp2_can_get_id_range(map->table[i].key, extended_default, &extended, &lo, &hi);
+                    if (lo != hi) {
+                        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Policies are for single IDs"));
+                    }
+                    uint8_t kind;
+                    uint32_t param;
+                    rp2_can_get_policy(map->table[i].value, &kind, &param);
+                    if (!canpolicy_set_id(&policy, CANFILTER_IDSET_KEY(extended, lo), kind, param)) {
+                        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "More IDs than max_ids"));
+                    }
+                }
+            }
+        }
+        if (filters != mp_const_none) {
+            mp_map_t *map = mp_obj_dict_get_map(filters);
+            for (size_t i = 0; i < map->alloc; i++) {
+                if (mp_map_slot_is_filled(map, i)) {
+                    mp_int_t idx = mp_obj_get_int(map->table[i].key);
+                    if (idx < 0 || idx >= CAN_MAX_ID_FILTERS) {
+                        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Filter index must be 0 to %d", CAN_MAX_ID_FILTERS - 1));
+                    }
+                    uint8_t kind;
+                    uint32_t param;
+                    rp2_can_get_policy(map->table[i].value, &kind, &param);
+                    canpolicy_set_filter(&policy, idx, kind, param);
+                }
+            }
+        }
+    }
+
+    // Only recv() uses the policies, so there is no need to lock out interrupts
+    self->policy = policy;
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_set_rx_policy_obj, 1, rp2_can_set_rx_policy);
+
+// Return a tuple of (suppressed, untracked, ids): the total number of frames suppressed, the number of frames
+// delivered because there was no room to track their IDs, and a list of (CANID, delivered, suppressed) for each
+// ID with a policy
+STATIC mp_obj_t rp2_can_get_rx_policy_stats(mp_obj_t self_in)
+{
+    rp2_can_obj_t *self = self_in;
+    canpolicy_t *policy = &self->policy;
+
+    if (policy->entries == NULL) {
+        return mp_const_none;
+    }
+
+    mp_obj_list_t *list = mp_obj_new_list(policy->n_ids, NULL);
+    size_t n = 0;
+    for (size_t i = 0; i <= policy->mask && n < policy->n_ids; i++) {
+        canpolicy_entry_t *e = &policy->entries[i];
+        if (e->key != CANFILTER_IDSET_EMPTY) {
+            rp2_canid_obj_t *canid = m_new_obj(rp2_canid_obj_t);
+            canid->base.type = &rp2_canid_type;
+            canid->extended = (e->key & 0x80000000U) != 0;
+            canid->arbitration_id = e->key & 0x1fffffffU;
+            mp_obj_tuple_t *tuple = mp_obj_new_tuple(3U, NULL);
+            tuple->items[0] = canid;
+            tuple->items[1] = mp_obj_new_int_from_uint(e->delivered);
+            tuple->items[2] = mp_obj_new_int_from_uint(e->suppressed);
+            list->items[n++] = tuple;
+        }
+    }
+
+    mp_obj_tuple_t *result = mp_obj_new_tuple(3U, NULL);
+    result->items[0] = mp_obj_new_int_from_uint(policy->suppressed);
+    result->items[1] = mp_obj_new_int_from_uint(policy->untracked);
+    result->items[2] = list;
+
+    return result;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_can_get_rx_policy_stats_obj, rp2_can_get_rx_policy_stats);
+
+// Keep the newest frame of each of a list of IDs (integers or CANIDs) in a latest-value mailbox, one slot per
+// ID in the order given (see canmailbox.h for the record layout). The mailboxes are updated for every frame let
+// through by the hardware filters, independently of the receive FIFO. Passing no IDs turns the mailboxes off.
+STATIC mp_obj_t rp2_can_set_mailbox(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_ids,           MP_ARG_OBJ, {.u_obj = mp_const_none}},
+        {MP_QSTR_extended,      MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
+    };
+
+    rp2_can_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_obj_t ids = args[0].u_obj;
+    bool extended_default = args[1].u_bool;
+
+    canmailbox_t mailbox;
+    mailbox.records = NULL;
+    mailbox.n_slots = 0;
+
+    if (ids != mp_const_none) {
+        size_t len;
+        mp_obj_t *elems;
+        mp_obj_get_array(ids, &len, &elems);
+        if (len < 1U || len > CAN_MAILBOX_MAX_SLOTS) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Must be 1 to %d IDs", (int)CAN_MAILBOX_MAX_SLOTS));
+        }
+        size_t size = canfilter_idset_size(len);
+        uint8_t *records = m_new(uint8_t, len * CANMAILBOX_RECORD_SIZE);
+        canmailbox_entry_t *entries = m_new(canmailbox_entry_t, size);
+        canmailbox_init(&mailbox, records, entries, size);
+        for (size_t i = 0; i < len; i++) {
+            bool extended;
+            uint32_t lo;
+            uint32_t hi;
+            rp2_can_get_id_range(elems[i], extended_default, &extended, &lo, &hi);
+            if (lo != hi) {
+                nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Mailboxes are for single IDs"));
+            }
+            if (!canmailbox_add(&mailbox, CANFILTER_IDSET_KEY(extended, lo))) {
+                nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Duplicate ID"));
+            }
+        }
+    }
+
+    uint32_t state = save_and_disable_interrupts();
+    self->mailbox = mailbox;
+    restore_interrupts(state);
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_set_mailbox_obj, 1, rp2_can_set_mailbox);
+
+// Read the mailboxes: with a slot number, return a consistent copy of that slot's record as bytes; with no
+// slot number, return a memoryview of all the records, updated in place by the ISR (see canmailbox.h for
+// how to read a record consistently). Returns None if the mailboxes are off.
+STATIC mp_obj_t rp2_can_get_mailbox(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_slot,          MP_ARG_OBJ, {.u_obj = mp_const_none}},
+    };
+
+    rp2_can_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    canmailbox_t *mailbox = &self->mailbox;
+
+    if (mailbox->records == NULL) {
+        return mp_const_none;
+    }
+    if (args[0].u_obj == mp_const_none) {
+        return mp_obj_new_memoryview('B', mailbox->n_slots * CANMAILBOX_RECORD_SIZE, mailbox->records);
+    }
+
+    mp_int_t slot = mp_obj_get_int(args[0].u_obj);
+    if (slot < 0 || slot >= (mp_int_t)mailbox->n_slots) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_IndexError, "Slot must be 0 to %d", (int)mailbox->n_slots - 1));
+    }
+    vstr_t vstr;
+    vstr_init_len(&vstr, CANMAILBOX_RECORD_SIZE);
+    uint32_t state = save_and_disable_interrupts();
+    memcpy(vstr.buf, mailbox->records + slot * CANMAILBOX_RECORD_SIZE, CANMAILBOX_RECORD_SIZE);
+    restore_interrupts(state);
+
+    return mp_obj_new_bytes_from_vstr(&vstr);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_get_mailbox_obj, 1, rp2_can_get_mailbox);
+
+// Answer remote frames from the receive ISR. Each of a list of CANFrame data frames is the response to a
+// remote frame with the same ID, queued in the priority transmit queue as soon as the remote frame is
+// received. Remote frames must not be rejected (see reject_remote). Passing no frames turns the responder off.
+STATIC mp_obj_t rp2_can_set_rtr_responder(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_frames,        MP_ARG_OBJ, {.u_obj = mp_const_none}},
+    };
+
+    rp2_can_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_obj_t frames = args[0].u_obj;
+
+    canresponder_t responder;
+    responder.entries = NULL;
+    responder.n_ids = 0;
+    responder.responses = 0;
+    responder.misses = 0;
+
+    if (frames != mp_const_none) {
+        size_t len;
+        mp_obj_t *elems;
+        mp_obj_get_array(frames, &len, &elems);
+        if (len < 1U || len > CAN_RESPONDER_MAX_IDS) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Must be 1 to %d frames", (int)CAN_RESPONDER_MAX_IDS));
+        }
+        size_t size = canfilter_idset_size(len);
+        canresponder_entry_t *entries = m_new(canresponder_entry_t, size);
+        canresponder_init(&responder, entries, size);
+        for (size_t i = 0; i < len; i++) {
+            if (!MP_OBJ_IS_TYPE(elems[i], &rp2_canframe_type)) {
+                nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_TypeError, "Responses must be of type CANFrame"));
+            }
+            rp2_can_check_classic(elems[i]);
+            can_frame_t *frame = &((rp2_canframe_obj_t *)elems[i])->frame;
+            if (can_frame_is_remote(frame)) {
+                nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Responses must be data frames"));
+            }
+            uint32_t key = CANFILTER_IDSET_KEY(can_frame_is_extended(frame), can_frame_get_arbitration_id(frame));
+            if (canresponder_add(&responder, key, can_frame_get_dlc(frame), can_frame_get_data(frame)) == NULL) {
+                nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Duplicate ID"));
+            }
+        }
+    }
+
+    uint32_t state = save_and_disable_interrupts();
+    self->responder = responder;
+    self->n_responder_pending = 0;
+    restore_interrupts(state);
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_set_rtr_responder_obj, 1, rp2_can_set_rtr_responder);
+
+// Change the payload (and DLC) of the response for an ID (an integer or CANID) so that remote frames are
+// answered with the latest value
+STATIC mp_obj_t rp2_can_set_rtr_response(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_canid,         MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = mp_const_none}},
+        {MP_QSTR_data,          MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = mp_const_none}},
+        {MP_QSTR_extended,      MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
+    };
+
+    rp2_can_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    bool extended;
+    uint32_t lo;
+    uint32_t hi;
+    rp2_can_get_id_range(args[0].u_obj, args[2].u_bool, &extended, &lo, &hi);
+    if (lo != hi) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Responses are for single IDs"));
+    }
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[1].u_obj, &bufinfo, MP_BUFFER_READ);
+    if (bufinfo.len > 8U) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Data must be 0 to 8 bytes"));
+    }
+
+    if (self->responder.entries == NULL) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Responder not set"));
+    }
+    canresponder_entry_t *e = canresponder_find(&self->responder, CANFILTER_IDSET_KEY(extended, lo));
+    if (e == NULL) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "No response for ID"));
+    }
+    uint32_t state = save_and_disable_interrupts();
+    canresponder_set_data(e, (uint8_t)bufinfo.len, bufinfo.buf);
+    restore_interrupts(state);
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_set_rtr_response_obj, 3, rp2_can_set_rtr_response);
+
+// Returns (responses, misses): responses queued and remote frames not answered because the transmit queue was full
+STATIC mp_obj_t rp2_can_get_rtr_responder_stats(mp_obj_t self_in)
+{
+    rp2_can_obj_t *self = self_in;
+    mp_obj_t tuple[2];
+
+    tuple[0] = mp_obj_new_int_from_uint(self->responder.responses);
+    tuple[1] = mp_obj_new_int_from_uint(self->responder.misses);
+
+    return mp_obj_new_tuple(2, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_can_get_rtr_responder_stats_obj, rp2_can_get_rtr_responder_stats);
+
+// Write out a full log block. A failed write stops logging (the error is returned by get_log_stats()) and
+// the records of the blocks after that are counted as dropped.
+STATIC void rp2_can_log_write(can_logger_t *logger, uint32_t b)
+{
+    canlog_t *log = logger->log;
+    uint8_t *block = log->blocks[b];
+
+    if (logger->error == 0) {
+        int errcode = 0;
+        mp_uint_t n = mp_stream_rw(logger->file, block, CANLOG_BLOCK_SIZE, &errcode, MP_STREAM_RW_WRITE);
+        if (n == CANLOG_BLOCK_SIZE) {
+            logger->blocks++;
+        }
+        else {
+            logger->error = errcode != 0 ? errcode : MP_ENOSPC;
+        }
+    }
+    uint32_t state = save_and_disable_interrupts();
+    if (logger->error != 0) {
+        log->total_dropped += ((uint32_t)block[24] << 8) | block[25];
+    }
+    log->full[b] = false;
+    restore_interrupts(state);
+}
+
+// Write out the full log blocks, oldest first (the block not being filled is always the older one)
+STATIC void rp2_can_log_write_full(can_logger_t *logger)
+{
+    canlog_t *log = logger->log;
+
+    for (;;) {
+        uint32_t state = save_and_disable_interrupts();
+        uint32_t b = log->current ^ 1U;
+        bool full = log->full[b];
+        restore_interrupts(state);
+        if (!full) {
+            return;
+        }
+        rp2_can_log_write(logger, b);
+    }
+}
+
+// Scheduled by the ISR when a block is full so that the file is written from the main thread
+STATIC mp_obj_t rp2_can_log_flush(mp_obj_t self_in)
+{
+    rp2_can_obj_t *self = self_in;
+
+    self->logger.flush_scheduled = false;
+    if (self->logger.log != NULL) {
+        rp2_can_log_write_full(&self->logger);
+    }
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_can_log_flush_obj, rp2_can_log_flush);
+
+// Called from the ISR after logging to schedule the writing of a block once one is full
+STATIC void TIME_CRITICAL rp2_can_log_schedule(rp2_can_obj_t *self)
+{
+    canlog_t *log = self->logger.log;
+
+    if ((log->full[0] || log->full[1]) && !self->logger.flush_scheduled) {
+        self->logger.flush_scheduled = mp_sched_schedule(MP_OBJ_FROM_PTR(&rp2_can_log_flush_obj), self);
+    }
+}
+
+// Log a frame from the ISR
+STATIC void TIME_CRITICAL rp2_can_log_frame(rp2_can_obj_t *self, uint32_t event, can_frame_t *frame, uint64_t timestamp)
+{
+    uint32_t arbitration_id = can_frame_get_arbitration_id(frame);
+    uint32_t id_word = can_frame_is_extended(frame) ? ((1U << 29) | arbitration_id) : (arbitration_id << 18);
+
+    canlog_frame(self->logger.log, event, id_word, can_frame_is_remote(frame), can_frame_get_dlc(frame), can_frame_get_data(frame), timestamp);
+    rp2_can_log_schedule(self);
+}
+
+// Finish the block being filled of a log that the ISR has been detached from and write out all of it
+STATIC void rp2_can_log_finish(can_logger_t *logger)
+{
+    rp2_can_log_write_full(logger);
+    canlog_close_block(logger->log);
+    rp2_can_log_write_full(logger);
+}
+
+// Log received frames (and transmitted frames and CAN errors unless turned off) to a file opened for writing in
+// binary mode, in flash-sector-sized blocks (see canlog.h for the format). The ISR fills one block while the
+// other is written to the file from the main thread, so the file is only written between Python bytecodes.
+// Calling this again finishes off the current file and moves on to a new one (the caller closes the old file),
+// raising OSError if a write to the old file failed. Passing None stops logging.
+//
+// Writing to flash stops the RP2040 with interrupts disabled while a sector is erased (tens of milliseconds),
+// and the controller's receive FIFO only holds a few milliseconds of a busy bus, so frames are lost while the file
+// is written. They show up as receive overflows, not as dropped log records.
+STATIC mp_obj_t rp2_can_set_log_file(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_file,          MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = mp_const_none}},
+        {MP_QSTR_tx,            MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = true}},
+        {MP_QSTR_errors,        MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = true}},
+    };
+
+    rp2_can_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_obj_t file = args[0].u_obj;
+    can_logger_t *logger = &self->logger;
+
+    if (file != mp_const_none) {
+        mp_get_stream_raise(file, MP_STREAM_OP_WRITE);
+    }
+
+    // The new file gets its own blocks (the spare ones left by the last file if there are any) so that the
+    // ISR can go straight on logging while the old file is finished off
+    canlog_t *log = NULL;
+    if (file != mp_const_none) {
+        log = logger->spare;
+        if (log == NULL) {
+            log = m_new_obj(canlog_t);
+            uint8_t *blocks = m_new(uint8_t, 2U * CANLOG_BLOCK_SIZE);
+            log->blocks[0] = blocks;
+            log->blocks[1] = blocks + CANLOG_BLOCK_SIZE;
+        }
+        logger->spare = NULL;
+        canlog_init(log, log->blocks[0], log->blocks[1]);
+    }
+
+    // The old log is detached and the new one attached at the same time, so the ISR never logs to neither
+    uint32_t state = save_and_disable_interrupts();
+    can_logger_t old = *logger;
+    logger->log = log;
+    logger->file = file == mp_const_none ? MP_OBJ_NULL : file;
+    logger->tx = args[1].u_bool;
+    logger->errors = args[2].u_bool;
+    logger->blocks = 0;
+    logger->error = 0;
+    restore_interrupts(state);
+
+    // Everything logged so far goes to the old file
+    if (old.log != NULL) {
+        rp2_can_log_finish(&old);
+        if (log != NULL) {
+            logger->spare = old.log;
+        }
+        if (old.error != 0) {
+            mp_raise_OSError(old.error);
+        }
+    }
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_set_log_file_obj, 2, rp2_can_set_log_file);
+
+// Returns (records, dropped, blocks, error) for the current log file, where error is the error number of a
+// failed write (0 if none)
+STATIC mp_obj_t rp2_can_get_log_stats(mp_obj_t self_in)
+{
+    rp2_can_obj_t *self = self_in;
+    can_logger_t *logger = &self->logger;
+    mp_obj_t tuple[4];
+
+    if (logger->log == NULL) {
+        return mp_const_none;
+    }
+    tuple[0] = mp_obj_new_int_from_uint(logger->log->records);
+    tuple[1] = mp_obj_new_int_from_uint(logger->log->total_dropped);
+    tuple[2] = mp_obj_new_int_from_uint(logger->blocks);
+    tuple[3] = MP_OBJ_NEW_SMALL_INT(logger->error);
+
+    return mp_obj_new_tuple(4, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_can_get_log_stats_obj, rp2_can_get_log_stats);
+
+// Start measuring bus load over windows of the given number of microseconds (0 stops the meter). The bit
+// rate is taken from the bit rate profile unless given (it must be given if custom bit timings are used).
+STATIC mp_obj_t rp2_can_set_bus_load(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_window,        MP_ARG_INT, {.u_int = 100000}},
+        {MP_QSTR_bitrate,       MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0}},
+    };
+
+    rp2_can_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_int_t window = args[0].u_int;
+    mp_int_t bitrate = args[1].u_int > 0 ? args[1].u_int : (mp_int_t)self->bitrate;
+
+    if (window == 0) {
+        self->load.enabled = false;
+        return mp_const_none;
+    }
+    if (window < 1000 || window > 10000000) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Window must be 1000 to 10000000 microseconds"));
+    }
+    if (bitrate <= 0) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Bit rate not known"));
+    }
+
+    uint64_t now = rp2_can_sample_timebase(self);
+    uint32_t state = save_and_disable_interrupts();
+    canload_start(&self->load, bitrate, window, now);
+    restore_interrupts(state);
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_set_bus_load_obj, 1, rp2_can_set_bus_load);
+
+// Return a tuple of (load, peak, bits): the load of the last complete window and the peak window load since
+// the meter was started, both in hundredths of a percent, and the number of bits of bus time counted since then.
+// Returns None if the meter is not running.
+STATIC mp_obj_t rp2_can_get_bus_load(mp_obj_t self_in)
+{
+    rp2_can_obj_t *self = self_in;
+
+    if (!self->load.enabled) {
+        return mp_const_none;
+    }
 
-        mp_obj_list_t *list = mp_obj_new_list(limit, NULL);
+    uint64_t now = rp2_can_sample_timebase(self);
+    uint32_t state = save_and_disable_interrupts();
+    canload_advance(&self->load, now);
+    uint32_t last_load = self->load.last_load;
+    uint32_t peak_load = self->load.peak_load;
+    uint64_t total_bits = self->load.total_bits;
+    restore_interrupts(state);
 
-        // Pull frames from the FIFO up to a limit
-        for (uint32_t i = 0; i < limit; i++) {
-            can_rx_event_t event;
-            can_rx_event_t *ev = &event;
-            if (can_recv(controller, ev)) {
-                if (can_event_is_frame(ev)) {
-                    rp2_canframe_obj_t *mp_frame = m_new_obj(rp2_canframe_obj_t);
-                    mp_frame->base.type = &rp2_canframe_type;
-                    mp_frame->frame = *can_event_get_frame(ev); // Make a copy (ev is temporary)
-                    mp_frame->timestamp = can_event_get_timestamp(ev);
-                    mp_frame->timestamp_valid = true;
-                    list->items[i] = mp_frame;
-                }
-                else if (can_event_is_error(ev)) {
-                    rp2_canerror_obj_t *mp_error = m_new_obj(rp2_canerror_obj_t);
-                    mp_error->base.type = &rp2_canerror_type;
-                    mp_error->error = *can_event_get_error(ev); // Make a copy (ev is temporary)
-                    mp_error->timestamp = can_event_get_timestamp(ev);
-                    list->items[i] = mp_error;
-                }
-                else if (can_event_is_overflow(ev)) {
-                    rp2_canoverflow_obj_t *mp_overflow = m_new_obj(rp2_canoverflow_obj_t);
-                    mp_overflow->base.type = &rp2_canoverflow_type;
-                    mp_overflow->receive = true;
-                    mp_overflow->error_cnt = can_rx_overflow_get_error_cnt(&ev->event.overflow);
-                    mp_overflow->frame_cnt = can_rx_overflow_get_frame_cnt(&ev->event.overflow);
-                    mp_overflow->timestamp = can_event_get_timestamp(ev);
-                    list->items[i] = mp_overflow;
-                }
-                else {
-                    // Unknown event type, should never happen, but we set the list item
-                    // to none just in case
-                    list->items[i] = mp_const_none;
-                }
-            }
+    mp_obj_tuple_t *tuple = mp_obj_new_tuple(3U, NULL);
+    tuple->items[0] = MP_OBJ_NEW_SMALL_INT(last_load);
+    tuple->items[1] = MP_OBJ_NEW_SMALL_INT(peak_load);
+    tuple->items[2] = mp_obj_new_int_from_ull(total_bits);
+
+    return tuple;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_can_get_bus_load_obj, rp2_can_get_bus_load);
+
+// Return the loads of the most recent windows (oldest first) in hundredths of a percent
+STATIC mp_obj_t rp2_can_get_bus_load_history(mp_obj_t self_in)
+{
+    rp2_can_obj_t *self = self_in;
+    uint16_t history[CANLOAD_HISTORY_SIZE];
+    uint32_t n = 0;
+
+    if (self->load.enabled) {
+        uint64_t now = rp2_can_sample_timebase(self);
+        uint32_t state = save_and_disable_interrupts();
+        canload_advance(&self->load, now);
+        n = self->load.n_history;
+        uint32_t first = (self->load.history_next + CANLOAD_HISTORY_SIZE - n) % CANLOAD_HISTORY_SIZE;
+        for (uint32_t i = 0; i < n; i++) {
+            history[i] = self->load.history[(first + i) % CANLOAD_HISTORY_SIZE];
         }
-        return list;
+        restore_interrupts(state);
+    }
+
+    mp_obj_list_t *list = mp_obj_new_list(n, NULL);
+    for (uint32_t i = 0; i < n; i++) {
+        list->items[i] = MP_OBJ_NEW_SMALL_INT(history[i]);
     }
+
+    return list;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_recv_obj, 1, rp2_can_recv);
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_can_get_bus_load_history_obj, rp2_can_get_bus_load_history);
 
 #if _BullseyeCoverage
 // TODO allocate this on the heap?
@@ -455,6 +2745,7 @@ STATIC mp_obj_t rp2_can_recv_tx_events(mp_uint_t n_args, const mp_obj_t *pos_arg
     static const mp_arg_t allowed_args[] = {
             {MP_QSTR_limit,    MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = CAN_TX_EVENT_FIFO_SIZE}},
             {MP_QSTR_as_bytes, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
+            {MP_QSTR_latency,  MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
     };
 
     rp2_can_obj_t *self = pos_args[0];
@@ -464,6 +2755,7 @@ STATIC mp_obj_t rp2_can_recv_tx_events(mp_uint_t n_args, const mp_obj_t *pos_arg
 
     uint32_t limit = args[0].u_int;
     bool as_bytes = args[1].u_bool;
+    bool latency = args[2].u_bool;
 
     uint32_t num_events = can_recv_tx_events_pending(controller);
 
@@ -502,6 +2794,8 @@ STATIC mp_obj_t rp2_can_recv_tx_events(mp_uint_t n_args, const mp_obj_t *pos_arg
             
             bool recvd = can_recv_tx_event(controller, e);
             if (recvd) {
+                // Microseconds from the frame being queued to being sent (None for an overflow event)
+                mp_obj_t mp_latency = mp_const_none;
                 if (can_tx_event_is_frame(e)) {
                     // Return a reference to the instance of the transmitted frame (that should not have been garbage collected
                     // because the reference to it is in the controller structure).
@@ -509,7 +2803,25 @@ STATIC mp_obj_t rp2_can_recv_tx_events(mp_uint_t n_args, const mp_obj_t *pos_arg
                     // Frame transmitted, return the CANFrame instance (application can then dig out the tag etc.)
                     // The transmit ISR callback will have already run and put the timestamp into the CANFrame
                     // instance so no need to fill it in here.
-                    list->items[i] = (rp2_canframe_obj_t *)(can_tx_event_get_uref(e).ref);
+                    void *ref = can_tx_event_get_uref(e).ref;
+                    if (rp2_can_is_tx_slot(self, ref)) {
+                        // Frame was sent from a copy so there is no CANFrame: return (tag, timestamp), plus
+                        // the transmit time error (microseconds after the deadline) if the frame had a deadline
+                        can_tx_slot_t *slot = ref;
+                        mp_obj_tuple_t *tuple = mp_obj_new_tuple(slot->timed ? 3U : 2U, NULL);
+                        tuple->items[0] = mp_obj_new_int_from_uint(slot->tag);
+                        tuple->items[1] = mp_obj_new_int_from_ull(slot->timestamp);
+                        if (slot->timed) {
+                            tuple->items[2] = mp_obj_new_int((int32_t)((uint32_t)slot->timestamp - slot->deadline));
+                        }
+                        list->items[i] = tuple;
+                        mp_latency = mp_obj_new_int_from_uint(slot->latency);
+                    }
+                    else {
+                        rp2_canframe_obj_t *mp_frame = ref;
+                        list->items[i] = mp_frame;
+                        mp_latency = mp_obj_new_int_from_uint(mp_frame->latency);
+                    }
                 }
                 else {
                     // It's an overflow event, so return an CANOverflow instance
@@ -517,9 +2829,16 @@ STATIC mp_obj_t rp2_can_recv_tx_events(mp_uint_t n_args, const mp_obj_t *pos_arg
                     mp_overflow->base.type = &rp2_canoverflow_type;
                     mp_overflow->receive = false;
                     mp_overflow->frame_cnt = can_tx_event_get_overflow_cnt(e);
-                    mp_overflow->timestamp = can_tx_event_get_timestamp(e);
+                    mp_overflow->timestamp = rp2_can_extend_timestamp(self, can_tx_event_get_timestamp(e));
                     list->items[i] = mp_overflow;                    
                 }
+                if (latency) {
+                    // Return (event, latency) pairs
+                    mp_obj_tuple_t *pair = mp_obj_new_tuple(2U, NULL);
+                    pair->items[0] = list->items[i];
+                    pair->items[1] = mp_latency;
+                    list->items[i] = pair;
+                }
             }
             else {
                 break;
@@ -530,6 +2849,47 @@ STATIC mp_obj_t rp2_can_recv_tx_events(mp_uint_t n_args, const mp_obj_t *pos_arg
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_recv_tx_events_obj, 1, rp2_can_recv_tx_events);
 
+// Return a tuple of two tuples, for the priority queue and then the FIFO queue, each of (count, mean, max,
+// buckets): the number of frames sent, the mean and worst time in microseconds from being queued to being
+// sent, and a list of the histogram buckets (bucket 0 is under 2us, bucket n is 2^n to 2^(n+1)-1us, and the
+// last bucket holds everything longer). The histograms are cleared after reading if clear is True.
+STATIC mp_obj_t rp2_can_get_tx_latency(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_clear,    MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
+    };
+
+    rp2_can_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    can_latency_hist_t hists[2];
+    uint32_t state = save_and_disable_interrupts();
+    memcpy(hists, self->latency, sizeof(hists));
+    if (args[0].u_bool) {
+        memset(self->latency, 0, sizeof(self->latency));
+    }
+    restore_interrupts(state);
+
+    mp_obj_tuple_t *result = mp_obj_new_tuple(2U, NULL);
+    for (uint32_t q = 0; q < 2U; q++) {
+        can_latency_hist_t *hist = &hists[q];
+        mp_obj_list_t *buckets = mp_obj_new_list(CAN_LATENCY_BUCKETS, NULL);
+        for (uint32_t i = 0; i < CAN_LATENCY_BUCKETS; i++) {
+            buckets->items[i] = mp_obj_new_int_from_uint(hist->buckets[i]);
+        }
+        mp_obj_tuple_t *tuple = mp_obj_new_tuple(4U, NULL);
+        tuple->items[0] = mp_obj_new_int_from_uint(hist->count);
+        tuple->items[1] = mp_obj_new_int_from_uint(hist->count > 0 ? (uint32_t)(hist->sum / hist->count) : 0);
+        tuple->items[2] = mp_obj_new_int_from_uint(hist->max);
+        tuple->items[3] = buckets;
+        result->items[q] = tuple;
+    }
+
+    return result;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_get_tx_latency_obj, 1, rp2_can_get_tx_latency);
+
 // Return number of events waiting in the TX event FIFO.`
 STATIC mp_obj_t rp2_can_recv_tx_events_pending(mp_obj_t self_in)
 {
@@ -544,8 +2904,7 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_can_recv_tx_events_pending_obj, rp2_can_rec
 STATIC mp_obj_t rp2_can_get_status(mp_obj_t self_in)
 {
     rp2_can_obj_t *self = self_in;
-    can_controller_t *controller = &self->controller;
-    can_status_t status = can_get_status(controller);
+    can_status_t status = rp2_can_read_status(self);
 
     // Returns a tuple of:
     // bool: is Bus-off
@@ -590,15 +2949,89 @@ STATIC mp_obj_t rp2_can_get_diagnostics(mp_obj_t self_in)
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_can_get_diagnostics_obj, rp2_can_get_diagnostics);
 
-// Return the timestamp counter (Typically used to convert timestamps to time-of-day)
-STATIC mp_obj_t rp2_can_get_time(mp_obj_t self_in)
+// Return the timestamp counter (Typically used to convert timestamps to time-of-day). The counter is 32 bits
+// unless extended=True, when it is extended to 64 bits in the same way as timestamps.
+STATIC mp_obj_t rp2_can_get_time(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_extended,  MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
+    };
+
+    rp2_can_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if (args[0].u_bool) {
+        return mp_obj_new_int_from_ull(rp2_can_sample_timebase(self));
+    }
+
+    return mp_obj_new_int_from_uint(rp2_can_read_time(self));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_get_time_obj, 1, rp2_can_get_time);
+
+// Convert a 64-bit timestamp from this controller to RP2040 time (microseconds since boot), the common
+// timebase for comparing timestamps from different controllers
+STATIC mp_obj_t rp2_can_to_local_time(mp_obj_t self_in, mp_obj_t timestamp_in)
 {
     rp2_can_obj_t *self = self_in;
-    can_controller_t *controller = &self->controller;
+    uint64_t timestamp = rp2_can_get_uint64(timestamp_in);
+
+    uint32_t state = save_and_disable_interrupts();
+    uint64_t local = self->timebase.local + (timestamp - self->timebase.controller);
+    restore_interrupts(state);
+
+    return mp_obj_new_int_from_ull(local);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(rp2_can_to_local_time_obj, rp2_can_to_local_time);
+
+// Return which of the board's controllers this is
+STATIC mp_obj_t rp2_can_get_index(mp_obj_t self_in)
+{
+    rp2_can_obj_t *self = self_in;
+
+    return MP_OBJ_NEW_SMALL_INT(self->index);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_can_get_index_obj, rp2_can_get_index);
 
-    return mp_obj_new_int_from_uint(can_get_time(controller));
+// Set a host-provided time (e.g. microseconds since the Unix epoch) for the controller time now, so that
+// get_time_correlation() can return it alongside the controller time
+STATIC mp_obj_t rp2_can_set_epoch(mp_obj_t self_in, mp_obj_t epoch_in)
+{
+    rp2_can_obj_t *self = self_in;
+    uint64_t epoch = rp2_can_get_uint64(epoch_in);
+
+    self->timebase.epoch_controller = rp2_can_sample_timebase(self);
+    self->timebase.epoch = epoch;
+    self->timebase.epoch_valid = true;
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(rp2_can_set_epoch_obj, rp2_can_set_epoch);
+
+// Return a tuple of (controller time, RP2040 time, host time) sampled together. The controller time is 64 bits
+// (as for timestamps), the RP2040 time is from time_us_64() and the host time is the time set by set_epoch()
+// moved on by the controller time since then (or None if set_epoch() has not been called). A host converts
+// a timestamp to its own time with: host time + (timestamp - controller time).
+STATIC mp_obj_t rp2_can_get_time_correlation(mp_obj_t self_in)
+{
+    rp2_can_obj_t *self = self_in;
+
+    uint64_t controller = rp2_can_sample_timebase(self);
+    uint64_t local = self->timebase.local;
+
+    mp_obj_tuple_t *tuple = mp_obj_new_tuple(3U, NULL);
+    tuple->items[0] = mp_obj_new_int_from_ull(controller);
+    tuple->items[1] = mp_obj_new_int_from_ull(local);
+    if (self->timebase.epoch_valid) {
+        tuple->items[2] = mp_obj_new_int_from_ull(self->timebase.epoch + (controller - self->timebase.epoch_controller));
+    }
+    else {
+        tuple->items[2] = mp_const_none;
+    }
+
+    return tuple;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_can_get_time_obj, rp2_can_get_time);
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_can_get_time_correlation_obj, rp2_can_get_time_correlation);
 
 // Return the timestamp counter resolution in ticks per second (the CAN drivers
 // set the timer to tick at 1us)
@@ -631,6 +3064,59 @@ STATIC mp_obj_t rp2_can_get_send_space(mp_uint_t n_args, const mp_obj_t *pos_arg
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_get_send_space_obj, 1, rp2_can_get_send_space);
 
+// Sleep until a frame has been sent (it has a timestamp) or the timeout (negative waits for ever). Returns
+// True if the frame was sent. Queueing a frame clears its timestamp, so this waits for the latest send.
+STATIC mp_obj_t rp2_can_wait_sent(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_frame,         MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = mp_const_none}},
+        {MP_QSTR_timeout_ms,    MP_ARG_INT, {.u_int = -1}},
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if (!MP_OBJ_IS_TYPE(args[0].u_obj, &rp2_canframe_type)) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_TypeError, "frame must be of type CANFrame"));
+    }
+    rp2_canframe_obj_t *frame = args[0].u_obj;
+    absolute_time_t until = rp2_can_wait_until(args[1].u_int);
+
+    // The transmit ISR sets timestamp_valid (a boolean, so no need to lock out interrupts)
+    while (!frame->timestamp_valid && rp2_can_wait_event(until)) {
+    }
+
+    return frame->timestamp_valid ? mp_const_true : mp_const_false;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_wait_sent_obj, 1, rp2_can_wait_sent);
+
+// Sleep until there are at least n frame slots free in the transmit or FIFO queues or the timeout (negative
+// waits for ever). Returns the number of slots free.
+STATIC mp_obj_t rp2_can_wait_space(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_n,             MP_ARG_INT, {.u_int = 1}},
+        {MP_QSTR_timeout_ms,    MP_ARG_INT, {.u_int = -1}},
+        {MP_QSTR_fifo,          MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
+    };
+
+    rp2_can_obj_t *self = pos_args[0];
+    can_controller_t *controller = &self->controller;
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    uint32_t n = args[0].u_int;
+    absolute_time_t until = rp2_can_wait_until(args[1].u_int);
+    bool fifo = args[2].u_bool;
+
+    while (can_get_send_space(controller, fifo) < n && rp2_can_wait_event(until)) {
+    }
+
+    return MP_OBJ_NEW_SMALL_INT(can_get_send_space(controller, fifo));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_wait_space_obj, 1, rp2_can_wait_space);
+
 // Set the conditions for triggering an edge on the trigger pin
 STATIC mp_obj_t rp2_can_set_trigger(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
 {
@@ -640,6 +3126,7 @@ STATIC mp_obj_t rp2_can_set_trigger(mp_uint_t n_args, const mp_obj_t *pos_args,
             {MP_QSTR_as_bytes,      MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none}},   // A block of bytes
             {MP_QSTR_on_tx,         MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
             {MP_QSTR_on_rx,         MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = true}},
+            {MP_QSTR_canhack,       MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},   // Start the armed CANHack action
     };
 
     rp2_can_obj_t *self = pos_args[0];
@@ -651,6 +3138,13 @@ STATIC mp_obj_t rp2_can_set_trigger(mp_uint_t n_args, const mp_obj_t *pos_args,
     mp_obj_t as_bytes = args[2].u_obj;
     bool on_tx = args[3].u_bool;
     bool on_rx = args[4].u_bool;
+    bool canhack = args[5].u_bool;
+
+#ifndef CANHACK
+    if (canhack) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "CANHack not in firmware"));
+    }
+#endif
 
     if (as_bytes != mp_const_none) {
         // Trigger can be set directly but the ID trigger is then not valid
@@ -721,6 +3215,10 @@ STATIC mp_obj_t rp2_can_set_trigger(mp_uint_t n_args, const mp_obj_t *pos_args,
         self->triggers[0].on_error = on_error;
         self->triggers[0].enabled = true;
     }
+    // Only set once the trigger is known to be good, and with the receive ISR locked out
+    uint32_t locked = rp2_can_spi_lock();
+    self->triggers[0].canhack = canhack;
+    rp2_can_spi_unlock(locked);
     
     // Set the trigger pin on the CANPico as a GPIO port, drive low
     gpio_set_function(TRIG_GPIO, GPIO_FUNC_SIO);
@@ -744,6 +3242,26 @@ STATIC mp_obj_t rp2_can_clear_trigger(mp_obj_t self_in)
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_can_clear_trigger_obj, rp2_can_clear_trigger);
 
+// Checks a frame against the trigger's ID, DLC and payload mask/match values
+STATIC TIME_CRITICAL bool trigger_match(can_trigger_t *trigger, can_frame_t *frame)
+{
+    uint8_t *data = can_frame_get_data(frame);
+    uint8_t *can_data_mask = (uint8_t *)trigger->can_data_mask;
+    uint8_t *can_data_match = (uint8_t *)trigger->can_data_match;
+
+    if (((can_frame_get_arbitration_id(frame) & trigger->arbitration_id_mask) != trigger->arbitration_id_match) ||
+        ((can_frame_get_dlc(frame) & trigger->can_dlc_mask) != trigger->can_dlc_match)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < 8U; i++) {
+        if ((data[i] & can_data_mask[i]) != can_data_match[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 STATIC TIME_CRITICAL void pulse_trigger(void)
 {
     // Ensure pulse is long enough for even a slow logic analyzer (e.g. 20MHz) to see
@@ -996,8 +3514,8 @@ STATIC void rp2_can_print(const mp_print_t *print, mp_obj_t self_in, mp_print_ki
      rp2_can_obj_t *self = self_in;
      can_controller_t *controller = &self->controller;
 
-    can_status_t status = can_get_status(controller);
-    uint32_t timestamp_timer = can_get_time(controller);
+    can_status_t status = rp2_can_read_status(self);
+    uint32_t timestamp_timer = rp2_can_read_time(self);
 
     // Show the bus off status, the error passive status, TEC, REC, the time, and the baud rate settings
     mp_printf(print, "CAN(mode=");
@@ -1046,15 +3564,57 @@ STATIC const mp_map_elem_t rp2_can_locals_dict_table[] = {
     ////// Instance methods
     { MP_OBJ_NEW_QSTR(MP_QSTR_send_frame), (mp_obj_t)&rp2_can_send_frame_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_send_frames), (mp_obj_t)&rp2_can_send_frames_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_send_bytes), (mp_obj_t)&rp2_can_send_bytes_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_schedule), (mp_obj_t)&rp2_can_set_schedule_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_schedule_data), (mp_obj_t)&rp2_can_set_schedule_data_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_schedule_stats), (mp_obj_t)&rp2_can_get_schedule_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_send_frame_at), (mp_obj_t)&rp2_can_send_frame_at_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_send_frames_at), (mp_obj_t)&rp2_can_send_frames_at_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_replay), (mp_obj_t)&rp2_can_replay_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_replay_stats), (mp_obj_t)&rp2_can_get_replay_stats_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_recv), (mp_obj_t)&rp2_can_recv_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_rx_lane), (mp_obj_t)&rp2_can_set_rx_lane_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_rx_lane_status), (mp_obj_t)&rp2_can_get_rx_lane_status_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_recv_pending), (mp_obj_t)&rp2_can_recv_pending_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_recv_tx_events), (mp_obj_t)&rp2_can_recv_tx_events_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_recv_tx_events_pending), (mp_obj_t)&rp2_can_recv_tx_events_pending_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_tx_latency), (mp_obj_t)&rp2_can_get_tx_latency_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_filters), (mp_obj_t)&rp2_can_set_filters_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_accept_ids), (mp_obj_t)&rp2_can_set_accept_ids_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_accept_rejected), (mp_obj_t)&rp2_can_get_accept_rejected_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_stats), (mp_obj_t)&rp2_can_set_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_stats), (mp_obj_t)&rp2_can_get_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_rx_policy), (mp_obj_t)&rp2_can_set_rx_policy_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_rx_policy_stats), (mp_obj_t)&rp2_can_get_rx_policy_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_mailbox), (mp_obj_t)&rp2_can_set_mailbox_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_mailbox), (mp_obj_t)&rp2_can_get_mailbox_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_rtr_responder), (mp_obj_t)&rp2_can_set_rtr_responder_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_rtr_response), (mp_obj_t)&rp2_can_set_rtr_response_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_rtr_responder_stats), (mp_obj_t)&rp2_can_get_rtr_responder_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_log_file), (mp_obj_t)&rp2_can_set_log_file_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_log_stats), (mp_obj_t)&rp2_can_get_log_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_monitor), (mp_obj_t)&rp2_can_monitor_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_monitor_stats), (mp_obj_t)&rp2_can_get_monitor_stats_obj },
+#if CFG_TUD_CDC > 1
+    { MP_OBJ_NEW_QSTR(MP_QSTR_slcan), (mp_obj_t)&rp2_can_slcan_obj },
+#endif
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_bus_load), (mp_obj_t)&rp2_can_set_bus_load_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_bus_load), (mp_obj_t)&rp2_can_get_bus_load_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_bus_load_history), (mp_obj_t)&rp2_can_get_bus_load_history_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_status), (mp_obj_t)&rp2_can_get_status_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_diagnostics), (mp_obj_t)&rp2_can_get_diagnostics_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_send_space), (mp_obj_t)&rp2_can_get_send_space_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_wait_sent), (mp_obj_t)&rp2_can_wait_sent_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_wait_space), (mp_obj_t)&rp2_can_wait_space_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_time), (mp_obj_t)&rp2_can_get_time_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_to_local_time), (mp_obj_t)&rp2_can_to_local_time_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_index), (mp_obj_t)&rp2_can_get_index_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_time_hz), (mp_obj_t)&rp2_can_get_time_hz_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_epoch), (mp_obj_t)&rp2_can_set_epoch_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_time_correlation), (mp_obj_t)&rp2_can_get_time_correlation_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_sync), (mp_obj_t)&rp2_can_set_sync_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_sync_status), (mp_obj_t)&rp2_can_get_sync_status_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_sync_time), (mp_obj_t)&rp2_can_sync_time_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_set_trigger), (mp_obj_t)&rp2_can_set_trigger_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_clear_trigger), (mp_obj_t)&rp2_can_clear_trigger_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_pulse_trigger), (mp_obj_t)&rp2_can_pulse_trigger_obj },
@@ -1097,6 +3657,20 @@ STATIC const mp_map_elem_t rp2_can_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_ACK_ONLY), MP_OBJ_NEW_SMALL_INT(CAN_MODE_ACK_ONLY) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_OFFLINE), MP_OBJ_NEW_SMALL_INT(CAN_MODE_OFFLINE) },
 
+    // Receive policies
+    { MP_OBJ_NEW_QSTR(MP_QSTR_POLICY_CHANGED), MP_OBJ_NEW_SMALL_INT(CANPOLICY_CHANGED) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_POLICY_EVERY_NTH), MP_OBJ_NEW_SMALL_INT(CANPOLICY_EVERY_NTH) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_POLICY_INTERVAL), MP_OBJ_NEW_SMALL_INT(CANPOLICY_INTERVAL) },
+
+    // Monitor styles
+    { MP_OBJ_NEW_QSTR(MP_QSTR_MONITOR_CANDUMP), MP_OBJ_NEW_SMALL_INT(CANMON_CANDUMP) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_MONITOR_ASC), MP_OBJ_NEW_SMALL_INT(CANMON_ASC) },
+
+    // Time synchronization roles
+    { MP_OBJ_NEW_QSTR(MP_QSTR_SYNC_OFF), MP_OBJ_NEW_SMALL_INT(CAN_SYNC_OFF) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_SYNC_MASTER), MP_OBJ_NEW_SMALL_INT(CAN_SYNC_MASTER) },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_SYNC_SLAVE), MP_OBJ_NEW_SMALL_INT(CAN_SYNC_SLAVE) },
+
     // Configuration constants
     { MP_OBJ_NEW_QSTR(MP_QSTR_RX_FIFO_SIZE), MP_OBJ_NEW_SMALL_INT(CAN_RX_FIFO_SIZE) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_TX_FIFO_SIZE), MP_OBJ_NEW_SMALL_INT(CAN_TX_FIFO_SIZE) },
@@ -1129,6 +3703,8 @@ STATIC mp_obj_t rp2_canframe_make_new(const mp_obj_type_t *type, mp_uint_t n_arg
         {MP_QSTR_remote,    MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
         {MP_QSTR_tag,       MP_ARG_KW_ONLY | MP_ARG_INT,  {.u_int = 0}},
         {MP_QSTR_dlc,       MP_ARG_KW_ONLY | MP_ARG_INT,  {.u_int = -1}},
+        {MP_QSTR_fd,        MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
+        {MP_QSTR_brs,       MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
     };
 
     mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
@@ -1140,10 +3716,18 @@ STATIC mp_obj_t rp2_canframe_make_new(const mp_obj_type_t *type, mp_uint_t n_arg
     uint32_t tag = args[3].u_int;
     bool dlc_set = args[4].u_int != -1;
     uint8_t dlc = args[4].u_int;
+    bool fd = args[5].u_bool;
+    bool brs = args[6].u_bool;
 
     if (!MP_OBJ_IS_TYPE(mp_canid, &rp2_canid_type)) {
         nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_TypeError, "canid must be of type CANID"));
     }
+    if (brs && !fd) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "brs needs fd=True"));
+    }
+    if (fd && remote) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "CAN FD has no remote frames"));
+    }
     if (dlc_set && dlc > 15) {
         nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_TypeError, "dlc must be 0..15"));
     }
@@ -1153,7 +3737,22 @@ STATIC mp_obj_t rp2_canframe_make_new(const mp_obj_type_t *type, mp_uint_t n_arg
 
     uint8_t frame_dlc;
     uint32_t data_buf[2];
-    if(mp_data == mp_const_none) {
+    mp_obj_t fd_data = MP_OBJ_NULL;
+    if (fd) {
+        // The driver's frame holds the first 8 bytes (for triggers and filters) and the whole payload is kept
+        mp_buffer_info_t bufinfo = {.buf = data_buf, .len = 0};
+        if (mp_data != mp_const_none) {
+            mp_get_buffer_raise(mp_data, &bufinfo, MP_BUFFER_READ);
+        }
+        frame_dlc = dlc_set ? dlc : canfd_len_to_dlc(bufinfo.len);
+        if (bufinfo.len > CANFD_MAX_DATA || canfd_dlc_to_len(frame_dlc) != bufinfo.len) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "FD data must be 0 to 8, 12, 16, 20, 24, 32, 48 or 64 bytes (and match dlc)"));
+        }
+        memset(data_buf, 0, sizeof(data_buf));
+        memcpy(data_buf, bufinfo.buf, bufinfo.len < 8U ? bufinfo.len : 8U);
+        fd_data = mp_obj_new_bytes(bufinfo.buf, bufinfo.len);
+    }
+    else if(mp_data == mp_const_none) {
         if (remote) {
             frame_dlc = dlc_set ? dlc : 0;
         }
@@ -1165,6 +3764,9 @@ STATIC mp_obj_t rp2_canframe_make_new(const mp_obj_type_t *type, mp_uint_t n_arg
         if(remote) {
             nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Remote frames cannot have data"));
         }
+        if (MP_OBJ_IS_STR_OR_BYTES(mp_data) && mp_obj_get_int(mp_obj_len(mp_data)) > 8) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Data longer than 8 bytes needs fd=True"));
+        }
         uint8_t len = (uint8_t)copy_mp_bytes(mp_data, (uint8_t *)data_buf, 8U);
         // If there are insufficient bytes to match the DLC then this is an error
         if (dlc_set && len < 8U && dlc > len) {
@@ -1181,7 +3783,12 @@ STATIC mp_obj_t rp2_canframe_make_new(const mp_obj_type_t *type, mp_uint_t n_arg
     // The reference in the frame is to the enclosing MicroPython CANFrame instance
     can_frame_set_uref(&self->frame, self);
     self->timestamp_valid = false;
+    self->latency_valid = false;
     self->tag = tag;
+    self->fd = fd;
+    self->brs = brs;
+    self->esi = false;
+    self->fd_data = fd_data;
 
     return self;
 }
@@ -1196,10 +3803,15 @@ STATIC mp_obj_t rp2_canframe_from_bytes(mp_obj_t frames)
     uint8_t data[1];
     rp2_buf_get_for_send(frames, &bufinfo, data);
 
-    if ((bufinfo.len % FRAME_FROM_BYTES_NUM) != 0) {
-        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Frames must be a multiple of %d bytes", FRAME_FROM_BYTES_NUM));
+    // Records are FRAME_FROM_BYTES_NUM bytes, except for FD frames (see canfd.h)
+    size_t num_frames = 0;
+    for (size_t n = 0; n < bufinfo.len; num_frames++) {
+        const uint8_t *record = (const uint8_t *)bufinfo.buf + n;
+        n += bufinfo.len - n < FRAME_FROM_BYTES_NUM ? FRAME_FROM_BYTES_NUM : canfd_record_size(record[0], record[5]);
+        if (n > bufinfo.len) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Frames must be whole records of %d bytes (more for FD frames)", FRAME_FROM_BYTES_NUM));
+        }
     }
-    size_t num_frames = bufinfo.len / FRAME_FROM_BYTES_NUM;
     uint8_t *buf_ptr = bufinfo.buf;
     mp_obj_list_t *list = mp_obj_new_list(num_frames, NULL);
 
@@ -1215,8 +3827,13 @@ STATIC mp_obj_t rp2_canframe_from_bytes(mp_obj_t frames)
         can_frame_set_uref(&self->frame, self);
         
         self->timestamp_valid = false;
+        self->latency_valid = false;
+        self->fd = (buf_ptr[0] & CANFD_FLAG_FD) != 0;
+        self->brs = self->fd && (buf_ptr[0] & CANFD_FLAG_BRS) != 0;
+        self->esi = self->fd && (buf_ptr[0] & CANFD_FLAG_ESI) != 0;
+        self->fd_data = self->fd ? mp_obj_new_bytes(buf_ptr + CANFD_RECORD_HEADER, canfd_dlc_to_len(buf_ptr[5])) : MP_OBJ_NULL;
         list->items[i] = self;
-        buf_ptr += FRAME_FROM_BYTES_NUM;
+        buf_ptr += canfd_record_size(buf_ptr[0], buf_ptr[5]);
     }
 
     return list;
@@ -1234,11 +3851,21 @@ STATIC mp_obj_t rp2_canframe_to_bytes(mp_obj_t self_in)
     rp2_canframe_obj_t *self = self_in;
 
     // Buffer, in same format as 'from bytes' static method
-    uint8_t to_bytes[FRAME_FROM_BYTES_NUM];
+    uint8_t to_bytes[CANFD_RECORD_MAX];
 
     can_make_bytes_from_frame(to_bytes, &self->frame, self->tag);
+    if (!self->fd) {
+        return make_mp_bytes(to_bytes, FRAME_FROM_BYTES_NUM);
+    }
+    // The driver's record only has the first 8 bytes of an FD frame
+    to_bytes[0] |= CANFD_FLAG_FD | (self->brs ? CANFD_FLAG_BRS : 0) | (self->esi ? CANFD_FLAG_ESI : 0);
+    size_t size = canfd_record_size(to_bytes[0], to_bytes[5]);
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(self->fd_data, &bufinfo, MP_BUFFER_READ);
+    memset(to_bytes + CANFD_RECORD_HEADER, 0, size - CANFD_RECORD_HEADER);
+    memcpy(to_bytes + CANFD_RECORD_HEADER, bufinfo.buf, bufinfo.len);
 
-    return make_mp_bytes(to_bytes, FRAME_FROM_BYTES_NUM);
+    return make_mp_bytes(to_bytes, size);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_canframe_to_bytes_obj, rp2_canframe_to_bytes);
 
@@ -1247,6 +3874,9 @@ STATIC mp_obj_t rp2_canframe_get_data(mp_obj_t self_in)
 {
     rp2_canframe_obj_t *self = self_in;
 
+    if (self->fd) {
+        return self->fd_data;
+    }
     uint8_t *data = can_frame_get_data(&self->frame);
     size_t len = can_frame_get_data_len(&self->frame);
 
@@ -1254,6 +3884,33 @@ STATIC mp_obj_t rp2_canframe_get_data(mp_obj_t self_in)
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_canframe_get_data_obj, rp2_canframe_get_data);
 
+// Returns True if this is a CAN FD frame
+STATIC mp_obj_t rp2_canframe_is_fd(mp_obj_t self_in)
+{
+    rp2_canframe_obj_t *self = self_in;
+
+    return self->fd ? mp_const_true : mp_const_false;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_canframe_is_fd_obj, rp2_canframe_is_fd);
+
+// Returns True if an FD frame's data phase is at the fast bit rate
+STATIC mp_obj_t rp2_canframe_is_brs(mp_obj_t self_in)
+{
+    rp2_canframe_obj_t *self = self_in;
+
+    return self->brs ? mp_const_true : mp_const_false;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_canframe_is_brs_obj, rp2_canframe_is_brs);
+
+// Returns True if an FD frame was sent by an error passive node
+STATIC mp_obj_t rp2_canframe_is_esi(mp_obj_t self_in)
+{
+    rp2_canframe_obj_t *self = self_in;
+
+    return self->esi ? mp_const_true : mp_const_false;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_canframe_is_esi_obj, rp2_canframe_is_esi);
+
 STATIC mp_obj_t rp2_canframe_get_dlc(mp_obj_t self_in)
 {
     rp2_canframe_obj_t *self = self_in;
@@ -1278,7 +3935,7 @@ STATIC mp_obj_t rp2_canframe_get_timestamp(mp_obj_t self_in)
 
     // An ISR can set timestamp_valid but since it is a boolean will not need to disable interrupts
     if (self->timestamp_valid) {
-        return mp_obj_new_int_from_uint(self->timestamp);
+        return mp_obj_new_int_from_ull(self->timestamp);
     }
     else {
         return mp_const_none;
@@ -1286,6 +3943,36 @@ STATIC mp_obj_t rp2_canframe_get_timestamp(mp_obj_t self_in)
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_canframe_get_timestamp_obj, rp2_canframe_get_timestamp);
 
+// Returns the frame's timestamp in master time as it was when the frame was timestamped (see CAN.set_sync()),
+// or None if there is no timestamp or the controller was a slave without a follow-up frame yet
+STATIC mp_obj_t rp2_canframe_get_sync_timestamp(mp_obj_t self_in)
+{
+    rp2_canframe_obj_t *self = self_in;
+
+    if (self->timestamp_valid && self->sync_valid) {
+        return mp_obj_new_int_from_ull(self->sync_timestamp);
+    }
+    else {
+        return mp_const_none;
+    }
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_canframe_get_sync_timestamp_obj, rp2_canframe_get_sync_timestamp);
+
+// Returns the time in microseconds from the frame being queued by send_frame()/send_frames() to being sent, or
+// None if the frame has not been sent since it was queued
+STATIC mp_obj_t rp2_canframe_get_latency(mp_obj_t self_in)
+{
+    rp2_canframe_obj_t *self = self_in;
+
+    if (self->latency_valid) {
+        return mp_obj_new_int_from_uint(self->latency);
+    }
+    else {
+        return mp_const_none;
+    }
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_canframe_get_latency_obj, rp2_canframe_get_latency);
+
 // Returns the ID acceptance filter that allowed through the frame
 STATIC mp_obj_t rp2_canframe_get_index(mp_obj_t self_in)
 {
@@ -1348,7 +4035,11 @@ STATIC void rp2_canframe_print(const mp_print_t *print, mp_obj_t self_in, mp_pri
         mp_printf(print, "S%03"PRIx32"", can_frame_get_arbitration_id(frame));
     }
 
-    mp_printf(print, "), dlc=%d, data=", can_frame_get_dlc(frame));
+    mp_printf(print, "), dlc=%d, ", can_frame_get_dlc(frame));
+    if (self->fd) {
+        mp_printf(print, self->brs ? "fd=True, brs=True, " : "fd=True, ");
+    }
+    mp_printf(print, "data=");
 
     if(can_frame_is_remote(frame)) {
         mp_printf(print, "R");
@@ -1356,6 +4047,12 @@ STATIC void rp2_canframe_print(const mp_print_t *print, mp_obj_t self_in, mp_pri
     else {
         size_t len = can_frame_get_data_len(frame);
         uint8_t *data = can_frame_get_data(frame);
+        mp_buffer_info_t bufinfo;
+        if (self->fd) {
+            mp_get_buffer_raise(self->fd_data, &bufinfo, MP_BUFFER_READ);
+            data = bufinfo.buf;
+            len = bufinfo.len;
+        }
         if(len) {
             for (uint32_t i = 0; i < len; i++) {
                 mp_printf(print, "%02x", data[i]);
@@ -1367,7 +4064,8 @@ STATIC void rp2_canframe_print(const mp_print_t *print, mp_obj_t self_in, mp_pri
     }
 
     if (self->timestamp_valid) {
-        mp_printf(print, ", timestamp=%lu", self->timestamp);
+        mp_printf(print, ", timestamp=");
+        rp2_can_print_timestamp(print, self->timestamp);
     }
 
     mp_printf(print, ")");
@@ -1382,8 +4080,13 @@ STATIC const mp_map_elem_t rp2_canframe_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_is_extended), (mp_obj_t)&rp2_canframe_is_extended_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_data), (mp_obj_t)&rp2_canframe_get_data_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_dlc), (mp_obj_t)&rp2_canframe_get_dlc_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_is_fd), (mp_obj_t)&rp2_canframe_is_fd_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_is_brs), (mp_obj_t)&rp2_canframe_is_brs_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_is_esi), (mp_obj_t)&rp2_canframe_is_esi_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_tag), (mp_obj_t)&rp2_canframe_get_tag_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_timestamp), (mp_obj_t)&rp2_canframe_get_timestamp_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_sync_timestamp), (mp_obj_t)&rp2_canframe_get_sync_timestamp_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_latency), (mp_obj_t)&rp2_canframe_get_latency_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_index), (mp_obj_t)&rp2_canframe_get_index_obj },
     // Static methods
     { MP_ROM_QSTR(MP_QSTR_from_bytes), (mp_obj_t)(&rp2_canframe_from_bytes_obj) },
@@ -1626,8 +4329,96 @@ STATIC void rp2_canidfilter_print(const mp_print_t *print, mp_obj_t self_in, mp_
     mp_printf(print, ")");
 }
 
+// Compile a list of IDs into mask/match filters. Each item is an integer, a CANID or a (lo, hi) tuple for
+// an inclusive range of IDs. Returns a tuple of a dict of filters (keyed by filter number from 'start', so it
+// can be passed as id_filters to CAN()) and the number of IDs that the filters let through that were not asked
+// for. These false positives can be dropped in software with CAN.set_accept_ids().
+STATIC mp_obj_t rp2_canidfilter_compile(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_ids,                   MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = mp_const_none}},
+        {MP_QSTR_n_filters,             MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = CAN_MAX_ID_FILTERS}},
+        {MP_QSTR_extended,              MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
+        {MP_QSTR_start,                 MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0}},
+        {MP_QSTR_max_false_positives,   MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = -1}},
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_obj_t ids = args[0].u_obj;
+    mp_int_t n_filters = args[1].u_int;
+    bool extended = args[2].u_bool;
+    mp_int_t start = args[3].u_int;
+    mp_int_t max_false_positives = args[4].u_int;
+
+    if ((n_filters < 1) || (start < 0) || (start + n_filters > CAN_MAX_ID_FILTERS)) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Filters must be in range 0..%d", (int)CAN_MAX_ID_FILTERS - 1));
+    }
+
+    size_t n_items;
+    mp_obj_t *items;
+    mp_obj_get_array(ids, &n_items, &items);
+    if (n_items == 0) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "No IDs to compile"));
+    }
+
+    // Work out the space needed by the compiler: a range is split into at most two cubes per ID bit
+    uint32_t id_bits = extended ? CANFILTER_EXTENDED_BITS : CANFILTER_STANDARD_BITS;
+    size_t max_cubes = 0;
+    for (size_t i = 0; i < n_items; i++) {
+        max_cubes += MP_OBJ_IS_TYPE(items[i], &mp_type_tuple) ? CANFILTER_MAX_RANGE_CUBES(id_bits) : 1U;
+    }
+
+    canfilter_cube_t *cubes = m_new(canfilter_cube_t, max_cubes);
+    uint32_t *best = m_new(uint32_t, max_cubes);
+    uint32_t *best_cost = m_new(uint32_t, max_cubes);
+    canfilter_compiler_t compiler;
+    canfilter_init(&compiler, cubes, best, best_cost, max_cubes, extended);
+
+    for (size_t i = 0; i < n_items; i++) {
+        bool item_extended;
+        uint32_t lo;
+        uint32_t hi;
+        rp2_can_get_id_range(items[i], extended, &item_extended, &lo, &hi);
+        if (item_extended != extended) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Cannot mix standard and extended IDs"));
+        }
+        // Can't run out of room because the space was sized above
+        canfilter_add_range(&compiler, lo, hi);
+    }
+
+    uint32_t false_positives = canfilter_compile(&compiler, n_filters);
+
+    if ((max_false_positives >= 0) && (false_positives > (mp_uint_t)max_false_positives)) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Filters would let in %u unwanted IDs", (unsigned int)false_positives));
+    }
+
+    mp_obj_t filters = mp_obj_new_dict(compiler.n_cubes);
+    for (size_t i = 0; i < compiler.n_cubes; i++) {
+        rp2_canidfilter_obj_t *mp_filter = m_new_obj(rp2_canidfilter_obj_t);
+        mp_filter->base.type = &rp2_canidfilter_type;
+        can_make_id_filter_masked(&mp_filter->filter, extended, compiler.cubes[i].match, compiler.cubes[i].mask);
+        mp_obj_dict_store(filters, MP_OBJ_NEW_SMALL_INT(start + i), mp_filter);
+    }
+
+    m_del(canfilter_cube_t, cubes, max_cubes);
+    m_del(uint32_t, best, max_cubes);
+    m_del(uint32_t, best_cost, max_cubes);
+
+    mp_obj_tuple_t *tuple = mp_obj_new_tuple(2U, NULL);
+    tuple->items[0] = filters;
+    tuple->items[1] = mp_obj_new_int_from_uint(false_positives);
+
+    return tuple;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_canidfilter_compile_fun_obj, 1, rp2_canidfilter_compile);
+STATIC MP_DEFINE_CONST_STATICMETHOD_OBJ(rp2_canidfilter_compile_obj, MP_ROM_PTR(&rp2_canidfilter_compile_fun_obj));
+
 STATIC const mp_map_elem_t rp2_canidfilter_locals_dict_table[] = {
     // Instance methods
+    // Static methods
+    { MP_OBJ_NEW_QSTR(MP_QSTR_compile), (mp_obj_t)&rp2_canidfilter_compile_obj },
 };
 STATIC MP_DEFINE_CONST_DICT(rp2_canidfilter_locals_dict, rp2_canidfilter_locals_dict_table);
 
@@ -1671,7 +4462,7 @@ STATIC mp_obj_t rp2_canerror_get_timestamp(mp_obj_t self_in)
 {
     rp2_canerror_obj_t *self = self_in;
 
-    return mp_obj_new_int_from_uint(self->timestamp);
+    return mp_obj_new_int_from_ull(self->timestamp);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_canerror_get_timestamp_obj, rp2_canerror_get_timestamp);
 
@@ -1794,7 +4585,9 @@ STATIC void rp2_canerror_print(const mp_print_t *print, mp_obj_t self_in, mp_pri
     if (prev_item) {
         mp_printf(print, ", ");
     }
-    mp_printf(print, "frame_cnt=%d, timestamp=%lu)", can_error_get_frame_cnt(e), self->timestamp);
+    mp_printf(print, "frame_cnt=%d, timestamp=", can_error_get_frame_cnt(e));
+    rp2_can_print_timestamp(print, self->timestamp);
+    mp_printf(print, ")");
 }
 
 STATIC const mp_map_elem_t rp2_canerror_locals_dict_table[] = {
@@ -1846,7 +4639,7 @@ STATIC mp_obj_t rp2_canoverflow_get_timestamp(mp_obj_t self_in)
 {
     rp2_canoverflow_obj_t *self = self_in;
 
-    return mp_obj_new_int_from_uint(self->timestamp);
+    return mp_obj_new_int_from_ull(self->timestamp);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_canoverflow_get_timestamp_obj, rp2_canoverflow_get_timestamp);
 
@@ -1877,11 +4670,13 @@ STATIC void rp2_canoverflow_print(const mp_print_t *print, mp_obj_t self_in, mp_
 {
     rp2_canoverflow_obj_t *self = self_in;
     if (self->receive) {
-        mp_printf(print, "CANOverflow(frame_cnt=%d, error_cnt=%d, timestamp=%lu)", self->frame_cnt, self->error_cnt, self->timestamp);
+        mp_printf(print, "CANOverflow(frame_cnt=%d, error_cnt=%d, timestamp=", self->frame_cnt, self->error_cnt);
     }
     else {
-        mp_printf(print, "CANOverflow(frame_cnt=%d, timestamp=%lu)", self->frame_cnt, self->timestamp);
+        mp_printf(print, "CANOverflow(frame_cnt=%d, timestamp=", self->frame_cnt);
     }
+    rp2_can_print_timestamp(print, self->timestamp);
+    mp_printf(print, ")");
 }
 
 STATIC const mp_map_elem_t rp2_canoverflow_locals_dict_table[] = {
@@ -1905,19 +4700,59 @@ MP_DEFINE_CONST_OBJ_TYPE(
 
 //////////////////////////////// Start of callbacks of CANOverflow class //////////////////////////
 
+// Work out the time from a frame being queued to being sent and add it to the histogram for its queue
+STATIC uint32_t TIME_CRITICAL rp2_can_record_latency(rp2_can_obj_t *self, bool fifo, uint64_t queued_at, uint64_t sent)
+{
+    // The queueing time is an estimate so can be a little after the transmit timestamp
+    uint64_t delta = sent > queued_at ? sent - queued_at : 0;
+    uint32_t latency = delta > 0xffffffffULL ? 0xffffffffU : (uint32_t)delta;
+
+    if (self != MP_OBJ_NULL) {
+        can_latency_hist_t *hist = &self->latency[fifo ? 1U : 0];
+        // Bucket 0 is under 2us
+        hist->buckets[canperf_bucket(latency, 1U, CAN_LATENCY_BUCKETS)]++;
+        hist->count++;
+        hist->sum += latency;
+        if (latency > hist->max) {
+            hist->max = latency;
+        }
+    }
+
+    return latency;
+}
+
 // Transmit ISR callback to track timestamp of the sent frame
 void TIME_CRITICAL can_isr_callback_frame_tx(can_uref_t uref, uint32_t timestamp)
 {
     // Called with interrupts locked
 
-    // The uref contains a pointer to the CANFrame instance that was transmitted
-    // so update its timestamp.    
-    rp2_canframe_obj_t *mp_frame = (rp2_canframe_obj_t *)(uref.ref);
-    mp_frame->timestamp = timestamp;
-    mp_frame->timestamp_valid = true;
+    // The uref contains a pointer to the CANFrame instance (or transmit slot) that was
+    // transmitted so update its timestamp.
+    rp2_can_obj_t *self = rp2_can_callback_obj();
+    can_frame_t *frame;
+    uint64_t timestamp64 = self != MP_OBJ_NULL ? rp2_can_extend_timestamp(self, timestamp) : timestamp;
+    if (rp2_can_is_tx_slot(self, uref.ref)) {
+        can_tx_slot_t *slot = (can_tx_slot_t *)(uref.ref);
+        slot->timestamp = timestamp64;
+        slot->latency = rp2_can_record_latency(self, slot->fifo, slot->queued_at, timestamp64);
+        // The frame has gone so the slot can be reused
+        slot->queued = false;
+        frame = &slot->frame;
+        // SYNC frames for time synchronization are always sent from a slot
+        if (self != MP_OBJ_NULL) {
+            can_sync_on_tx(self, frame, timestamp64);
+        }
+    }
+    else {
+        rp2_canframe_obj_t *mp_frame = (rp2_canframe_obj_t *)(uref.ref);
+        mp_frame->timestamp = timestamp64;
+        mp_frame->sync_valid = self != MP_OBJ_NULL && can_sync_master_time(self, timestamp64, &mp_frame->sync_timestamp);
+        mp_frame->timestamp_valid = true;
+        mp_frame->latency = rp2_can_record_latency(self, mp_frame->fifo, mp_frame->queued_at, timestamp64);
+        mp_frame->latency_valid = true;
+        frame = &mp_frame->frame;
+    }
 
-    can_frame_t *frame = &mp_frame->frame;
-    rp2_can_obj_t *self = MP_STATE_PORT(rp2_can_obj[0]);
     // Guard against spurious interrupt callbacks
     if (self != MP_OBJ_NULL) {
         can_trigger_t *trigger = &self->triggers[0];
@@ -1925,13 +4760,16 @@ void TIME_CRITICAL can_isr_callback_frame_tx(can_uref_t uref, uint32_t timestamp
         uint8_t dlc = can_frame_get_dlc(frame);
 
         // Check to see if the transmitted frame matches and should trigger
-        if (trigger->enabled && trigger->on_tx) {
-            if (((arbitration_id & trigger->arbitration_id_mask) == trigger->arbitration_id_match) &&
-                ((dlc & trigger->can_dlc_mask) == self->triggers->can_dlc_match) &&
-                ((frame->data[0] & trigger->can_data_mask[0]) == self->triggers->can_data_match[0]) &&
-                ((frame->data[0] & trigger->can_data_mask[1]) == self->triggers->can_data_match[1])) {
-                pulse_trigger();
-            }
+        if (trigger->enabled && trigger->on_tx && trigger_match(trigger, frame)) {
+            pulse_trigger();
+        }
+        // The controller does not receive its own frames so they are counted here
+        if (self->load.enabled) {
+            uint32_t bits = canload_frame_bits(can_frame_is_extended(frame), arbitration_id, can_frame_is_remote(frame), dlc, can_frame_get_data(frame));
+            canload_add(&self->load, bits, timestamp64);
+        }
+        if (self->logger.log != NULL && self->logger.tx) {
+            rp2_can_log_frame(self, CANLOG_TX, frame, timestamp64);
         }
     }
 }
@@ -1943,6 +4781,12 @@ uint32_t TIME_CRITICAL can_isr_callback_uref(can_uref_t uref)
 
     // The user-reference for the CAN API is pointers to MicroPython CANFrame class instances,
     // which when turned into bytes should give a 32-bit application tag that resides in the CANFrame instance
+    // This can be called outside the interrupt handler, so the slot's owner is found from the slot
+    if (rp2_can_tx_slot_owner(uref.ref) != NULL) {
+        // Frame was sent from a copy
+        can_tx_slot_t *slot = (can_tx_slot_t *)(uref.ref);
+        return slot->tag;
+    }
     rp2_canframe_obj_t *mp_frame = (rp2_canframe_obj_t *)(uref.ref);
     uint32_t tag = mp_frame->tag; // Application-provided 32-bit tag
     return tag;
@@ -1953,32 +4797,77 @@ void TIME_CRITICAL can_isr_callback_frame_rx(can_frame_t *frame, uint32_t timest
 {
     // Called with interrupts locked
 
-    rp2_can_obj_t *self = MP_STATE_PORT(rp2_can_obj[0]);
+    rp2_can_obj_t *self = rp2_can_callback_obj();
     // Guard against spurious interrupt callbacks
     if (self != MP_OBJ_NULL) {
         can_trigger_t *trigger = &self->triggers[0];
         uint32_t arbitration_id = can_frame_get_arbitration_id(frame);
         uint8_t dlc = can_frame_get_dlc(frame);
+        uint64_t timestamp64 = rp2_can_extend_timestamp(self, timestamp);
+
+        // Remote frames with a response are answered once the driver's interrupt handler returns
+        if (self->responder.entries != NULL && can_frame_is_remote(frame)) {
+            canresponder_entry_t *e = canresponder_find(&self->responder, CANFILTER_IDSET_KEY(can_frame_is_extended(frame), arbitration_id));
+            if (e != NULL) {
+                if (self->n_responder_pending < CAN_RESPONDER_PENDING) {
+                    self->responder_pending[self->n_responder_pending++] = e;
+                }
+                else {
+                    self->responder.misses++;
+                }
+            }
+        }
+
+        // Priority lanes are filled before anything else is done with the frame
+        if (self->lane_filters != 0) {
+            rp2_can_lane_put(self, frame, timestamp64);
+        }
+        if (self->rx_deep.records != NULL && !rp2_can_on_lane(self, can_frame_get_id_filter(frame))) {
+            rp2_can_deep_put(self, frame, timestamp64);
+        }
 
-        if (trigger->enabled && trigger->on_rx) {
-            if (((arbitration_id & trigger->arbitration_id_mask) == trigger->arbitration_id_match) &&
-                ((dlc & trigger->can_dlc_mask) == self->triggers->can_dlc_match) &&
-                ((frame->data[0] & trigger->can_data_mask[0]) == self->triggers->can_data_match[0]) &&
-                ((frame->data[0] & trigger->can_data_mask[1]) == self->triggers->can_data_match[1])) {
-                pulse_trigger();
+        if (trigger->enabled && trigger->on_rx && trigger_match(trigger, frame)) {
+            pulse_trigger();
+#ifdef CANHACK
+            // Start the CANHack action straight away so that it can catch the next frame on the bus
+            if (trigger->canhack) {
+                uint64_t action_at = rp2_can_estimate_time(self);
+                rp2_canhack_trigger_action(action_at > timestamp64 ? (uint32_t)(action_at - timestamp64) : 0);
             }
+#endif
+        }
+
+        // Time synchronization slave looks for SYNC and follow-up frames (before any software filtering)
+        can_sync_on_rx(self, frame, timestamp64);
+
+        // Traffic statistics cover every frame let through by the hardware filters
+        if (self->stats.entries != NULL) {
+            canstats_frame(&self->stats, CANFILTER_IDSET_KEY(can_frame_is_extended(frame), arbitration_id), dlc, timestamp64);
+        }
+        if (self->load.enabled) {
+            uint32_t bits = canload_frame_bits(can_frame_is_extended(frame), arbitration_id, can_frame_is_remote(frame), dlc, can_frame_get_data(frame));
+            canload_add(&self->load, bits, timestamp64);
+        }
+        if (self->logger.log != NULL) {
+            rp2_can_log_frame(self, CANLOG_RX, frame, timestamp64);
+        }
+        if (self->mailbox.records != NULL) {
+            canmailbox_frame(&self->mailbox, CANFILTER_IDSET_KEY(can_frame_is_extended(frame), arbitration_id),
+                             can_frame_is_remote(frame), dlc, can_frame_get_data(frame), timestamp64);
         }
 
         // Potential callback to Python function (done after trigger because function could be slow)
-        if (self->mp_rx_callback_fn != mp_const_none) {
+        if ((self->mp_rx_callback_fn != mp_const_none) && rp2_can_accept_frame(&self->accept, frame, false)) {
             // Frame here is created in a global space and does NOT have a lifetime beyond the
             // callback.
             static rp2_canframe_obj_t mp_frame_tmp;
             mp_frame_tmp.frame = *frame;
             mp_frame_tmp.base.type = &rp2_canframe_type;
             mp_frame_tmp.tag = 0;
-            mp_frame_tmp.timestamp = timestamp;
+            mp_frame_tmp.timestamp = timestamp64;
             mp_frame_tmp.timestamp_valid = true;
+            mp_frame_tmp.sync_valid = can_sync_master_time(self, timestamp64, &mp_frame_tmp.sync_timestamp);
+            mp_frame_tmp.latency_valid = false;
 
             // Already has been verified that this function is a callable Python function, so
             // hand it the CANFrame instance so the handler can inspect it and react quickly
@@ -1992,7 +4881,7 @@ void TIME_CRITICAL can_isr_callback_error(can_error_t error, uint32_t timestamp)
 {
     // Called with interrupts locked
 
-    rp2_can_obj_t *self = MP_STATE_PORT(rp2_can_obj[0]);
+    rp2_can_obj_t *self = rp2_can_callback_obj();
 
     // Guard against a spurious interrupt that is raised after the controller is stopped.
     if (self != MP_OBJ_NULL) {
@@ -2001,10 +4890,20 @@ void TIME_CRITICAL can_isr_callback_error(can_error_t error, uint32_t timestamp)
         if (trigger->enabled && trigger->on_error) {
             pulse_trigger();
         }
+        if (self->stats.entries != NULL) {
+            canstats_error(&self->stats);
+        }
+        if (self->load.enabled) {
+            canload_add(&self->load, CANLOAD_ERROR_FRAME_BITS, rp2_can_extend_timestamp(self, timestamp));
+        }
+        if (self->logger.log != NULL && self->logger.errors) {
+            canlog_error(self->logger.log, error.details, rp2_can_extend_timestamp(self, timestamp));
+            rp2_can_log_schedule(self);
+        }
     }
 }
 
-// In the future there may be more than one CAN controller
-MP_REGISTER_ROOT_POINTER(void *rp2_can_obj[1]);
+// One root pointer for each CAN controller
+MP_REGISTER_ROOT_POINTER(void *rp2_can_obj[CAN_MAX_CONTROLLERS]);
 
 
@@ -32,13 +32,46 @@
 void can_init(void);
 void can_deinit(void);
 
+// Bind the host interface (SPI and interrupt pin) of a controller, returning false if the board does not
+// have that controller (boards with more than one controller override this)
+bool rp2_can_bind_interface(uint32_t index, can_interface_t *interface);
+
+// Extend a 32-bit controller timestamp to 64 bits (callable from interrupt context)
+uint64_t rp2_can_extend_timestamp(rp2_can_obj_t *self, uint32_t timestamp);
+// Sample the controller time and the RP2040 time together, returning the controller time as 64 bits
+uint64_t rp2_can_sample_timebase(rp2_can_obj_t *self);
+// Estimate the controller time now from the RP2040 timer (callable from interrupt context)
+uint64_t rp2_can_estimate_time(rp2_can_obj_t *self);
+// Get a 64-bit unsigned value from an int
+uint64_t rp2_can_get_uint64(mp_obj_t obj);
+// Get an ID (an int or CANID) or an ID range (a (lo, hi) tuple of ints), raising an exception if out of range
+void rp2_can_get_id_range(mp_obj_t item, bool extended_default, bool *extended, uint32_t *lo, uint32_t *hi);
+
+// The controllers share one SPI bus, so a transfer for one must not be interrupted by the ISR of another (or by
+// the scheduler alarm). The driver only locks out its own controller's interrupt, so the thread locks the bus
+// for all of them, and the alarm backs off while any controller's interrupt is locked out.
+uint32_t rp2_can_spi_lock(void);
+void rp2_can_spi_unlock(uint32_t locked);
+bool rp2_can_spi_busy(void);
+// Read the controller's time and status with the SPI bus locked
+uint32_t rp2_can_read_time(rp2_can_obj_t *self);
+can_status_t rp2_can_read_status(rp2_can_obj_t *self);
+
+// Send a copy of a frame (callable from interrupt context), reporting the transmit event with the given tag
+// and, if deadline is not NULL, the transmit time error against the deadline
+can_errorcode_t rp2_can_send_frame_copy(rp2_can_obj_t *self, const can_frame_t *frame, uint32_t tag, bool fifo, const uint32_t *deadline);
+// Raise an exception for a CAN FD frame, which the CAN driver cannot send
+void rp2_can_check_classic(const rp2_canframe_obj_t *mp_frame);
+
 /////////////// The binary version of a received CAN frame as bytes is laid out as follows:
 //
 // Byte 0: Flags:
 //      bits 3:0 = event type (0 = transmitted frame, 1 = received frame, 2 = overflow event record, 3 = CAN error)
-//      bits 6:4 = reserved (must be set to 0)
+//      bit 4    = CAN FD frame
+//      bit 5    = bit rate switch (FD frames only)
+//      bit 6    = error state indicator (FD frames only)
 //      bit 7    = remote frame
-// Bytes 1-4: timestamp (received) or tag (transmitted) (Big endian)
+// Bytes 1-4: timestamp (received) or tag (transmitted) (Big endian, bottom 32 bits of the 64-bit timestamp)
 //
 // Frame                                        Overflow                                    Error
 // -----                                        --------                                    -----
@@ -48,17 +81,20 @@ void can_deinit(void);
 //              format (Big endian)
 // Bytes 11-18: Data (padded to 8 bytes)        Bytes 11-14: Error overflow count
 //
+// An FD frame's record carries the whole payload from byte 11 (padded to 8 bytes), so it is 11 bytes plus the
+// payload length given by the DLC (see canfd.h) rather than 19 bytes.
 //
 /////////////// Binary version of a CAN frame to transmit as bytes is laid out as follows:
 //
 // Byte 0:      Flags, as follows:
-//      bits 6:0 = reserved (must be set to 0)
+//      bits 3:0 = reserved (must be set to 0)
+//      bits 6:4 = CAN FD frame, bit rate switch, error state indicator (as above)
 //      bit 7    = remote
 // Bytes 1-4:   Tag (Big endian)
 // Byte 5:      DLC
 // Byte 6:      Filter index
 // Bytes 7-10:  CAN ID in 32-bit format (Big endian)
-// Bytes 11-18: Data (padded to 8 bytes)
+// Bytes 11-18: Data (padded to 8 bytes, or the whole payload of an FD frame as above)
 //
 // CAN ID is a 32-bit integer laid out as follows:
 //
@@ -109,8 +145,18 @@ typedef struct {
     mp_obj_base_t base;
     can_frame_t frame;
     uint32_t tag;                                       // Tag supplied via API for identification of an instance
-    uint32_t timestamp;
+    uint64_t timestamp;                                 // Extended to 64 bits (see rp2_can_extend_timestamp())
     bool timestamp_valid;                               // true when timestamp is set; cleared when queued for transmission
+    uint64_t sync_timestamp;                            // Timestamp in master time (see rp2_cansync.h)
+    bool sync_valid;                                    // true when sync_timestamp is set along with timestamp
+    uint64_t queued_at;                                 // Controller time when queued by send_frame()/send_frames()
+    uint32_t latency;                                   // Microseconds from being queued to being sent
+    bool latency_valid;                                 // true when the frame has been sent since it was last queued
+    bool fifo;                                          // Queued in the FIFO queue
+    bool fd;                                            // CAN FD frame (the driver's frame holds the first 8 bytes)
+    bool brs;                                           // FD bit rate switch
+    bool esi;                                           // FD error state indicator
+    mp_obj_t fd_data;                                   // Whole payload of an FD frame (bytes)
 } rp2_canframe_obj_t;
 
 typedef struct _rp2_canidfilter_obj_t {
@@ -121,7 +167,7 @@ typedef struct _rp2_canidfilter_obj_t {
 typedef struct _rp2_canerror_obj_t {
     mp_obj_base_t base;
     can_error_t error;                                  // Value of error register
-    uint32_t timestamp;                                 // Read from the controller
+    uint64_t timestamp;                                 // Read from the controller, extended to 64 bits
 } rp2_canerror_obj_t;
 
 typedef struct _rp2_canoverflow_obj_t {
@@ -129,7 +175,7 @@ typedef struct _rp2_canoverflow_obj_t {
     uint32_t error_cnt;
     uint32_t frame_cnt;    
     bool receive;                                       // Receive overflow
-    uint32_t timestamp;                                 // Timestamp associated with overflow
+    uint64_t timestamp;                                 // Timestamp associated with overflow
 } rp2_canoverflow_obj_t;
 
 extern const mp_obj_type_t rp2_can_type;
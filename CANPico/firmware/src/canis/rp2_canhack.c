@@ -24,6 +24,7 @@
 #include "py/obj.h"
 #include "pico/stdlib.h"
 #include "hardware/pwm.h"
+#include "hardware/sync.h"
 #include "rp2_canhack.h"
 #include "common.h"
 
@@ -53,6 +54,33 @@ typedef struct _canhack_rp2_obj_t {
     uint32_t bit_rate_kbps;
 } canhack_rp2_obj_t;
 
+// An action preloaded to be started from the CAN receive ISR when a controller trigger matches. The
+// frames and attack masks are set up when the action is armed so the ISR only has to run the attack.
+typedef struct {
+    volatile uint8_t action;                    // CANHACK_ACTION_NONE if not armed
+    bool one_shot;                              // Disarm after firing once
+    bool janus;                                 // Spoof with a Janus frame
+    uint32_t timeout;
+    uint32_t retries;
+    uint32_t repeat;                            // Error attack repeats
+    ctr_t sync_time;
+    ctr_t split_time;
+    uint32_t fired;                             // Number of times started
+    uint32_t succeeded;                         // Number of times the attack or transmission succeeded
+    uint32_t last_latency;                      // Microseconds from the triggering frame to the action starting
+    uint32_t max_latency;
+} canhack_trigger_action_t;
+
+STATIC canhack_trigger_action_t trigger_action;
+
+// Polling loops of the CANHack functions in one bit time at 500kbit/sec (the loop runs from RAM and takes
+// about 15 cycles at 125MHz; a bit is 250 cycles). Scaled up for slower bit rates.
+#define CANHACK_TRIGGER_LOOPS_PER_BIT       (16U)
+// A longest stuffed frame plus the interframe space, in bits: the default timeout of a triggered action
+#define CANHACK_TRIGGER_FRAME_BITS          (160U)
+// Longest timeout of a triggered action, in frame times
+#define CANHACK_TRIGGER_MAX_FRAMES          (4U)
+
 
 // Construct a CAN hack object.
 //
@@ -578,6 +606,135 @@ STATIC mp_obj_t rp2_canhack_freeze_doom_loop_attack(mp_uint_t n_args, const mp_o
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_canhack_freeze_doom_loop_attack_obj, 1, rp2_canhack_freeze_doom_loop_attack);
 
+void TIME_CRITICAL rp2_canhack_trigger_action(uint32_t latency)
+{
+    canhack_trigger_action_t *a = &trigger_action;
+    uint8_t action = a->action;
+
+    if (action == CANHACK_ACTION_NONE) {
+        return;
+    }
+    if (a->one_shot) {
+        a->action = CANHACK_ACTION_NONE;
+    }
+    a->fired++;
+    a->last_latency = latency;
+    if (latency > a->max_latency) {
+        a->max_latency = latency;
+    }
+
+    // Might already be called with interrupts locked so they are restored rather than enabled
+    uint32_t irq_state = save_and_disable_interrupts();
+    canhack_set_timeout(a->timeout);
+    bool ok;
+    switch (action) {
+        case CANHACK_ACTION_SEND:
+            ok = canhack_send_frame(a->retries, false);
+            break;
+        case CANHACK_ACTION_JANUS:
+            ok = canhack_send_janus_frame(a->sync_time, a->split_time, a->retries);
+            break;
+        case CANHACK_ACTION_SPOOF:
+            ok = canhack_spoof_frame(a->janus, a->sync_time, a->split_time, a->retries);
+            break;
+        default:
+            ok = canhack_error_attack(a->repeat, true, 0x7fU, 0x3fU);
+            break;
+    }
+    SET_CAN_TX_REC();
+    restore_interrupts(irq_state);
+
+    if (ok) {
+        a->succeeded++;
+    }
+}
+
+// Preload an action for a CAN controller receive trigger to start. The action runs in the CAN ISR with
+// interrupts disabled, so nothing else is serviced until it finishes: the timeout (in polling loops) defaults
+// to about one frame time and is clamped to CANHACK_TRIGGER_MAX_FRAMES frame times. The worst-case interrupt
+// latency while an action runs is therefore 640 bit times (1.3ms at 500kbit/s, 5.1ms at 125kbit/s) per try,
+// and each retry can take as long again. Other controllers' receive FIFOs and USB can overflow in that time.
+STATIC mp_obj_t rp2_canhack_arm_trigger_action(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+            { MP_QSTR_action,            MP_ARG_REQUIRED | MP_ARG_INT,  {.u_int = CANHACK_ACTION_SEND} },
+            { MP_QSTR_timeout,           MP_ARG_KW_ONLY  | MP_ARG_INT,  {.u_int = 0} },
+            { MP_QSTR_retries,           MP_ARG_KW_ONLY  | MP_ARG_INT,  {.u_int = 0} },
+            { MP_QSTR_janus,             MP_ARG_KW_ONLY  | MP_ARG_BOOL,  {.u_bool = false} },
+            { MP_QSTR_sync_time,         MP_ARG_KW_ONLY  | MP_ARG_INT,  {.u_int = 0} },
+            { MP_QSTR_split_time,        MP_ARG_KW_ONLY  | MP_ARG_INT,  {.u_int = 0} },
+            { MP_QSTR_repeat,            MP_ARG_KW_ONLY  | MP_ARG_INT,  {.u_int = 2U} },
+            { MP_QSTR_one_shot,          MP_ARG_KW_ONLY  | MP_ARG_BOOL,  {.u_bool = true} },
+    };
+
+    canhack_rp2_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_int_t action = args[0].u_int;
+    bool janus = args[3].u_bool;
+    uint32_t frame_loops = CANHACK_TRIGGER_FRAME_BITS * CANHACK_TRIGGER_LOOPS_PER_BIT * (500U / self->bit_rate_kbps);
+    uint32_t timeout = args[1].u_int > 0 ? (uint32_t)args[1].u_int : frame_loops;
+    if (timeout > frame_loops * CANHACK_TRIGGER_MAX_FRAMES) {
+        timeout = frame_loops * CANHACK_TRIGGER_MAX_FRAMES;
+    }
+
+    if (action < CANHACK_ACTION_SEND || action > CANHACK_ACTION_ERROR) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Unknown action"));
+    }
+    if (!canhack_get_frame(false)->frame_set) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "CAN frame has not been set"));
+    }
+    if ((action == CANHACK_ACTION_JANUS || (action == CANHACK_ACTION_SPOOF && janus)) && !canhack_get_frame(true)->frame_set) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Second CAN frame has not been set"));
+    }
+
+    // Disarm while the parameters change so that the ISR does not see a half-set action
+    trigger_action.action = CANHACK_ACTION_NONE;
+    if (action == CANHACK_ACTION_SPOOF || action == CANHACK_ACTION_ERROR) {
+        // Target a frame
+        canhack_set_attack_masks();
+    }
+    trigger_action.timeout = timeout;
+    trigger_action.retries = args[2].u_int;
+    trigger_action.janus = janus;
+    trigger_action.sync_time = args[4].u_int ? args[4].u_int : BIT_TIME / 4U;
+    trigger_action.split_time = args[5].u_int ? args[5].u_int : (BIT_TIME * 5U) / 8U;
+    trigger_action.repeat = args[6].u_int;
+    trigger_action.one_shot = args[7].u_bool;
+    trigger_action.fired = 0;
+    trigger_action.succeeded = 0;
+    trigger_action.last_latency = 0;
+    trigger_action.max_latency = 0;
+    trigger_action.action = (uint8_t)action;
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(rp2_canhack_arm_trigger_action_obj, 2, rp2_canhack_arm_trigger_action);
+
+STATIC mp_obj_t rp2_canhack_disarm_trigger_action(mp_obj_t self_in)
+{
+    trigger_action.action = CANHACK_ACTION_NONE;
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_canhack_disarm_trigger_action_obj, rp2_canhack_disarm_trigger_action);
+
+// Returns (armed, fired, succeeded, last_latency, max_latency) with latencies in microseconds
+STATIC mp_obj_t rp2_canhack_get_trigger_action_status(mp_obj_t self_in)
+{
+    mp_obj_t tuple[5];
+
+    tuple[0] = mp_obj_new_bool(trigger_action.action != CANHACK_ACTION_NONE);
+    tuple[1] = mp_obj_new_int_from_uint(trigger_action.fired);
+    tuple[2] = mp_obj_new_int_from_uint(trigger_action.succeeded);
+    tuple[3] = mp_obj_new_int_from_uint(trigger_action.last_latency);
+    tuple[4] = mp_obj_new_int_from_uint(trigger_action.max_latency);
+
+    return mp_obj_new_tuple(5, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(rp2_canhack_get_trigger_action_status_obj, rp2_canhack_get_trigger_action_status);
+
 STATIC mp_obj_t rp2_canhack_set_can_tx(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
 {
     static const mp_arg_t allowed_args[] = {
@@ -707,6 +864,15 @@ STATIC const mp_map_elem_t rp2_canhack_locals_dict_table[] = {
         { MP_OBJ_NEW_QSTR(MP_QSTR_get_clock), (mp_obj_t)&rp2_canhack_get_clock_obj },
         { MP_OBJ_NEW_QSTR(MP_QSTR_reset_clock), (mp_obj_t)&rp2_canhack_reset_clock_obj },
         { MP_OBJ_NEW_QSTR(MP_QSTR_send_raw), (mp_obj_t)&rp2_canhack_send_raw_obj },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_arm_trigger_action), (mp_obj_t)&rp2_canhack_arm_trigger_action_obj },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_disarm_trigger_action), (mp_obj_t)&rp2_canhack_disarm_trigger_action_obj },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_get_trigger_action_status), (mp_obj_t)&rp2_canhack_get_trigger_action_status_obj },
+
+        // class constants
+        { MP_OBJ_NEW_QSTR(MP_QSTR_ACTION_SEND), MP_OBJ_NEW_SMALL_INT(CANHACK_ACTION_SEND) },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_ACTION_JANUS), MP_OBJ_NEW_SMALL_INT(CANHACK_ACTION_JANUS) },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_ACTION_SPOOF), MP_OBJ_NEW_SMALL_INT(CANHACK_ACTION_SPOOF) },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_ACTION_ERROR), MP_OBJ_NEW_SMALL_INT(CANHACK_ACTION_ERROR) },
 };
 STATIC MP_DEFINE_CONST_DICT(rp2_canhack_locals_dict, rp2_canhack_locals_dict_table);
 
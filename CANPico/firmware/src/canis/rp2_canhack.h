@@ -111,7 +111,18 @@ static inline void init_ctr(uint div) {
     pwm_init(CANHACK_PWM, &c,true);
 }
 
+// Actions that a CAN controller receive trigger can start (see CAN.set_trigger(canhack=True))
+#define     CANHACK_ACTION_NONE             (0)
+#define     CANHACK_ACTION_SEND             (1U)     // Send frame 1 at the next bus idle
+#define     CANHACK_ACTION_JANUS            (2U)     // Send a Janus frame from frames 1 and 2 at the next bus idle
+#define     CANHACK_ACTION_SPOOF            (3U)     // Spoof the next frame matching frame 1
+#define     CANHACK_ACTION_ERROR            (4U)     // Destroy the next frame matching frame 1 with an error
+
 // MicroPython CANHack object
 extern const mp_obj_type_t rp2_canhack_type;
 
+// Run the armed trigger action (if any). Called from the CAN receive ISR with the microseconds since
+// the triggering frame was received.
+void rp2_canhack_trigger_action(uint32_t latency);
+
 #endif //MICROPYTHON_CANHACK_RP2_H
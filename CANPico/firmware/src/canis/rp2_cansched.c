@@ -0,0 +1,800 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "common.h"
+#include "rp2_can.h"
+#include "canfd.h"
+#include "rp2_cansched.h"
+#include "rp2_cansync.h"
+
+#include <hardware/timer.h>
+#include <hardware/sync.h>
+#include <py/runtime.h>
+#include <py/builtin.h>
+#include <py/stream.h>
+
+// Hardware alarm claimed when the first schedule is set (-1 if none claimed)
+STATIC int sched_alarm = -1;
+
+// Timed queue of each controller, kept out of the CAN object because it holds no heap pointers
+STATIC can_timed_frame_t sched_timed[CAN_MAX_CONTROLLERS][CAN_TIMED_QUEUE_SIZE];
+
+STATIC void TIME_CRITICAL sched_alarm_callback(uint alarm);
+
+////////////////////////////////////// Cyclic schedule //////////////////////////////////////
+
+STATIC inline uint64_t sched_due(can_sched_t *sched, uint32_t heap_idx)
+{
+    return sched->entries[sched->heap[heap_idx]].due;
+}
+
+STATIC void TIME_CRITICAL sched_heap_swap(can_sched_t *sched, uint32_t a, uint32_t b)
+{
+    uint16_t tmp = sched->heap[a];
+    sched->heap[a] = sched->heap[b];
+    sched->heap[b] = tmp;
+}
+
+STATIC void TIME_CRITICAL sched_sift_down(can_sched_t *sched, uint32_t i)
+{
+    for (;;) {
+        uint32_t smallest = i;
+        uint32_t left = 2U * i + 1U;
+        uint32_t right = left + 1U;
+
+        if (left < sched->n_heap && sched_due(sched, left) < sched_due(sched, smallest)) {
+            smallest = left;
+        }
+        if (right < sched->n_heap && sched_due(sched, right) < sched_due(sched, smallest)) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+        sched_heap_swap(sched, i, smallest);
+        i = smallest;
+    }
+}
+
+STATIC void sched_sift_up(can_sched_t *sched, uint32_t i)
+{
+    while (i > 0) {
+        uint32_t parent = (i - 1U) / 2U;
+        if (sched_due(sched, parent) <= sched_due(sched, i)) {
+            return;
+        }
+        sched_heap_swap(sched, i, parent);
+        i = parent;
+    }
+}
+
+// Send the cyclic frames that are due. Returns the time the next one is due, or UINT64_MAX if there is none.
+STATIC uint64_t TIME_CRITICAL sched_service_cyclic(rp2_can_obj_t *self, uint64_t now)
+{
+    can_sched_t *sched = &self->sched;
+
+    while (sched->n_heap > 0) {
+        can_sched_entry_t *entry = &sched->entries[sched->heap[0]];
+        if (entry->due > now) {
+            return entry->due;
+        }
+
+        uint64_t late = now - entry->due;
+        if (rp2_can_send_frame_copy(self, &entry->frame, entry->tag, sched->fifo, NULL) == CAN_ERC_NO_ERROR) {
+            entry->sent++;
+            if (late > entry->max_late) {
+                entry->max_late = (uint32_t)late;
+            }
+        }
+        else {
+            entry->skipped++;
+        }
+
+        bool last = (entry->period == 0) || (entry->remaining == 1U);
+        if (entry->remaining > 0) {
+            entry->remaining--;
+        }
+        if (last) {
+            // Finished with this entry so take it out of the heap
+            sched->n_heap--;
+            sched->heap[0] = sched->heap[sched->n_heap];
+        }
+        else {
+            // Stay in phase: if the alarm was held up for more than a period then skip the missed sends
+            entry->due += entry->period;
+            if (entry->due <= now) {
+                uint64_t missed = (now - entry->due) / entry->period + 1U;
+                entry->skipped += (uint32_t)missed;
+                entry->due += missed * entry->period;
+            }
+        }
+        sched_sift_down(sched, 0);
+    }
+
+    return UINT64_MAX;
+}
+
+////////////////////////////////////// Timed frames //////////////////////////////////////
+
+STATIC void TIME_CRITICAL timed_swap(can_sched_t *sched, uint32_t a, uint32_t b)
+{
+    can_timed_frame_t tmp = sched->timed[a];
+    sched->timed[a] = sched->timed[b];
+    sched->timed[b] = tmp;
+}
+
+STATIC void TIME_CRITICAL timed_sift_down(can_sched_t *sched, uint32_t i)
+{
+    for (;;) {
+        uint32_t smallest = i;
+        uint32_t left = 2U * i + 1U;
+        uint32_t right = left + 1U;
+
+        if (left < sched->n_timed && sched->timed[left].release < sched->timed[smallest].release) {
+            smallest = left;
+        }
+        if (right < sched->n_timed && sched->timed[right].release < sched->timed[smallest].release) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+        timed_swap(sched, i, smallest);
+        i = smallest;
+    }
+}
+
+// Add a frame to the timed queue (called with interrupts locked and with room in the queue)
+STATIC void timed_push(can_sched_t *sched, const can_timed_frame_t *timed)
+{
+    uint32_t i = sched->n_timed++;
+    sched->timed[i] = *timed;
+
+    while (i > 0) {
+        uint32_t parent = (i - 1U) / 2U;
+        if (sched->timed[parent].release <= sched->timed[i].release) {
+            return;
+        }
+        timed_swap(sched, i, parent);
+        i = parent;
+    }
+}
+
+// Send the timed frames that are due. Returns the time the next one is due, or UINT64_MAX if there is none.
+STATIC uint64_t TIME_CRITICAL sched_service_timed(rp2_can_obj_t *self, uint64_t now)
+{
+    can_sched_t *sched = &self->sched;
+
+    while (sched->n_timed > 0) {
+        can_timed_frame_t *timed = &sched->timed[0];
+        if (timed->release > now) {
+            return timed->release;
+        }
+        if (rp2_can_send_frame_copy(self, &timed->frame, timed->tag, timed->fifo, &timed->deadline) != CAN_ERC_NO_ERROR) {
+            // No room in the transmit queue: a late frame is better than a missing frame so try again soon
+            return now + CAN_SCHED_RETRY_US;
+        }
+        sched->n_timed--;
+        sched->timed[0] = sched->timed[sched->n_timed];
+        timed_sift_down(sched, 0);
+    }
+
+    return UINT64_MAX;
+}
+
+////////////////////////////////////// Replay //////////////////////////////////////
+
+STATIC inline uint32_t replay_timestamp(const uint8_t *record)
+{
+    return BIG_ENDIAN_WORD(record + 1U);
+}
+
+// Time a record is released in the current pass
+STATIC inline uint64_t replay_release(const can_replay_t *replay, const uint8_t *record)
+{
+    uint32_t t = replay_timestamp(record) - replay->t0;
+
+    return replay->start + (((uint64_t)t * replay->scale) >> 16);
+}
+
+// Only received frames are replayed (errors and overflows in a capture are skipped), filtered by ID
+STATIC bool TIME_CRITICAL replay_wanted(const can_replay_t *replay, const uint8_t *record)
+{
+    if ((record[0] & 0x0fU) != CAN_EVENT_TYPE_RECEIVED_FRAME) {
+        return false;
+    }
+    if (replay->ids.keys == NULL) {
+        return true;
+    }
+    uint32_t id_word = BIG_ENDIAN_WORD(record + 7U);
+    bool extended = (id_word & (1U << 29)) != 0;
+    uint32_t arbitration_id = extended ? (id_word & CAN_ID_ARBITRATION_ID) : ((id_word >> 18) & 0x7ffU);
+
+    return canfilter_idset_contains(&replay->ids, CANFILTER_IDSET_KEY(extended, arbitration_id));
+}
+
+STATIC void TIME_CRITICAL replay_make_frame(can_frame_t *frame, const uint8_t *record)
+{
+    uint32_t id_word = BIG_ENDIAN_WORD(record + 7U);
+    bool extended = (id_word & (1U << 29)) != 0;
+    uint32_t arbitration_id = extended ? (id_word & CAN_ID_ARBITRATION_ID) : ((id_word >> 18) & 0x7ffU);
+
+    can_make_frame(frame, extended, arbitration_id, record[5], record + 11U, (record[0] & 0x80U) != 0);
+}
+
+// Send the replayed frames that are due. Returns the time the next one is due, or UINT64_MAX if there is none.
+STATIC uint64_t TIME_CRITICAL sched_service_replay(rp2_can_obj_t *self, uint64_t now)
+{
+    can_replay_t *replay = &self->sched.replay;
+
+    while (replay->records != NULL) {
+        if (replay->next >= replay->n_records) {
+            if (!replay->loop) {
+                replay->records = NULL;
+                replay->capture = MP_OBJ_NULL;
+                break;
+            }
+            // The next pass starts a gap after the last record of this one
+            const uint8_t *last = replay->records + (replay->n_records - 1U) * CAN_RX_RECORD_BYTES;
+            replay->start = replay_release(replay, last) + replay->gap;
+            replay->next = 0;
+            replay->passes++;
+        }
+
+        const uint8_t *record = replay->records + replay->next * CAN_RX_RECORD_BYTES;
+        if (!replay_wanted(replay, record)) {
+            replay->next++;
+            continue;
+        }
+        uint64_t release = replay_release(replay, record);
+        if (release > now) {
+            return release;
+        }
+        can_frame_t frame;
+        replay_make_frame(&frame, record);
+        if (rp2_can_send_frame_copy(self, &frame, 0, replay->fifo, NULL) != CAN_ERC_NO_ERROR) {
+            // No room in the transmit queue: try again soon (the lateness is counted when it goes)
+            return now + CAN_SCHED_RETRY_US;
+        }
+        uint32_t late = (uint32_t)(now - release);
+        replay->sent++;
+        replay->total_late += late;
+        if (late > replay->max_late) {
+            replay->max_late = late;
+        }
+        replay->next++;
+    }
+
+    return UINT64_MAX;
+}
+
+////////////////////////////////////// Alarm service //////////////////////////////////////
+
+// Work out when the alarm next needs to go off
+STATIC uint64_t TIME_CRITICAL sched_service(rp2_can_obj_t *self, uint64_t now)
+{
+    if (rp2_can_spi_busy()) {
+        return now + CAN_SCHED_RETRY_US;
+    }
+
+    uint64_t next = sched_service_cyclic(self, now);
+    uint64_t next_timed = sched_service_timed(self, now);
+    if (next_timed < next) {
+        next = next_timed;
+    }
+    uint64_t next_sync = can_sync_service(self, now);
+    if (next_sync < next) {
+        next = next_sync;
+    }
+    uint64_t next_replay = sched_service_replay(self, now);
+    if (next_replay < next) {
+        next = next_replay;
+    }
+
+    return next;
+}
+
+STATIC void TIME_CRITICAL sched_alarm_callback(uint alarm)
+{
+    // One alarm serves the schedules of all the controllers
+    for (;;) {
+        uint64_t next = UINT64_MAX;
+        for (uint32_t i = 0; i < CAN_MAX_CONTROLLERS; i++) {
+            rp2_can_obj_t *self = MP_STATE_PORT(rp2_can_obj[i]);
+            // Guard against the alarm going off after the controller has gone
+            if (self != MP_OBJ_NULL) {
+                uint64_t next_self = sched_service(self, time_us_64());
+                if (next_self < next) {
+                    next = next_self;
+                }
+            }
+        }
+        if (next == UINT64_MAX) {
+            return;
+        }
+        // If the time has already passed then go round again rather than wait for the timer to wrap
+        if (!hardware_alarm_set_target(alarm, from_us_since_boot(next))) {
+            return;
+        }
+    }
+}
+
+// Re-evaluate the next alarm after the schedule has been changed (called with interrupts locked, or from
+// an ISR of the same priority as the alarm)
+void TIME_CRITICAL can_sched_kick(void)
+{
+    if (sched_alarm >= 0) {
+        // Set the alarm to go off almost straight away and the callback works out the next time
+        uint64_t t = time_us_64();
+        do {
+            t += CAN_SCHED_RETRY_US;
+        } while (hardware_alarm_set_target(sched_alarm, from_us_since_boot(t)));
+    }
+}
+
+void can_sched_claim_alarm(void)
+{
+    if (sched_alarm < 0) {
+        sched_alarm = hardware_alarm_claim_unused(false);
+        if (sched_alarm < 0) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_RuntimeError, "No hardware alarm free"));
+        }
+        hardware_alarm_set_callback(sched_alarm, sched_alarm_callback);
+    }
+}
+
+void can_sched_init(void)
+{
+    sched_alarm = -1;
+}
+
+void can_sched_deinit(void)
+{
+    if (sched_alarm >= 0) {
+        hardware_alarm_cancel(sched_alarm);
+        hardware_alarm_set_callback(sched_alarm, NULL);
+        hardware_alarm_unclaim(sched_alarm);
+        sched_alarm = -1;
+    }
+}
+
+// Called when the controller is set up again: nothing scheduled carries over
+void can_sched_reset(rp2_can_obj_t *self)
+{
+    uint32_t state = save_and_disable_interrupts();
+    self->sched.entries = NULL;
+    self->sched.heap = NULL;
+    self->sched.n_entries = 0;
+    self->sched.n_heap = 0;
+    self->sched.timed = sched_timed[self->index];
+    self->sched.n_timed = 0;
+    self->sched.replay.records = NULL;
+    self->sched.replay.capture = MP_OBJ_NULL;
+    restore_interrupts(state);
+}
+
+/////////////////////////////////////// MicroPython bindings ///////////////////////////////////////
+
+// Set a cyclic schedule of frames to send. Each entry is a tuple of (frame, period, offset, count), where
+// period and offset are in microseconds and count is the number of times to send the frame (offset and
+// count are optional; a count of 0 sends forever and a period of 0 sends once). Offsets are relative to a
+// common start time so that frames can be phased against each other. A copy of each frame is taken, and
+// the payload can be changed with set_schedule_data(). Passing None (or an empty list) stops the schedule.
+STATIC mp_obj_t rp2_can_set_schedule(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_entries,   MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = mp_const_none}},
+        {MP_QSTR_fifo,      MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
+    };
+
+    rp2_can_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_obj_t mp_entries = args[0].u_obj;
+    bool fifo = args[1].u_bool;
+
+    size_t n_entries = 0;
+    mp_obj_t *items = NULL;
+    if (mp_entries != mp_const_none) {
+        mp_obj_get_array(mp_entries, &n_entries, &items);
+    }
+    if (n_entries > CAN_SCHED_MAX_ENTRIES) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Too many entries (max %d)", (int)CAN_SCHED_MAX_ENTRIES));
+    }
+
+    can_sched_entry_t *entries = NULL;
+    uint16_t *heap = NULL;
+    if (n_entries > 0) {
+        can_sched_claim_alarm();
+        entries = m_new(can_sched_entry_t, n_entries);
+        heap = m_new(uint16_t, n_entries);
+    }
+
+    // Build the new schedule, with all offsets relative to the same start time
+    uint64_t start = time_us_64() + CAN_SCHED_START_US;
+    for (size_t i = 0; i < n_entries; i++) {
+        size_t len;
+        mp_obj_t *elems;
+        mp_obj_get_array(items[i], &len, &elems);
+        if (len < 2U || len > 4U) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Entry must be (frame, period, offset, count)"));
+        }
+        rp2_canframe_obj_t *mp_frame = elems[0];
+        if (!MP_OBJ_IS_TYPE(mp_frame, &rp2_canframe_type)) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_TypeError, "CANFrame expected"));
+        }
+        rp2_can_check_classic(mp_frame);
+        mp_int_t period = mp_obj_get_int(elems[1]);
+        mp_int_t offset = len > 2U ? mp_obj_get_int(elems[2]) : 0;
+        mp_int_t count = len > 3U ? mp_obj_get_int(elems[3]) : 0;
+        if (period < 0 || offset < 0 || count < 0) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Period, offset and count must not be negative"));
+        }
+
+        can_sched_entry_t *entry = &entries[i];
+        entry->frame = mp_frame->frame;
+        entry->tag = mp_frame->tag;
+        entry->period = period;
+        entry->remaining = count;
+        entry->due = start + offset;
+        entry->sent = 0;
+        entry->skipped = 0;
+        entry->max_late = 0;
+        heap[i] = i;
+    }
+
+    // The timed queue is left alone
+    uint32_t state = save_and_disable_interrupts();
+    can_sched_t *sched = &self->sched;
+    sched->entries = entries;
+    sched->heap = heap;
+    sched->n_entries = n_entries;
+    sched->n_heap = 0;
+    sched->fifo = fifo;
+    for (size_t i = 0; i < n_entries; i++) {
+        sched->n_heap++;
+        sched_sift_up(sched, i);
+    }
+    can_sched_kick();
+    restore_interrupts(state);
+
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_set_schedule_obj, 2, rp2_can_set_schedule);
+
+// Change the payload of a scheduled frame. The new data must be the same length as the old, and the
+// change is made with interrupts locked so a frame is never sent with half old and half new data.
+STATIC mp_obj_t rp2_can_set_schedule_data(mp_obj_t self_in, mp_obj_t index_in, mp_obj_t data_in)
+{
+    rp2_can_obj_t *self = self_in;
+    can_sched_t *sched = &self->sched;
+    mp_int_t index = mp_obj_get_int(index_in);
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(data_in, &bufinfo, MP_BUFFER_READ);
+
+    if (index < 0 || index >= (mp_int_t)sched->n_entries) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_IndexError, "No such schedule entry"));
+    }
+    can_frame_t *frame = &sched->entries[index].frame;
+    if (bufinfo.len != can_frame_get_data_len(frame)) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Data must be %d bytes", (int)can_frame_get_data_len(frame)));
+    }
+
+    uint32_t state = save_and_disable_interrupts();
+    memcpy(can_frame_get_data(frame), bufinfo.buf, bufinfo.len);
+    restore_interrupts(state);
+
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_3(rp2_can_set_schedule_data_obj, rp2_can_set_schedule_data);
+
+// Return a list of (sent, skipped, max_late) tuples, one for each entry in the schedule
+STATIC mp_obj_t rp2_can_get_schedule_stats(mp_obj_t self_in)
+{
+    rp2_can_obj_t *self = self_in;
+    can_sched_t *sched = &self->sched;
+
+    mp_obj_list_t *list = mp_obj_new_list(sched->n_entries, NULL);
+    for (size_t i = 0; i < sched->n_entries; i++) {
+        can_sched_entry_t *entry = &sched->entries[i];
+        uint32_t state = save_and_disable_interrupts();
+        uint32_t sent = entry->sent;
+        uint32_t skipped = entry->skipped;
+        uint32_t max_late = entry->max_late;
+        restore_interrupts(state);
+
+        mp_obj_tuple_t *tuple = mp_obj_new_tuple(3U, NULL);
+        tuple->items[0] = mp_obj_new_int_from_uint(sent);
+        tuple->items[1] = mp_obj_new_int_from_uint(skipped);
+        tuple->items[2] = mp_obj_new_int_from_uint(max_late);
+        list->items[i] = tuple;
+    }
+
+    return list;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(rp2_can_get_schedule_stats_obj, rp2_can_get_schedule_stats);
+
+// A controller time is converted into RP2040 time from a pair of samples of the two clocks. The controller
+// timestamp counter ticks at 1MHz (see get_time_hz()) like the RP2040 timer, so the two only differ by an
+// offset. Times within 35 minutes either side of the samples convert correctly.
+typedef struct {
+    uint64_t local;
+    uint32_t controller;
+} sched_time_pair_t;
+
+STATIC void sched_sample_time(rp2_can_obj_t *self, sched_time_pair_t *pair)
+{
+    pair->local = time_us_64();
+    pair->controller = rp2_can_read_time(self);
+}
+
+STATIC void sched_make_timed(can_timed_frame_t *timed, mp_obj_t frame_in, mp_obj_t t_in, bool fifo, uint32_t lead, const sched_time_pair_t *pair)
+{
+    rp2_canframe_obj_t *mp_frame = frame_in;
+    if (!MP_OBJ_IS_TYPE(mp_frame, &rp2_canframe_type)) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_TypeError, "CANFrame expected"));
+    }
+    rp2_can_check_classic(mp_frame);
+    uint32_t t = mp_obj_get_int_truncated(t_in);
+
+    timed->frame = mp_frame->frame;
+    timed->tag = mp_frame->tag;
+    timed->deadline = t;
+    timed->release = pair->local + (int64_t)(int32_t)(t - pair->controller) - lead;
+    timed->fifo = fifo;
+}
+
+// Send a frame at a given controller time (as returned by get_time() and used for timestamps). A copy of
+// the frame is held until just before the time and then put into the transmit queue. The transmit event is
+// returned by recv_tx_events() as (tag, timestamp, error), where error is the transmit timestamp minus the
+// requested time in microseconds. A frame with a time in the past is sent straight away.
+STATIC mp_obj_t rp2_can_send_frame_at(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_frame,     MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = mp_const_none}},
+        {MP_QSTR_t,         MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = mp_const_none}},
+        {MP_QSTR_fifo,      MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
+        {MP_QSTR_lead,      MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = CAN_SCHED_LEAD_US}},
+    };
+
+    rp2_can_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    bool fifo = args[2].u_bool;
+    mp_int_t lead = args[3].u_int;
+    if (lead < 0) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "lead must not be negative"));
+    }
+
+    can_sched_claim_alarm();
+    sched_time_pair_t pair;
+    sched_sample_time(self, &pair);
+    can_timed_frame_t timed;
+    sched_make_timed(&timed, args[0].u_obj, args[1].u_obj, fifo, lead, &pair);
+
+    uint32_t state = save_and_disable_interrupts();
+    if (self->sched.n_timed >= CAN_TIMED_QUEUE_SIZE) {
+        restore_interrupts(state);
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "No room in timed queue"));
+    }
+    timed_push(&self->sched, &timed);
+    can_sched_kick();
+    restore_interrupts(state);
+
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_send_frame_at_obj, 3, rp2_can_send_frame_at);
+
+// Send a list of (frame, t) tuples as for send_frame_at(). Either all the frames are queued or none are.
+STATIC mp_obj_t rp2_can_send_frames_at(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_frames,    MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = mp_const_none}},
+        {MP_QSTR_fifo,      MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
+        {MP_QSTR_lead,      MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = CAN_SCHED_LEAD_US}},
+    };
+
+    rp2_can_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    bool fifo = args[1].u_bool;
+    mp_int_t lead = args[2].u_int;
+    if (lead < 0) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "lead must not be negative"));
+    }
+
+    size_t n_frames;
+    mp_obj_t *items;
+    mp_obj_get_array(args[0].u_obj, &n_frames, &items);
+    if (n_frames > CAN_TIMED_QUEUE_SIZE) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "No room in timed queue"));
+    }
+
+    can_sched_claim_alarm();
+    sched_time_pair_t pair;
+    sched_sample_time(self, &pair);
+    can_timed_frame_t timed;
+    // First pass checks the entries (so nothing is raised with interrupts locked)
+    for (size_t i = 0; i < n_frames; i++) {
+        size_t len;
+        mp_obj_t *elems;
+        mp_obj_get_array(items[i], &len, &elems);
+        if (len != 2U) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Entry must be (frame, t)"));
+        }
+        sched_make_timed(&timed, elems[0], elems[1], fifo, lead, &pair);
+    }
+
+    uint32_t state = save_and_disable_interrupts();
+    if (self->sched.n_timed + n_frames > CAN_TIMED_QUEUE_SIZE) {
+        restore_interrupts(state);
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "No room in timed queue"));
+    }
+    for (size_t i = 0; i < n_frames; i++) {
+        size_t len;
+        mp_obj_t *elems;
+        mp_obj_get_array(items[i], &len, &elems);
+        sched_make_timed(&timed, elems[0], elems[1], fifo, lead, &pair);
+        timed_push(&self->sched, &timed);
+    }
+    can_sched_kick();
+    restore_interrupts(state);
+
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_send_frames_at_obj, 2, rp2_can_send_frames_at);
+
+// Replay a capture of frames in the binary format returned by recv(as_bytes=True), given as a bytes-like
+// object or as the name of a file (read into RAM), releasing each frame at its original time relative to the
+// first record divided by the speed. Only received frame records are replayed, and if a list of IDs (ints or
+// CANIDs) is given then only frames with those IDs. With loop set the capture is replayed again, starting a
+// gap (in microseconds) after the last record. The capture must not be changed while it is being replayed.
+// Passing None stops the replay.
+STATIC mp_obj_t rp2_can_replay(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_capture,   MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = mp_const_none}},
+        {MP_QSTR_speed,     MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = MP_OBJ_NEW_SMALL_INT(1)}},
+        {MP_QSTR_loop,      MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
+        {MP_QSTR_gap,       MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = CAN_SCHED_START_US}},
+        {MP_QSTR_ids,       MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none}},
+        {MP_QSTR_extended,  MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
+        {MP_QSTR_fifo,      MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
+    };
+
+    rp2_can_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_obj_t capture = args[0].u_obj;
+    mp_int_t gap = args[3].u_int;
+    mp_obj_t ids = args[4].u_obj;
+    bool extended_default = args[5].u_bool;
+
+    can_replay_t replay;
+    // Not replaying, with no ID filter and the statistics cleared
+    memset(&replay, 0, sizeof(replay));
+
+    if (capture != mp_const_none) {
+        if (mp_obj_is_str(capture)) {
+            // Read the whole file: the alarm ISR cannot read from the filesystem
+            mp_obj_t file = mp_call_function_2(MP_OBJ_FROM_PTR(&mp_builtin_open_obj), capture, MP_OBJ_NEW_QSTR(MP_QSTR_rb));
+            mp_obj_t dest[2];
+            mp_load_method(file, MP_QSTR_read, dest);
+            capture = mp_call_method_n_kw(0, 0, dest);
+            mp_stream_close(file);
+        }
+        mp_buffer_info_t bufinfo;
+        mp_get_buffer_raise(capture, &bufinfo, MP_BUFFER_READ);
+        if ((bufinfo.len % CAN_RX_RECORD_BYTES) != 0) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Capture must be a multiple of %d bytes", CAN_RX_RECORD_BYTES));
+        }
+        // Replay walks the capture in fixed-size records, so variable-size FD records cannot be skipped over
+        for (size_t i = 0; i < bufinfo.len; i += CAN_RX_RECORD_BYTES) {
+            if (((const uint8_t *)bufinfo.buf)[i] & CANFD_FLAG_FD) {
+                nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Capture contains CAN FD frames, which cannot be replayed"));
+            }
+        }
+        mp_float_t speed = mp_obj_get_float(args[1].u_obj);
+        if (speed < 0.001 || speed > 1000.0) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "speed must be 0.001 to 1000"));
+        }
+        if (gap < 0) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "gap must not be negative"));
+        }
+
+        if (ids != mp_const_none) {
+            size_t n_ids;
+            mp_obj_t *items;
+            mp_obj_get_array(ids, &n_ids, &items);
+            size_t size = canfilter_idset_size(n_ids);
+            uint32_t *keys = m_new(uint32_t, size);
+            canfilter_idset_init(&replay.ids, keys, size);
+            for (size_t i = 0; i < n_ids; i++) {
+                bool extended;
+                uint32_t lo;
+                uint32_t hi;
+                rp2_can_get_id_range(items[i], extended_default, &extended, &lo, &hi);
+                if (lo != hi) {
+                    nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Replay IDs must be single IDs"));
+                }
+                canfilter_idset_add(&replay.ids, CANFILTER_IDSET_KEY(extended, lo));
+            }
+        }
+
+        replay.records = bufinfo.buf;
+        replay.capture = capture;
+        replay.n_records = bufinfo.len / CAN_RX_RECORD_BYTES;
+        replay.scale = (uint32_t)(MICROPY_FLOAT_CONST(65536.0) / speed);
+        replay.gap = gap;
+        replay.loop = args[2].u_bool;
+        replay.fifo = args[6].u_bool;
+
+        // Something must be sent on each pass, otherwise a looping replay would never wait for the alarm
+        bool any = false;
+        for (uint32_t i = 0; i < replay.n_records && !any; i++) {
+            any = replay_wanted(&replay, replay.records + i * CAN_RX_RECORD_BYTES);
+        }
+        if (!any) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "No frames to replay"));
+        }
+        replay.t0 = replay_timestamp(replay.records);
+        can_sched_claim_alarm();
+        replay.start = time_us_64() + CAN_SCHED_START_US;
+    }
+
+    uint32_t state = save_and_disable_interrupts();
+    self->sched.replay = replay;
+    can_sched_kick();
+    restore_interrupts(state);
+
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_replay_obj, 2, rp2_can_replay);
+
+// Returns (active, passes, sent, max_late, mean_late), lateness being how long after its original relative
+// time (scaled by the speed) a frame was put into the transmit queue, in microseconds
+STATIC mp_obj_t rp2_can_get_replay_stats(mp_obj_t self_in)
+{
+    rp2_can_obj_t *self = self_in;
+    can_replay_t *replay = &self->sched.replay;
+
+    uint32_t state = save_and_disable_interrupts();
+    bool active = replay->records != NULL;
+    uint32_t passes = replay->passes;
+    uint32_t sent = replay->sent;
+    uint32_t max_late = replay->max_late;
+    uint64_t total_late = replay->total_late;
+    restore_interrupts(state);
+
+    mp_obj_t tuple[5];
+    tuple[0] = mp_obj_new_bool(active);
+    tuple[1] = mp_obj_new_int_from_uint(passes);
+    tuple[2] = mp_obj_new_int_from_uint(sent);
+    tuple[3] = mp_obj_new_int_from_uint(max_late);
+    tuple[4] = mp_obj_new_int_from_uint(sent > 0 ? (uint32_t)(total_late / sent) : 0);
+
+    return mp_obj_new_tuple(5, tuple);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(rp2_can_get_replay_stats_obj, rp2_can_get_replay_stats);
@@ -0,0 +1,53 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef MICROPYTHON_CANSCHED_H
+#define MICROPYTHON_CANSCHED_H
+
+#include "py/obj.h"
+
+#include "rp2_can.h"
+
+// Scheduled transmission for the CAN class. A single hardware alarm is shared by everything that has to
+// put frames into the transmit queues at a given time, so that frames are queued from interrupt context
+// rather than by Python loops.
+
+// How long to wait before trying again if the alarm goes off while the main thread is in the CAN driver
+#define CAN_SCHED_RETRY_US                  (10U)
+// Time from setting a schedule to the first frames being sent (allows the alarm to be set up)
+#define CAN_SCHED_START_US                  (1000U)
+// Default time before its deadline that a timed frame is put into the transmit queue (covers the time
+// taken by the alarm ISR and the SPI transfer to the controller)
+#define CAN_SCHED_LEAD_US                   (50U)
+
+void can_sched_init(void);
+void can_sched_deinit(void);
+void can_sched_reset(rp2_can_obj_t *self);
+// Claim the hardware alarm (raises an exception if there is none free)
+void can_sched_claim_alarm(void);
+// Make the alarm go off soon so that the next alarm time is worked out again
+void can_sched_kick(void);
+
+// Methods of the CAN class
+MP_DECLARE_CONST_FUN_OBJ_KW(rp2_can_set_schedule_obj);
+MP_DECLARE_CONST_FUN_OBJ_3(rp2_can_set_schedule_data_obj);
+MP_DECLARE_CONST_FUN_OBJ_1(rp2_can_get_schedule_stats_obj);
+MP_DECLARE_CONST_FUN_OBJ_KW(rp2_can_send_frame_at_obj);
+MP_DECLARE_CONST_FUN_OBJ_KW(rp2_can_send_frames_at_obj);
+MP_DECLARE_CONST_FUN_OBJ_KW(rp2_can_replay_obj);
+MP_DECLARE_CONST_FUN_OBJ_1(rp2_can_get_replay_stats_obj);
+
+#endif // MICROPYTHON_CANSCHED_H
@@ -0,0 +1,336 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "common.h"
+#include "rp2_can.h"
+#include "rp2_cansched.h"
+#include "rp2_cansync.h"
+
+#include <hardware/timer.h>
+#include <hardware/sync.h>
+#include <py/runtime.h>
+
+// Drift limit as a 32.32 fixed point fraction
+#define SYNC_MAX_DRIFT                      (((int64_t)CAN_SYNC_MAX_DRIFT_PPM << 32) / 1000000)
+
+STATIC bool TIME_CRITICAL sync_is_frame(const can_sync_t *sync, const can_frame_t *frame, uint32_t id)
+{
+    return !can_frame_is_remote(frame) && (can_frame_is_extended(frame) == sync->extended) && (can_frame_get_arbitration_id(frame) == id);
+}
+
+STATIC inline int64_t sync_abs(int64_t x)
+{
+    return x < 0 ? -x : x;
+}
+
+// Offset (master time - local time) predicted for a local time
+STATIC inline int64_t sync_predict(const can_sync_t *sync, uint64_t t)
+{
+    return sync->offset + ((sync->drift * (int64_t)(t - sync->t_ref)) >> 32);
+}
+
+////////////////////////////////////// Master //////////////////////////////////////
+
+uint64_t TIME_CRITICAL can_sync_service(rp2_can_obj_t *self, uint64_t now)
+{
+    can_sync_t *sync = &self->sync;
+
+    if (sync->role != CAN_SYNC_MASTER) {
+        return UINT64_MAX;
+    }
+
+    uint64_t next = sync->next_sync;
+    can_frame_t frame;
+
+    if (sync->fup_pending) {
+        uint8_t data[8];
+        data[0] = sync->seq;
+        for (uint32_t i = 1U; i < 8U; i++) {
+            data[i] = (uint8_t)(sync->fup_timestamp >> (8U * (7U - i)));
+        }
+        can_make_frame(&frame, sync->extended, sync->fup_id, 8U, data, false);
+        if (rp2_can_send_frame_copy(self, &frame, 0, false, NULL) == CAN_ERC_NO_ERROR) {
+            sync->fup_pending = false;
+        }
+        else if (now + CAN_SCHED_RETRY_US < next) {
+            // Transmit queue full: try again shortly
+            next = now + CAN_SCHED_RETRY_US;
+        }
+    }
+
+    if (now >= sync->next_sync) {
+        // A follow-up that has not gone yet is for an old SYNC frame so is dropped
+        sync->seq++;
+        sync->fup_pending = false;
+        sync->awaiting_tx = true;
+        can_make_frame(&frame, sync->extended, sync->sync_id, 1U, &sync->seq, false);
+        if (rp2_can_send_frame_copy(self, &frame, 0, false, NULL) != CAN_ERC_NO_ERROR) {
+            sync->awaiting_tx = false;
+        }
+        sync->next_sync += sync->period;
+        if (sync->next_sync <= now) {
+            // Fell behind (e.g. the driver was busy for a long time) so start again from now
+            sync->next_sync = now + sync->period;
+        }
+        next = sync->next_sync;
+    }
+
+    return next;
+}
+
+void TIME_CRITICAL can_sync_on_tx(rp2_can_obj_t *self, const can_frame_t *frame, uint64_t timestamp)
+{
+    can_sync_t *sync = &self->sync;
+
+    if (sync->role == CAN_SYNC_MASTER && sync->awaiting_tx && sync_is_frame(sync, frame, sync->sync_id)) {
+        sync->awaiting_tx = false;
+        sync->fup_timestamp = timestamp;
+        sync->fup_pending = true;
+        // Get the alarm to send the follow-up now rather than wait until the next SYNC frame
+        can_sched_kick();
+    }
+}
+
+////////////////////////////////////// Slave //////////////////////////////////////
+
+// Steer the offset and drift estimate towards a measured offset at local time t. The offset is corrected by
+// half the error each time and the drift by a quarter of the error rate, which filters out the jitter of
+// a single measurement.
+STATIC void TIME_CRITICAL sync_servo(can_sync_t *sync, int64_t measured, uint64_t t)
+{
+    if (sync->n_updates == 0) {
+        // First measurement: jump straight to it
+        sync->offset = measured;
+        sync->drift = 0;
+        sync->t_ref = t;
+        sync->last_error = 0;
+        sync->n_updates = 1U;
+        sync->locked = false;
+        return;
+    }
+
+    int64_t dt = (int64_t)(t - sync->t_ref);
+    if (dt <= 0) {
+        return;
+    }
+    int64_t predicted = sync_predict(sync, t);
+    int64_t error = measured - predicted;
+
+    if (sync_abs(error) > CAN_SYNC_STEP_US) {
+        // Too far out to steer: start again from this measurement
+        sync->n_updates = 0;
+        sync_servo(sync, measured, t);
+        sync->last_error = error > 0 ? INT32_MAX : INT32_MIN;
+        return;
+    }
+
+    int64_t drift;
+    if (sync->n_updates == 1U) {
+        // Second measurement: the first estimate of drift comes straight from the two measurements
+        drift = (error << 32) / dt;
+        sync->offset = measured;
+    }
+    else {
+        drift = sync->drift + ((error << 32) / dt) / 4;
+        sync->offset = predicted + error / 2;
+    }
+    if (drift > SYNC_MAX_DRIFT) {
+        drift = SYNC_MAX_DRIFT;
+    }
+    else if (drift < -SYNC_MAX_DRIFT) {
+        drift = -SYNC_MAX_DRIFT;
+    }
+    sync->drift = drift;
+    sync->t_ref = t;
+    sync->last_error = (int32_t)error;
+    sync->locked = sync_abs(error) <= CAN_SYNC_LOCK_US;
+    sync->n_updates++;
+}
+
+void TIME_CRITICAL can_sync_on_rx(rp2_can_obj_t *self, const can_frame_t *frame, uint64_t timestamp)
+{
+    can_sync_t *sync = &self->sync;
+
+    if (sync->role != CAN_SYNC_SLAVE) {
+        return;
+    }
+    if (sync_is_frame(sync, frame, sync->sync_id) && can_frame_get_data_len(frame) >= 1U) {
+        sync->seq = can_frame_get_data((can_frame_t *)frame)[0];
+        sync->sync_rx_timestamp = timestamp;
+        sync->sync_rx_valid = true;
+    }
+    else if (sync_is_frame(sync, frame, sync->fup_id) && can_frame_get_data_len(frame) == 8U) {
+        const uint8_t *data = can_frame_get_data((can_frame_t *)frame);
+        // Only use a follow-up that goes with the last SYNC frame received
+        if (sync->sync_rx_valid && data[0] == sync->seq) {
+            uint64_t master = 0;
+            for (uint32_t i = 1U; i < 8U; i++) {
+                master = (master << 8) | data[i];
+            }
+            sync->sync_rx_valid = false;
+            sync_servo(sync, (int64_t)(master - sync->sync_rx_timestamp), sync->sync_rx_timestamp);
+        }
+    }
+}
+
+// Called when the controller is set up again
+// Called from the ISRs as frames are timestamped, and from the main thread (so the servo state is locked)
+bool TIME_CRITICAL can_sync_master_time(rp2_can_obj_t *self, uint64_t t, uint64_t *master)
+{
+    bool ok = true;
+
+    uint32_t state = save_and_disable_interrupts();
+    const can_sync_t *sync = &self->sync;
+    if (sync->role != CAN_SYNC_SLAVE) {
+        *master = t;
+    }
+    else if (sync->n_updates == 0) {
+        ok = false;
+    }
+    else {
+        *master = t + sync_predict(sync, t);
+    }
+    restore_interrupts(state);
+
+    return ok;
+}
+
+void can_sync_reset(rp2_can_obj_t *self)
+{
+    uint32_t state = save_and_disable_interrupts();
+    memset(&self->sync, 0, sizeof(self->sync));
+    self->sync.role = CAN_SYNC_OFF;
+    restore_interrupts(state);
+}
+
+/////////////////////////////////////// MicroPython bindings ///////////////////////////////////////
+
+// Start time synchronization as CAN.SYNC_MASTER or CAN.SYNC_SLAVE, or stop it with CAN.SYNC_OFF. The master
+// sends a SYNC frame every period microseconds, followed by a follow-up frame with the time it was sent.
+// SYNC and follow-up frames are sent through the priority queue with a tag of 0, so they show up in the
+// transmit events. A slave must have filters that let the two frames through.
+STATIC mp_obj_t rp2_can_set_sync(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_role,      MP_ARG_REQUIRED | MP_ARG_INT, {.u_int = CAN_SYNC_OFF}},
+        {MP_QSTR_period,    MP_ARG_KW_ONLY | MP_ARG_INT,  {.u_int = CAN_SYNC_DEFAULT_PERIOD_US}},
+        {MP_QSTR_sync_id,   MP_ARG_KW_ONLY | MP_ARG_INT,  {.u_int = CAN_SYNC_DEFAULT_SYNC_ID}},
+        {MP_QSTR_fup_id,    MP_ARG_KW_ONLY | MP_ARG_INT,  {.u_int = CAN_SYNC_DEFAULT_FUP_ID}},
+        {MP_QSTR_extended,  MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
+    };
+
+    rp2_can_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_int_t role = args[0].u_int;
+    mp_int_t period = args[1].u_int;
+    mp_int_t sync_id = args[2].u_int;
+    mp_int_t fup_id = args[3].u_int;
+    bool extended = args[4].u_bool;
+    mp_int_t max_id = extended ? 0x1fffffff : 0x7ff;
+
+    if (role != CAN_SYNC_OFF && role != CAN_SYNC_MASTER && role != CAN_SYNC_SLAVE) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Invalid role"));
+    }
+    if (period < (mp_int_t)CAN_SYNC_MIN_PERIOD_US) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "Period must be at least %d", (int)CAN_SYNC_MIN_PERIOD_US));
+    }
+    if (sync_id < 0 || sync_id > max_id || fup_id < 0 || fup_id > max_id) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "ID out of range"));
+    }
+    if (sync_id == fup_id) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "SYNC and follow-up IDs must be different"));
+    }
+    if (role == CAN_SYNC_MASTER) {
+        can_sched_claim_alarm();
+    }
+
+    can_sync_reset(self);
+
+    uint32_t state = save_and_disable_interrupts();
+    can_sync_t *sync = &self->sync;
+    sync->sync_id = sync_id;
+    sync->fup_id = fup_id;
+    sync->extended = extended;
+    sync->period = period;
+    sync->next_sync = time_us_64() + CAN_SCHED_START_US;
+    sync->role = role;
+    if (role == CAN_SYNC_MASTER) {
+        can_sched_kick();
+    }
+    restore_interrupts(state);
+
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_set_sync_obj, 2, rp2_can_set_sync);
+
+// Return a tuple of (role, locked, offset, drift, error, updates): the offset is master time - local time in
+// microseconds, the drift is in parts per billion, the error is how far the last follow-up was from the
+// estimate in microseconds and updates is the number of follow-ups used since the servo last started
+STATIC mp_obj_t rp2_can_get_sync_status(mp_obj_t self_in)
+{
+    rp2_can_obj_t *self = self_in;
+
+    uint32_t state = save_and_disable_interrupts();
+    can_sync_t sync = self->sync;
+    restore_interrupts(state);
+
+    mp_obj_tuple_t *tuple = mp_obj_new_tuple(6U, NULL);
+    tuple->items[0] = MP_OBJ_NEW_SMALL_INT(sync.role);
+    tuple->items[1] = sync.locked ? mp_const_true : mp_const_false;
+    tuple->items[2] = mp_obj_new_int_from_ll(sync.offset);
+    tuple->items[3] = mp_obj_new_int_from_ll((sync.drift * 1000000000LL) >> 32);
+    tuple->items[4] = mp_obj_new_int(sync.last_error);
+    tuple->items[5] = mp_obj_new_int_from_uint(sync.n_updates);
+
+    return tuple;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(rp2_can_get_sync_status_obj, rp2_can_get_sync_status);
+
+// Convert a 64-bit timestamp (e.g. from CANFrame.get_timestamp()) to master time, or return the master
+// time now if no timestamp is given. The master (or a controller not synchronizing) returns the timestamp
+// unchanged, and a slave returns None until it has received a follow-up frame.
+STATIC mp_obj_t rp2_can_sync_time(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_timestamp, MP_ARG_OBJ, {.u_obj = mp_const_none}},
+    };
+
+    rp2_can_obj_t *self = pos_args[0];
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    uint64_t t;
+    if (args[0].u_obj == mp_const_none) {
+        t = rp2_can_sample_timebase(self);
+    }
+    else {
+        t = rp2_can_get_uint64(args[0].u_obj);
+    }
+
+    uint64_t master;
+    if (!can_sync_master_time(self, t, &master)) {
+        return mp_const_none;
+    }
+
+    return mp_obj_new_int_from_ull(master);
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(rp2_can_sync_time_obj, 1, rp2_can_sync_time);
@@ -0,0 +1,59 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef MICROPYTHON_CANSYNC_H
+#define MICROPYTHON_CANSYNC_H
+
+#include "py/obj.h"
+
+#include "rp2_can.h"
+
+// Time synchronization over CAN. The master sends a SYNC frame (one byte: a sequence number) and, once the
+// transmit event gives the time the SYNC frame was actually sent, a follow-up frame (byte 0: the sequence
+// number, bytes 1-7: the 64-bit controller time of the SYNC frame, bottom 56 bits, big endian). A slave pairs
+// the follow-up with the time it received the SYNC frame and steers an estimate of the offset and drift of
+// its controller clock against the master's.
+
+// Default frame IDs (the same as the Python heartbeat() and drift() in canpico.py)
+#define CAN_SYNC_DEFAULT_SYNC_ID            (0x100U)
+#define CAN_SYNC_DEFAULT_FUP_ID             (0x101U)
+// Default time between SYNC frames in microseconds
+#define CAN_SYNC_DEFAULT_PERIOD_US          (1000000U)
+// Shortest time between SYNC frames
+#define CAN_SYNC_MIN_PERIOD_US              (1000U)
+// An error bigger than this steps the offset rather than steering it (e.g. the master has been reset)
+#define CAN_SYNC_STEP_US                    (1000)
+// The servo is locked when the error is within this
+#define CAN_SYNC_LOCK_US                    (10)
+// Largest drift the servo will steer to, in parts per million (crystals are usually within 100ppm)
+#define CAN_SYNC_MAX_DRIFT_PPM              (500)
+
+void can_sync_reset(rp2_can_obj_t *self);
+// Called from the scheduler alarm: sends SYNC and follow-up frames and returns when next to be called
+uint64_t can_sync_service(rp2_can_obj_t *self, uint64_t now);
+// Called from the transmit ISR with a frame sent from a transmit slot
+void can_sync_on_tx(rp2_can_obj_t *self, const can_frame_t *frame, uint64_t timestamp);
+// Called from the receive ISR with every received frame
+void can_sync_on_rx(rp2_can_obj_t *self, const can_frame_t *frame, uint64_t timestamp);
+// Converts a 64-bit timestamp to master time: false if a slave has not yet had a follow-up frame
+bool can_sync_master_time(rp2_can_obj_t *self, uint64_t t, uint64_t *master);
+
+// Methods of the CAN class
+MP_DECLARE_CONST_FUN_OBJ_KW(rp2_can_set_sync_obj);
+MP_DECLARE_CONST_FUN_OBJ_1(rp2_can_get_sync_status_obj);
+MP_DECLARE_CONST_FUN_OBJ_KW(rp2_can_sync_time_obj);
+
+#endif // MICROPYTHON_CANSYNC_H
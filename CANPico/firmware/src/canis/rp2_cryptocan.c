@@ -17,6 +17,7 @@
 #include "rp2_cryptocan.h"
 #include "rp2_can.h"
 #include "common.h"
+#include "rp2_perf.h"
 
 #ifdef CC_MEASURE
 
@@ -295,7 +296,9 @@ STATIC mp_obj_t TIME_CRITICAL_MEASURE rp2_cryptocan_receive_frame(mp_uint_t n_ar
 #ifdef CC_MEASURE
     TRIG_SET();
 #endif
+    uint32_t start = PERF_START();
     rc = cc_receive_frame(&self->rx_ctx, &cc_rxd_frame, &cc_decoded_frame, freshness, alt_freshness);
+    PERF_END(CANPERF_CRYPTOCAN_VERIFY, start);
 #ifdef CC_MEASURE
     TRIG_CLEAR();
 #endif
@@ -312,6 +315,9 @@ STATIC mp_obj_t TIME_CRITICAL_MEASURE rp2_cryptocan_receive_frame(mp_uint_t n_ar
         mp_decoded_frame->tag = 0;
         mp_decoded_frame->timestamp = mp_frame->timestamp;
         mp_decoded_frame->timestamp_valid = mp_frame->timestamp_valid; // Timestamp is the Frame B time
+        mp_decoded_frame->sync_timestamp = mp_frame->sync_timestamp;
+        mp_decoded_frame->sync_valid = mp_frame->sync_valid;
+        mp_decoded_frame->latency_valid = false;
 
         CRYPTOCAN_DEBUG_PRINT("Creating decoded frame\n");
 
@@ -387,7 +393,9 @@ STATIC TIME_CRITICAL_MEASURE mp_obj_t rp2_cryptocan_create_frames(mp_uint_t n_ar
 #ifdef CC_MEASURE
     TRIG_SET();
 #endif
+    uint32_t start = PERF_START();
     rc = cc_create_frames(&self->tx_ctx, &plaintext_cc_frame, ciphertext_cc_frames, freshness);
+    PERF_END(CANPERF_CRYPTOCAN_CREATE, start);
 #ifdef CC_MEASURE
     TRIG_CLEAR();
 #endif
@@ -405,10 +413,12 @@ STATIC TIME_CRITICAL_MEASURE mp_obj_t rp2_cryptocan_create_frames(mp_uint_t n_ar
     cc_frame_to_native_frame(mp_frame_a, &ciphertext_cc_frames[0]);
     mp_frame_a->tag = 0;
     mp_frame_a->timestamp_valid = false;
+    mp_frame_a->latency_valid = false;
     
     cc_frame_to_native_frame(mp_frame_b, &ciphertext_cc_frames[1]);
     mp_frame_b->tag = 0;
     mp_frame_b->timestamp_valid = false;
+    mp_frame_b->latency_valid = false;
     
     mp_obj_list_t *mp_frames = mp_obj_new_list(2U, NULL);
 
@@ -26,6 +26,7 @@
 #include "py/mphal.h"
 #include "tusb.h"
 #include "ports/rp2/canis/common.h"
+#include "ports/rp2/canis/rp2_perf.h"
 #include "rp2_min.h"
 
 
@@ -36,7 +37,8 @@
 #error "No second CDC for MIN"
 #endif
 
-// Second CDC port: corresponds to the descriptor index
+// Second CDC port: corresponds to the descriptor index (CAN.slcan() uses the same port, so MIN and SLCAN
+// cannot run at the same time)
 #define MIN_CDC_ITF         (1U)
 
 #ifndef TRANSPORT_PROTOCOL
@@ -50,6 +52,7 @@
 // in XIP flash).
 STATIC void usb_write(size_t len, uint8_t *src)
 {
+    uint32_t start = PERF_START();
     if (tud_cdc_n_connected(MIN_CDC_ITF)) {
         for (size_t i = 0; i < len;) {
             uint32_t n = len - i;
@@ -66,6 +69,7 @@ STATIC void usb_write(size_t len, uint8_t *src)
             i += n2;
         }
     }
+    PERF_END(CANPERF_MIN_USB_WRITE, start);
 }
 
 // Read as many characters as possible from the USB
@@ -74,10 +78,13 @@ STATIC void usb_write(size_t len, uint8_t *src)
 //      using the heap.
 STATIC uint32_t usb_read(uint8_t *dest, size_t max_len)
 {
+    uint32_t start = PERF_START();
+    uint32_t len = 0;
     if (tud_cdc_n_connected(MIN_CDC_ITF) && tud_cdc_n_available(MIN_CDC_ITF)) {
-        return tud_cdc_n_read(MIN_CDC_ITF, dest, max_len);
+        len = tud_cdc_n_read(MIN_CDC_ITF, dest, max_len);
     }
-    return 0;
+    PERF_END(CANPERF_MIN_USB_READ, start);
+    return len;
 }
 
 // Deinit the root pointer
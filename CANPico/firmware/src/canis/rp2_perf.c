@@ -0,0 +1,62 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "rp2_perf.h"
+
+#include <hardware/clocks.h>
+#include <hardware/sync.h>
+#include <py/runtime.h>
+
+// SysTick control and status register bits
+#define SYSTICK_CSR_ENABLE                  (1U << 0)
+#define SYSTICK_CSR_CLKSOURCE               (1U << 2)           // Count the processor clock
+
+void rp2_perf_init(void)
+{
+    // Free-running with no interrupt
+    systick_hw->csr = 0;
+    systick_hw->rvr = 0xffffffU;
+    systick_hw->cvr = 0;
+    systick_hw->csr = SYSTICK_CSR_CLKSOURCE | SYSTICK_CSR_ENABLE;
+
+    canperf_reset();
+}
+
+// Return a snapshot of the performance counters as bytes (see canperf.h for the layout)
+STATIC mp_obj_t rp2_perf_snapshot(void)
+{
+    vstr_t vstr;
+    vstr_init_len(&vstr, CANPERF_SNAPSHOT_SIZE);
+
+    // Locked so that the ISR counter is not updated part way through
+    uint32_t state = save_and_disable_interrupts();
+    canperf_pack(clock_get_hz(clk_sys), (uint8_t *)vstr.buf);
+    restore_interrupts(state);
+
+    return mp_obj_new_bytes_from_vstr(&vstr);
+}
+MP_DEFINE_CONST_FUN_OBJ_0(rp2_perf_snapshot_obj, rp2_perf_snapshot);
+
+// Reset all the performance counters
+STATIC mp_obj_t rp2_perf_reset(void)
+{
+    uint32_t state = save_and_disable_interrupts();
+    canperf_reset();
+    restore_interrupts(state);
+
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_0(rp2_perf_reset_obj, rp2_perf_reset);
@@ -0,0 +1,50 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Performance counters for the firmware (see canperf.h), timed with the core's SysTick timer run as a
+// free-running 24-bit down counter of CPU cycles. Intervals are only correct up to 2^24 cycles (134ms at
+// 125MHz), far longer than any of the instrumented code paths, and only on core 0 where the MicroPython
+// interpreter runs. Each counter is updated from only one context (interrupt or thread) so no locking is
+// needed.
+
+#ifndef RP2_PERF_H
+#define RP2_PERF_H
+
+#include "py/obj.h"
+
+#include "canperf.h"
+
+#ifdef CAN
+
+#include <hardware/structs/systick.h>
+
+#define PERF_START()                        (systick_hw->cvr)
+#define PERF_END(counter, start)            canperf_record((counter), ((start) - systick_hw->cvr) & 0xffffffU)
+
+// Start the cycle counter and reset the counters
+void rp2_perf_init(void);
+
+extern const mp_obj_fun_builtin_fixed_t rp2_perf_snapshot_obj;
+extern const mp_obj_fun_builtin_fixed_t rp2_perf_reset_obj;
+
+#else
+
+#define PERF_START()                        (0U)
+#define PERF_END(counter, start)            ((void)(start))
+
+#endif // CAN
+
+#endif // RP2_PERF_H
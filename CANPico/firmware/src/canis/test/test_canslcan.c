@@ -0,0 +1,217 @@
+// Copyright 2020 Canis Automotive Labs (https://canislabs.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and
+// to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Host test of the SLCAN protocol module (canslcan.c). Build and run from this directory with:
+//
+//     gcc -std=c99 -Wall -Wextra -Werror -I.. -o test_canslcan test_canslcan.c ../canslcan.c && ./test_canslcan
+
+#include <stdio.h>
+#include <string.h>
+
+#include "canslcan.h"
+
+static uint32_t failures;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+// Puts a command line (without the CR) and returns the command of the CR, checking that no earlier character
+// completes a command
+static uint32_t command(canslcan_t *slcan, const char *line, canslcan_cmd_t *cmd)
+{
+    for (const char *p = line; *p; p++) {
+        CHECK(canslcan_put(slcan, *p, cmd) == CANSLCAN_NONE);
+    }
+
+    return canslcan_put(slcan, '\r', cmd);
+}
+
+static void test_open_close(void)
+{
+    canslcan_t slcan;
+    canslcan_cmd_t cmd;
+
+    canslcan_init(&slcan);
+    CHECK(!slcan.open && !slcan.listen_only && !slcan.timestamps);
+    CHECK(command(&slcan, "C", &cmd) == CANSLCAN_ERROR);        // Not open
+    CHECK(command(&slcan, "O", &cmd) == CANSLCAN_OK);
+    CHECK(slcan.open && !slcan.listen_only);
+    CHECK(command(&slcan, "O", &cmd) == CANSLCAN_ERROR);        // Already open
+    CHECK(command(&slcan, "L", &cmd) == CANSLCAN_ERROR);
+    CHECK(command(&slcan, "F", &cmd) == CANSLCAN_STATUS);
+    CHECK(command(&slcan, "C", &cmd) == CANSLCAN_OK);
+    CHECK(!slcan.open);
+    CHECK(command(&slcan, "F", &cmd) == CANSLCAN_ERROR);        // Status only when open
+    CHECK(command(&slcan, "L", &cmd) == CANSLCAN_OK);
+    CHECK(slcan.open && slcan.listen_only);
+    CHECK(command(&slcan, "C", &cmd) == CANSLCAN_OK);
+    CHECK(command(&slcan, "O1", &cmd) == CANSLCAN_ERROR);       // Trailing characters
+
+    // Timestamps can only be changed when closed
+    CHECK(command(&slcan, "Z1", &cmd) == CANSLCAN_OK);
+    CHECK(slcan.timestamps);
+    CHECK(command(&slcan, "Z2", &cmd) == CANSLCAN_ERROR);
+    CHECK(command(&slcan, "O", &cmd) == CANSLCAN_OK);
+    CHECK(command(&slcan, "Z0", &cmd) == CANSLCAN_ERROR);
+    CHECK(slcan.timestamps);
+}
+
+static void test_bitrate(void)
+{
+    static const uint32_t bitrates[] = {10000U, 20000U, 50000U, 100000U, 125000U, 250000U, 500000U, 800000U, 1000000U};
+    canslcan_t slcan;
+    canslcan_cmd_t cmd;
+    char line[3] = "S0";
+
+    canslcan_init(&slcan);
+    for (uint32_t i = 0; i < 9U; i++) {
+        line[1] = (char)('0' + i);
+        cmd.bitrate = 0;
+        CHECK(command(&slcan, line, &cmd) == CANSLCAN_BITRATE);
+        CHECK(cmd.bitrate == bitrates[i]);
+    }
+    CHECK(command(&slcan, "S9", &cmd) == CANSLCAN_ERROR);
+    CHECK(command(&slcan, "S", &cmd) == CANSLCAN_ERROR);
+    CHECK(command(&slcan, "S10", &cmd) == CANSLCAN_ERROR);
+    CHECK(command(&slcan, "O", &cmd) == CANSLCAN_OK);
+    CHECK(command(&slcan, "S6", &cmd) == CANSLCAN_ERROR);       // Only when closed
+}
+
+static void test_frames(void)
+{
+    canslcan_t slcan;
+    canslcan_cmd_t cmd;
+
+    canslcan_init(&slcan);
+    CHECK(command(&slcan, "t1232AABB", &cmd) == CANSLCAN_ERROR); // Not open
+    CHECK(command(&slcan, "O", &cmd) == CANSLCAN_OK);
+
+    memset(&cmd, 0, sizeof(cmd));
+    CHECK(command(&slcan, "t1232AAbb", &cmd) == CANSLCAN_SEND);
+    CHECK(!cmd.ide && !cmd.remote && cmd.arbitration_id == 0x123U && cmd.dlc == 2U);
+    CHECK(cmd.data[0] == 0xaaU && cmd.data[1] == 0xbbU);
+
+    CHECK(command(&slcan, "T1ABCDEF88001122334455667F", &cmd) == CANSLCAN_SEND);
+    CHECK(cmd.ide && !cmd.remote && cmd.arbitration_id == 0x1abcdef8U && cmd.dlc == 8U);
+    CHECK(cmd.data[0] == 0x00U && cmd.data[7] == 0x7fU);
+
+    CHECK(command(&slcan, "t7FF0", &cmd) == CANSLCAN_SEND);
+    CHECK(cmd.arbitration_id == 0x7ffU && cmd.dlc == 0);
+
+    CHECK(command(&slcan, "r1004", &cmd) == CANSLCAN_SEND);
+    CHECK(!cmd.ide && cmd.remote && cmd.arbitration_id == 0x100U && cmd.dlc == 4U);
+
+    CHECK(command(&slcan, "R000000018", &cmd) == CANSLCAN_SEND);
+    CHECK(cmd.ide && cmd.remote && cmd.arbitration_id == 1U && cmd.dlc == 8U);
+
+    // A listen-only channel cannot send
+    CHECK(command(&slcan, "C", &cmd) == CANSLCAN_OK);
+    CHECK(command(&slcan, "L", &cmd) == CANSLCAN_OK);
+    CHECK(command(&slcan, "t1230", &cmd) == CANSLCAN_ERROR);
+}
+
+static void test_malformed(void)
+{
+    canslcan_t slcan;
+    canslcan_cmd_t cmd;
+
+    canslcan_init(&slcan);
+    CHECK(command(&slcan, "O", &cmd) == CANSLCAN_OK);
+    CHECK(command(&slcan, "t800", &cmd) == CANSLCAN_ERROR);     // 11-bit ID out of range
+    CHECK(command(&slcan, "T200000000", &cmd) == CANSLCAN_ERROR); // 29-bit ID out of range
+    CHECK(command(&slcan, "t12G0", &cmd) == CANSLCAN_ERROR);    // Not hex
+    CHECK(command(&slcan, "t1239", &cmd) == CANSLCAN_ERROR);    // DLC over 8
+    CHECK(command(&slcan, "t1232AA", &cmd) == CANSLCAN_ERROR);  // Short data
+    CHECK(command(&slcan, "t1231AABB", &cmd) == CANSLCAN_ERROR); // Long data
+    CHECK(command(&slcan, "t1231AZ", &cmd) == CANSLCAN_ERROR);  // Data not hex
+    CHECK(command(&slcan, "r1231AA", &cmd) == CANSLCAN_ERROR);  // Remote frame with data
+    CHECK(command(&slcan, "t12", &cmd) == CANSLCAN_ERROR);      // Truncated ID
+    CHECK(command(&slcan, "x", &cmd) == CANSLCAN_ERROR);        // Unknown command
+
+    // An empty line flushes a partial command, and LF is ignored
+    CHECK(command(&slcan, "", &cmd) == CANSLCAN_OK);
+    CHECK(canslcan_put(&slcan, '\n', &cmd) == CANSLCAN_NONE);
+    CHECK(command(&slcan, "t1230", &cmd) == CANSLCAN_SEND);
+
+    // The longest command fits, and one character more is thrown away as a whole line
+    char line[CANSLCAN_CMD_MAX + 2U];
+    memset(line, 0, sizeof(line));
+    strcpy(line, "T1ABCDEF880011223344556677");
+    CHECK(strlen(line) + 1U == CANSLCAN_CMD_MAX);
+    CHECK(command(&slcan, line, &cmd) == CANSLCAN_SEND);
+    strcat(line, "8");
+    CHECK(command(&slcan, line, &cmd) == CANSLCAN_ERROR);
+    memset(line, 'T', CANSLCAN_CMD_MAX + 1U);
+    CHECK(command(&slcan, line, &cmd) == CANSLCAN_ERROR);
+    // The line after an overlong one is parsed normally
+    CHECK(command(&slcan, "t1230", &cmd) == CANSLCAN_SEND);
+}
+
+static void test_output(void)
+{
+    canslcan_t slcan;
+    char line[CANSLCAN_LINE_MAX + 1U];
+    static const uint8_t data[8] = {0x01U, 0x23U, 0x45U, 0x67U, 0x89U, 0xabU, 0xcdU, 0xefU};
+    size_t n;
+
+    canslcan_init(&slcan);
+    n = canslcan_frame(&slcan, line, 0, false, 0x123U, false, 2U, data);
+    CHECK(n == 10U && memcmp(line, "t12320123\r", n) == 0);
+    n = canslcan_frame(&slcan, line, 0, true, 0x1abcdef8U, true, 3U, data);
+    CHECK(n == 11U && memcmp(line, "R1ABCDEF83\r", n) == 0);
+
+    // The longest line (extended ID, 8 bytes, timestamp) fits, and the timestamp wraps at 60 seconds
+    slcan.timestamps = true;
+    n = canslcan_frame(&slcan, line, 61234567ULL, true, 0x1fffffffU, false, 8U, data);
+    CHECK(n <= CANSLCAN_LINE_MAX);
+    CHECK(n == 31U && memcmp(line, "T1FFFFFFF80123456789ABCDEF04D2\r", n) == 0);
+    // A DLC over 8 is sent as 8
+    n = canslcan_frame(&slcan, line, 0, false, 0x7ffU, false, 15U, data);
+    CHECK(n == 26U && line[4] == '8');
+
+    // The status reply fits a reply and clears the raised flags
+    slcan.flags = CANSLCAN_FLAG_DATA_OVERRUN;
+    n = canslcan_status(&slcan, line, CANSLCAN_FLAG_ERROR_PASSIVE);
+    CHECK(n <= CANSLCAN_REPLY_MAX);
+    CHECK(n == 4U && memcmp(line, "F28\r", n) == 0);
+    n = canslcan_status(&slcan, line, 0);
+    CHECK(memcmp(line, "F00\r", n) == 0);
+    // The version and serial number replies sent by CAN.slcan()
+    CHECK(strlen("V1013\r") <= CANSLCAN_REPLY_MAX);
+    CHECK(strlen("NCP00\r") <= CANSLCAN_REPLY_MAX);
+}
+
+int main(void)
+{
+    test_open_close();
+    test_bitrate();
+    test_frames();
+    test_malformed();
+    test_output();
+
+    if (failures > 0) {
+        printf("%u checks failed\n", (unsigned)failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+
+    return 0;
+}
@@ -44,6 +44,7 @@ MP_DECLARE_CONST_FUN_OBJ_VAR_BETWEEN(mod_network_country_obj);
 
 #ifdef CAN
 #include "canis/rp2_can.h"
+#include "canis/rp2_perf.h"
 #endif
 
 #ifdef CANHACK
@@ -114,6 +115,8 @@ STATIC const mp_rom_map_elem_t rp2_module_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_CANIDFilter),         MP_ROM_PTR(&rp2_canidfilter_type) },
     { MP_ROM_QSTR(MP_QSTR_CANError),            MP_ROM_PTR(&rp2_canerror_type) },
     { MP_ROM_QSTR(MP_QSTR_CANOverflow),         MP_ROM_PTR(&rp2_canoverflow_type) },
+    { MP_ROM_QSTR(MP_QSTR_perf_snapshot),       MP_ROM_PTR(&rp2_perf_snapshot_obj) },
+    { MP_ROM_QSTR(MP_QSTR_perf_reset),          MP_ROM_PTR(&rp2_perf_reset_obj) },
     #endif
     #ifdef MIN_PROTOCOL
     { MP_ROM_QSTR(MP_QSTR_MIN),                 MP_ROM_PTR(&rp2_min_type) },
@@ -61,6 +61,10 @@ const uint8_t mp_usbd_desc_cfg_static[USBD_STATIC_DESC_LEN] = {
     TUD_CDC_DESCRIPTOR(USBD_ITF_CDC, USBD_STR_CDC, USBD_CDC_EP_CMD,
         USBD_CDC_CMD_MAX_SIZE, USBD_CDC_EP_OUT, USBD_CDC_EP_IN, USBD_CDC_IN_OUT_MAX_SIZE),
     #endif
+    #if CFG_TUD_CDC > 1
+    TUD_CDC_DESCRIPTOR(USBD_ITF_CDC2, USBD_STR_CDC2, USBD_CDC2_EP_CMD,
+        USBD_CDC_CMD_MAX_SIZE, USBD_CDC2_EP_OUT, USBD_CDC2_EP_IN, USBD_CDC_IN_OUT_MAX_SIZE),
+    #endif
     #if CFG_TUD_MSC
     TUD_MSC_DESCRIPTOR(USBD_ITF_MSC, 5, EPNUM_MSC_OUT, EPNUM_MSC_IN, 64),
     #endif
@@ -93,6 +97,11 @@ const uint16_t *tud_descriptor_string_cb(uint8_t index, uint16_t langid) {
             desc_str = MICROPY_HW_USB_CDC_INTERFACE_STRING;
             break;
         #endif
+        #if CFG_TUD_CDC > 1
+        case USBD_STR_CDC2:
+            desc_str = MICROPY_HW_USB_CDC2_INTERFACE_STRING;
+            break;
+        #endif
         #if CFG_TUD_MSC
         case USBD_STR_MSC:
             desc_str = MICROPY_HW_USB_MSC_INTERFACE_STRING;
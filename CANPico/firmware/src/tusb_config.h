@@ -43,6 +43,10 @@
 #define MICROPY_HW_USB_CDC_INTERFACE_STRING "Board CDC"
 #endif
 
+#ifndef MICROPY_HW_USB_CDC2_INTERFACE_STRING
+#define MICROPY_HW_USB_CDC2_INTERFACE_STRING "Board CDC2"
+#endif
+
 #ifndef MICROPY_HW_USB_MSC_INQUIRY_VENDOR_STRING
 #define MICROPY_HW_USB_MSC_INQUIRY_VENDOR_STRING "MicroPy"
 #endif
@@ -59,7 +63,10 @@
 #define CFG_TUSB_RHPORT0_MODE   (OPT_MODE_DEVICE)
 #endif
 
-#if MICROPY_HW_USB_CDC
+#if MICROPY_HW_USB_CDC && MICROPY_HW_USB_CDC_SECOND
+// The second port carries MIN (canis/rp2_min.c) or the SLCAN server (CAN.slcan())
+#define CFG_TUD_CDC             (2)
+#elif MICROPY_HW_USB_CDC
 #define CFG_TUD_CDC             (1)
 #else
 #define CFG_TUD_CDC             (0)
@@ -90,6 +97,7 @@
 
 #define USBD_STATIC_DESC_LEN (TUD_CONFIG_DESC_LEN +                     \
     (CFG_TUD_CDC ? (TUD_CDC_DESC_LEN) : 0) +  \
+    (CFG_TUD_CDC > 1 ? (TUD_CDC_DESC_LEN) : 0) +  \
     (CFG_TUD_MSC ? (TUD_MSC_DESC_LEN) : 0)    \
     )
 
@@ -99,6 +107,7 @@
 #define USBD_STR_SERIAL (0x03)
 #define USBD_STR_CDC (0x04)
 #define USBD_STR_MSC (0x05)
+#define USBD_STR_CDC2 (0x06)
 
 #define USBD_MAX_POWER_MA (250)
 
@@ -113,9 +122,20 @@
 #define USBD_CDC_EP_IN (0x82)
 #endif // CFG_TUD_CDC
 
+#if CFG_TUD_CDC > 1
+#define USBD_ITF_CDC2 (2) // needs 2 interfaces
+#define USBD_CDC2_EP_CMD (0x83)
+#define USBD_CDC2_EP_OUT (0x04)
+#define USBD_CDC2_EP_IN (0x84)
+#endif // CFG_TUD_CDC > 1
+
 #if CFG_TUD_MSC
 // Interface & Endpoint numbers for MSC come after CDC, if it is enabled
-#if CFG_TUD_CDC
+#if CFG_TUD_CDC > 1
+#define USBD_ITF_MSC (4)
+#define EPNUM_MSC_OUT (0x05)
+#define EPNUM_MSC_IN (0x85)
+#elif CFG_TUD_CDC
 #define USBD_ITF_MSC (2)
 #define EPNUM_MSC_OUT (0x03)
 #define EPNUM_MSC_IN (0x83)
@@ -129,8 +149,16 @@
 /* Limits of statically defined USB interfaces, endpoints, strings */
 #if CFG_TUD_MSC
 #define USBD_ITF_STATIC_MAX (USBD_ITF_MSC + 1)
+#if CFG_TUD_CDC > 1
+#define USBD_STR_STATIC_MAX (USBD_STR_CDC2 + 1)
+#else
 #define USBD_STR_STATIC_MAX (USBD_STR_MSC + 1)
+#endif
 #define USBD_EP_STATIC_MAX (EPNUM_MSC_OUT + 1)
+#elif CFG_TUD_CDC > 1
+#define USBD_ITF_STATIC_MAX (USBD_ITF_CDC2 + 2)
+#define USBD_STR_STATIC_MAX (USBD_STR_CDC2 + 1)
+#define USBD_EP_STATIC_MAX (((USBD_CDC2_EP_IN)&~TUSB_DIR_IN_MASK) + 1)
 #elif CFG_TUD_CDC
 #define USBD_ITF_STATIC_MAX (USBD_ITF_CDC + 2)
 #define USBD_STR_STATIC_MAX (USBD_STR_CDC + 1)